@@ -0,0 +1,747 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utils/common.h"
+#include "objects/sphere_set.h"
+#include "utils/ppm.h"
+#include "world/bvh.h"
+#include "world/camera.h"
+#include "world/flat_scene.h"
+#include "world/hittable_list.h"
+#include "world/ray_query.h"
+#include "world/scenes.h"
+
+// Self-contained benchmark driver. Results are written as JSON (stdout by default) so runs can
+// be compared across commits; progress goes to stderr.
+//
+//   raytracer_bench [--quick] [--max-objects N] [--thread-scaling] [--out results.json]
+//
+// --thread-scaling adds a report of main_world() render time from 1 to N threads for both the
+// OpenMP loop and the work-stealing scheduler.
+//
+// Regression mode renders the reference scenes at fixed seeds and compares them, and their
+// throughput, with a stored baseline. The exit code is non-zero when a check fails.
+//
+//   raytracer_bench --bless <dir>
+//   raytracer_bench --check <dir> [--tolerance 0.02] [--max-slowdown 15] [--out results.json]
+//                   [--actual-dir <dir>]
+//
+// Checking only reads dir. Renders are compared in memory, quantized as they would be stored;
+// with --actual-dir, the render of every failing scene is written there as <scene>.actual.ppm.
+
+#ifndef RAYTRACER_GIT_REV
+#define RAYTRACER_GIT_REV "unknown"
+#endif
+
+#ifndef RAYTRACER_BUILD_TYPE
+#define RAYTRACER_BUILD_TYPE "unknown"
+#endif
+
+namespace
+{
+    using bench_clock = std::chrono::steady_clock;
+
+    double seconds_since(bench_clock::time_point start)
+    {
+        return std::chrono::duration<double>(bench_clock::now() - start).count();
+    }
+
+    // Minimal JSON object writer; values are numbers, booleans or strings without characters
+    // that need escaping, which is all the benchmark emits.
+    class json_object
+    {
+    public:
+        json_object &add(const std::string &key, double value)
+        {
+            std::ostringstream s;
+            s.precision(10);
+            s << value;
+            return add_raw(key, s.str());
+        }
+        json_object &add(const std::string &key, bool value)
+        {
+            return add_raw(key, value ? "true" : "false");
+        }
+        json_object &add(const std::string &key, const std::string &value)
+        {
+            return add_raw(key, '"' + value + '"');
+        }
+        // Keeps string literals from binding to the bool overload.
+        json_object &add(const std::string &key, const char *value)
+        {
+            return add(key, std::string(value));
+        }
+        json_object &add(const std::string &key, const json_object &value)
+        {
+            return add_raw(key, value.str());
+        }
+        json_object &add(const std::string &key, const std::vector<json_object> &values)
+        {
+            std::string s = "[";
+            for (size_t i = 0; i < values.size(); i++)
+                s += (i ? ", " : "") + values[i].str();
+            return add_raw(key, s + "]");
+        }
+        std::string str() const
+        {
+            return "{" + body + "}";
+        }
+
+    private:
+        std::string body;
+
+        json_object &add_raw(const std::string &key, const std::string &value)
+        {
+            if (!body.empty())
+                body += ", ";
+            body += '"' + key + "\": " + value;
+            return *this;
+        }
+    };
+
+    // Rays from random points on a sphere of radius 3 towards random points inside the unit
+    // cube around the origin, where the microbenchmark primitives sit.
+    std::vector<ray> make_probe_rays(size_t count, unsigned seed)
+    {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<double> unit(-1.0, 1.0);
+        std::vector<ray> rays;
+        rays.reserve(count);
+        while (rays.size() < count)
+        {
+            vec3 d(unit(rng), unit(rng), unit(rng));
+            if (d.length_squared() < 1e-6 || d.length_squared() > 1)
+                continue;
+            point3 origin = 3.0 * unit_vector(d);
+            point3 target(0.5 * unit(rng), 0.5 * unit(rng), 0.5 * unit(rng));
+            rays.push_back(ray(origin, target - origin));
+        }
+        return rays;
+    }
+
+    // Calls object.hit for every probe ray until min_seconds have passed.
+    json_object bench_primitive(const std::string &name, const hittable &object, const std::vector<ray> &rays,
+                                double min_seconds)
+    {
+        size_t tested = 0;
+        size_t hits = 0;
+        hit_record rec;
+        auto start = bench_clock::now();
+        double elapsed;
+        do
+        {
+            for (const ray &r : rays)
+                hits += object.hit(r, interval(0.001, infinity), rec) ? 1 : 0;
+            tested += rays.size();
+        } while ((elapsed = seconds_since(start)) < min_seconds);
+
+        std::clog << "  " << name << ": " << tested / elapsed / 1e6 << " Mrays/s\n";
+        return json_object()
+            .add("name", name)
+            .add("rays", double(tested))
+            .add("seconds", elapsed)
+            .add("rays_per_sec", tested / elapsed)
+            .add("hit_fraction", double(hits) / double(tested));
+    }
+
+    template <typename world_t>
+    json_object bench_render(const std::string &name, const world_t &world, camera cam)
+    {
+        RT_STAT(reset_stats());
+        auto start = bench_clock::now();
+        std::vector<color> pixels = cam.render_frame(world);
+        double elapsed = seconds_since(start);
+
+        double samples = double(pixels.size()) * cam.samples_per_pixel;
+        std::clog << "  " << name << ": " << elapsed << " s\n";
+        json_object result;
+        result.add("name", name)
+            .add("width", double(cam.image_width))
+            .add("height", double(pixels.size() / cam.image_width))
+            .add("samples_per_pixel", double(cam.samples_per_pixel))
+            .add("max_depth", double(cam.max_depth))
+            .add("seconds", elapsed)
+            .add("camera_rays_per_sec", samples / elapsed);
+#ifdef RAYTRACER_STATS
+        render_stats stats = merged_stats();
+        double rays = double(stats.primary_rays + stats.secondary_rays);
+        result.add("rays", rays)
+            .add("rays_per_sec", rays / elapsed)
+            .add("intersection_tests", double(stats.total_tests()));
+#endif
+        return result;
+    }
+
+    json_object bench_scaling(int object_count, int width, int samples_per_pixel)
+    {
+        auto start = bench_clock::now();
+        hittable_list world = procedural_world(object_count);
+        double build_seconds = seconds_since(start);
+
+        // Keep the number of ray/object tests roughly constant across sizes.
+        std::vector<ray> rays;
+        size_t ray_count = size_t(std::max(64.0, 2e7 / object_count));
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<double> unit(-0.5, 0.5);
+        for (size_t i = 0; i < ray_count; i++)
+            rays.push_back(ray(point3(0, 0, 0), vec3(unit(rng), unit(rng), -1)));
+
+        hit_record rec;
+        size_t hits = 0;
+        start = bench_clock::now();
+        for (const ray &r : rays)
+            hits += world.hit(r, interval(0.001, infinity), rec) ? 1 : 0;
+        double trace_seconds = seconds_since(start);
+
+        camera cam;
+        cam.aspect_ratio = 16.0 / 9.0;
+        cam.image_width = width;
+        cam.samples_per_pixel = samples_per_pixel;
+        cam.max_depth = 8;
+        cam.vfov = 60;
+        start = bench_clock::now();
+        std::vector<color> pixels = cam.render_frame(world);
+        double render_seconds = seconds_since(start);
+
+        std::clog << "  " << object_count << " objects: build " << build_seconds << " s, "
+                  << ray_count / trace_seconds << " rays/s, render " << render_seconds << " s\n";
+        return json_object()
+            .add("objects", double(object_count))
+            .add("build_seconds", build_seconds)
+            .add("rays", double(ray_count))
+            .add("rays_per_sec", ray_count / trace_seconds)
+            .add("hit_fraction", double(hits) / double(ray_count))
+            .add("render_width", double(width))
+            .add("render_samples_per_pixel", double(samples_per_pixel))
+            .add("render_seconds", render_seconds);
+    }
+
+    // count random spheres in the probe volume, once as a list of sphere objects and once as a
+    // sphere_set, traced with the probe rays.
+    std::vector<json_object> bench_sphere_set(int count, const std::vector<ray> &rays, double min_seconds)
+    {
+        std::mt19937 rng{uint32_t(count)};
+        std::uniform_real_distribution<double> unit(-0.5, 0.5);
+        auto mat = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+        hittable_list list;
+        sphere_set set;
+        for (int k = 0; k < count; k++)
+        {
+            point3 center(unit(rng), unit(rng), unit(rng));
+            double radius = 0.02 + 0.1 * (unit(rng) + 0.5) / std::sqrt(double(count));
+            list.add(make_shared<sphere>(center, radius, mat));
+            set.add(center, radius, mat);
+        }
+
+        std::vector<json_object> results;
+        for (int as_set = 0; as_set < 2; as_set++)
+        {
+            std::string name = (as_set ? "sphere_set_" : "sphere_list_") + std::to_string(count);
+            json_object result = as_set ? bench_primitive(name, set, rays, min_seconds)
+                                        : bench_primitive(name, list, rays, min_seconds);
+            results.push_back(result.add("spheres", double(count)));
+        }
+        return results;
+    }
+
+    // Builds a bvh of the given width over world and traces rays through it until min_seconds
+    // have passed. hits counts the rays that hit, to check the layouts against each other.
+    template <int width>
+    json_object bench_bvh(const std::string &name, const hittable_list &world, const std::vector<ray> &rays,
+                          double min_seconds, size_t &hits)
+    {
+        auto start = bench_clock::now();
+        bvh<width> tree(world);
+        double build_seconds = seconds_since(start);
+
+        size_t tested = 0;
+        hit_record rec;
+        start = bench_clock::now();
+        double elapsed;
+        do
+        {
+            hits = 0;
+            for (const ray &r : rays)
+                hits += tree.hit(r, interval(0.001, infinity), rec) ? 1 : 0;
+            tested += rays.size();
+        } while ((elapsed = seconds_since(start)) < min_seconds);
+
+        double bytes = double(tree.bytes());
+        std::clog << "  " << name << " " << width << "-wide: " << tree.node_count() << " nodes, "
+                  << bytes / double(tree.primitive_count()) << " bytes/primitive, " << tested / elapsed / 1e6
+                  << " Mrays/s\n";
+        return json_object()
+            .add("scene", name)
+            .add("width", double(width))
+            .add("primitives", double(tree.primitive_count()))
+            .add("triangles", double(tree.triangle_count()))
+            .add("nodes", double(tree.node_count()))
+            .add("node_bytes", double(sizeof(typename bvh<width>::node)))
+            .add("bytes", bytes)
+            .add("bytes_per_primitive", bytes / double(tree.primitive_count()))
+            .add("build_seconds", build_seconds)
+            .add("rays_per_sec", tested / elapsed)
+            .add("hit_fraction", double(hits) / double(rays.size()));
+    }
+
+    // Binary against 4- and 8-wide compressed layouts, over scenes of increasing size.
+    std::vector<json_object> bench_hierarchies(bool quick, double min_seconds)
+    {
+        std::vector<std::pair<std::string, hittable_list>> scenes;
+        scenes.push_back({"main_world", main_world()});
+        scenes.push_back({"procedural_10000", procedural_world(10000)});
+        if (!quick)
+            scenes.push_back({"procedural_100000", procedural_world(100000)});
+
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<double> unit(-0.5, 0.5);
+        std::vector<ray> rays;
+        for (int i = 0; i < (quick ? 1 << 14 : 1 << 17); i++)
+            rays.push_back(ray(point3(0, 0, 0), vec3(unit(rng), unit(rng), -1)));
+
+        std::vector<json_object> results;
+        for (const auto &[name, world] : scenes)
+        {
+            size_t hits[3];
+            results.push_back(bench_bvh<2>(name, world, rays, min_seconds, hits[0]));
+            results.push_back(bench_bvh<4>(name, world, rays, min_seconds, hits[1]));
+            results.push_back(bench_bvh<8>(name, world, rays, min_seconds, hits[2]));
+            if (hits[1] != hits[0] || hits[2] != hits[0])
+                std::clog << "  " << name << ": layouts disagree on " << hits[0] << ", " << hits[1] << ", "
+                          << hits[2] << " hits\n";
+        }
+        return results;
+    }
+
+    // Closest-hit and any-hit batches of the same rays through a ray_query_scene, repeated
+    // until min_seconds have passed.
+    std::vector<json_object> bench_ray_queries(bool quick, double min_seconds)
+    {
+        hittable_list world = procedural_world(10000);
+        auto start = bench_clock::now();
+        ray_query_scene scene(world);
+        double build_seconds = seconds_since(start);
+
+        std::mt19937 rng(11);
+        std::uniform_real_distribution<double> unit(-0.5, 0.5);
+        std::vector<query_ray> rays(quick ? 1 << 14 : 1 << 17);
+        for (auto &q : rays)
+            q = {point3(0, 0, 0), vec3(unit(rng), unit(rng), -1), 0.001, infinity};
+
+        query_hits hits;
+        std::vector<uint8_t> occluded(rays.size());
+        std::vector<json_object> results;
+        for (int any = 0; any < 2; any++)
+        {
+            size_t traced = 0;
+            double elapsed;
+            start = bench_clock::now();
+            do
+            {
+                if (any)
+                    scene.any_hit(rays.data(), rays.size(), occluded.data());
+                else
+                    scene.closest_hit(rays.data(), rays.size(), hits);
+                traced += rays.size();
+            } while ((elapsed = seconds_since(start)) < min_seconds);
+
+            size_t hit_count = 0;
+            for (size_t k = 0; k < rays.size(); k++)
+                hit_count += any ? occluded[k] : hits.object[k] >= 0;
+            const char *name = any ? "any_hit" : "closest_hit";
+            std::clog << "  " << name << ": " << traced / elapsed / 1e6 << " Mrays/s\n";
+            results.push_back(json_object()
+                                  .add("query", name)
+                                  .add("scene", "procedural_10000")
+                                  .add("primitives", double(scene.primitive_count()))
+                                  .add("build_seconds", build_seconds)
+                                  .add("batch", double(rays.size()))
+                                  .add("rays_per_sec", traced / elapsed)
+                                  .add("hit_fraction", double(hit_count) / double(rays.size())));
+        }
+        return results;
+    }
+
+    // Renders main_world() with 1, 2, 4, ... up to every hardware thread, once with the OpenMP
+    // loop and once on a pinned work-stealing scheduler.
+    std::vector<json_object> bench_thread_scaling(bool quick)
+    {
+        hittable_list world = main_world();
+        camera cam;
+        cam.aspect_ratio = 16.0 / 9.0;
+        cam.image_width = quick ? 80 : 200;
+        cam.samples_per_pixel = quick ? 4 : 16;
+        cam.max_depth = 50;
+        cam.lookfrom = point3(2, 1.5, 1.5);
+        cam.lookat = point3(0.5, 1.25, -0.5);
+
+        int max_threads = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<int> counts;
+        for (int t = 1; t < max_threads; t *= 2)
+            counts.push_back(t);
+        counts.push_back(max_threads);
+
+        std::vector<json_object> results;
+        double base_openmp = 0, base_steal = 0;
+        for (int threads : counts)
+        {
+            omp_set_num_threads(threads);
+            cam.scheduler = nullptr;
+            auto start = bench_clock::now();
+            std::vector<color> reference = cam.render_frame(world);
+            double openmp_seconds = seconds_since(start);
+
+            cam.scheduler = make_shared<task_scheduler>(threads, true);
+            start = bench_clock::now();
+            std::vector<color> stolen = cam.render_frame(world);
+            double steal_seconds = seconds_since(start);
+            uint64_t steals = cam.scheduler->steals();
+            cam.scheduler = nullptr;
+
+            if (threads == 1)
+            {
+                base_openmp = openmp_seconds;
+                base_steal = steal_seconds;
+            }
+
+            bool identical = true;
+            for (size_t k = 0; k < reference.size() && identical; k++)
+                identical = (reference[k] - stolen[k]).near_zero();
+
+            std::clog << "  " << threads << " threads: openmp " << openmp_seconds << " s, steal "
+                      << steal_seconds << " s\n";
+            results.push_back(json_object()
+                                  .add("threads", double(threads))
+                                  .add("openmp_seconds", openmp_seconds)
+                                  .add("openmp_speedup", base_openmp / openmp_seconds)
+                                  .add("steal_seconds", steal_seconds)
+                                  .add("steal_speedup", base_steal / steal_seconds)
+                                  .add("steal_efficiency", base_steal / steal_seconds / threads)
+                                  .add("steals", double(steals))
+                                  .add("images_identical", identical));
+        }
+        omp_set_num_threads(max_threads);
+        return results;
+    }
+
+    // Writes the result to path, or to stdout when path is empty.
+    bool write_results(const json_object &result, const std::string &path)
+    {
+        if (path.empty())
+        {
+            std::cout << result.str() << '\n';
+            return true;
+        }
+        std::ofstream out(path);
+        out << result.str() << '\n';
+        if (!out)
+        {
+            std::cerr << "raytracer_bench: cannot write " << path << '\n';
+            return false;
+        }
+        return true;
+    }
+
+    struct reference_scene
+    {
+        std::string name;
+        hittable_list world;
+        camera cam;
+    };
+
+    std::vector<reference_scene> reference_scenes()
+    {
+        camera cam;
+        cam.aspect_ratio = 16.0 / 9.0;
+        cam.image_width = 96;
+        cam.samples_per_pixel = 16;
+        cam.max_depth = 50;
+        cam.seed = 2024;
+
+        std::vector<reference_scene> scenes;
+        scenes.push_back({"debug_world", debug_world(), cam});
+
+        cam.lookfrom = point3(2, 1.5, 1.5);
+        cam.lookat = point3(0.5, 1.25, -0.5);
+        scenes.push_back({"main_world", main_world(), cam});
+
+        cam.lookfrom = point3(0, 0, 0);
+        cam.lookat = point3(0, 0, -1);
+        cam.vfov = 60;
+        cam.max_depth = 8;
+        scenes.push_back({"procedural_1000", procedural_world(1000), cam});
+        return scenes;
+    }
+
+    // Compares two images by the mean color of 8x8 pixel blocks. Averaging over a block
+    // suppresses per-pixel Monte Carlo noise, so the error stays small for renders that differ
+    // only in their random paths but grows for real changes such as a missing object or a
+    // darker material. Returns the RMS of the block differences in display units [0, 1].
+    double block_rms_error(const std::vector<color> &a, const std::vector<color> &b, int width, int height)
+    {
+        const int block = 8;
+        double sum = 0;
+        int count = 0;
+        for (int by = 0; by < height; by += block)
+        {
+            for (int bx = 0; bx < width; bx += block)
+            {
+                color mean_a, mean_b;
+                int n = 0;
+                for (int y = by; y < std::min(by + block, height); y++)
+                {
+                    for (int x = bx; x < std::min(bx + block, width); x++)
+                    {
+                        mean_a += a[size_t(y) * width + x];
+                        mean_b += b[size_t(y) * width + x];
+                        n++;
+                    }
+                }
+                vec3 d = (mean_a - mean_b) / n;
+                sum += d.length_squared() / 3;
+                count++;
+            }
+        }
+        return std::sqrt(sum / count);
+    }
+
+    std::map<std::string, double> read_throughput(const std::string &path)
+    {
+        std::map<std::string, double> values;
+        std::ifstream in(path);
+        std::string name;
+        double value;
+        while (in >> name >> value)
+            values[name] = value;
+        return values;
+    }
+
+    // Renders every reference scene and either stores the images and throughput in dir
+    // (bless) or checks them against what is stored there, writing failing renders to
+    // actual_dir unless it is empty. Returns false if any check failed.
+    bool run_regression(const std::string &dir, bool bless, double tolerance, double max_slowdown,
+                        const std::string &actual_dir, std::vector<json_object> &results)
+    {
+        const std::string throughput_path = dir + "/throughput.txt";
+        std::map<std::string, double> baseline = bless ? std::map<std::string, double>() : read_throughput(throughput_path);
+        std::ofstream throughput_out;
+        if (bless)
+        {
+            throughput_out.open(throughput_path);
+            if (!throughput_out)
+            {
+                std::cerr << "raytracer_bench: cannot write " << throughput_path << '\n';
+                return false;
+            }
+        }
+
+        bool passed = true;
+        for (auto &scene : reference_scenes())
+        {
+            // Best of three runs keeps timer noise out of the throughput check.
+            std::vector<color> pixels;
+            double best = infinity;
+            for (int run = 0; run < 3; run++)
+            {
+                auto start = bench_clock::now();
+                pixels = scene.cam.render_frame(scene.world);
+                best = std::min(best, seconds_since(start));
+            }
+            double rays_per_sec = double(pixels.size()) * scene.cam.samples_per_pixel / best;
+
+            const std::string golden_path = dir + "/" + scene.name + ".ppm";
+            std::stringstream image;
+            scene.cam.write_image(image, pixels);
+
+            json_object result;
+            result.add("name", scene.name).add("camera_rays_per_sec", rays_per_sec);
+
+            if (bless)
+            {
+                std::ofstream(golden_path) << image.rdbuf();
+                throughput_out << scene.name << ' ' << rays_per_sec << '\n';
+                std::clog << "  " << scene.name << ": blessed\n";
+                results.push_back(result.add("status", "blessed"));
+                continue;
+            }
+
+            int gw, gh, aw, ah;
+            std::vector<color> golden, actual;
+            std::string status = "pass";
+            if (!read_ppm(golden_path, gw, gh, golden))
+            {
+                status = "missing golden image";
+            }
+            else if (!read_ppm(image, aw, ah, actual))
+            {
+                status = "unreadable render";
+            }
+            else if (gw != aw || gh != ah)
+            {
+                status = "size mismatch";
+            }
+            else
+            {
+                double error = block_rms_error(golden, actual, gw, gh);
+                result.add("block_rms_error", error);
+                if (error > tolerance)
+                    status = "image differs";
+            }
+
+            auto base = baseline.find(scene.name);
+            if (base != baseline.end())
+            {
+                double slowdown = 100.0 * (1.0 - rays_per_sec / base->second);
+                result.add("baseline_rays_per_sec", base->second).add("slowdown_percent", slowdown);
+                if (status == "pass" && slowdown > max_slowdown)
+                    status = "throughput regression";
+            }
+
+            if (status != "pass")
+            {
+                passed = false;
+                if (!actual_dir.empty())
+                {
+                    const std::string actual_path = actual_dir + "/" + scene.name + ".actual.ppm";
+                    image.clear();
+                    image.seekg(0);
+                    std::ofstream(actual_path) << image.rdbuf();
+                    result.add("actual_image", actual_path);
+                }
+            }
+
+            std::clog << "  " << scene.name << ": " << status << '\n';
+            results.push_back(result.add("status", status));
+        }
+        return passed;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bool quick = false;
+    int max_objects = 1000000;
+    std::string out_path;
+    std::string regression_dir, actual_dir;
+    bool bless = false;
+    double tolerance = 0.02;
+    double max_slowdown = 15;
+    bool thread_scaling = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--quick") == 0)
+            quick = true;
+        else if (std::strcmp(argv[i], "--max-objects") == 0 && i + 1 < argc)
+            max_objects = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+            out_path = argv[++i];
+        else if (std::strcmp(argv[i], "--thread-scaling") == 0)
+            thread_scaling = true;
+        else if ((std::strcmp(argv[i], "--check") == 0 || std::strcmp(argv[i], "--bless") == 0) && i + 1 < argc)
+        {
+            bless = std::strcmp(argv[i], "--bless") == 0;
+            regression_dir = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+            tolerance = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--max-slowdown") == 0 && i + 1 < argc)
+            max_slowdown = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--actual-dir") == 0 && i + 1 < argc)
+            actual_dir = argv[++i];
+        else
+        {
+            std::cerr << "usage: raytracer_bench [--quick] [--max-objects N] [--thread-scaling] [--out results.json]\n"
+                      << "       raytracer_bench --bless <dir>\n"
+                      << "       raytracer_bench --check <dir> [--tolerance 0.02] [--max-slowdown 15] [--out results.json]\n"
+                      << "                      [--actual-dir <dir>]\n";
+            return 2;
+        }
+    }
+
+    json_object result;
+    result.add("git_rev", RAYTRACER_GIT_REV)
+        .add("build_type", RAYTRACER_BUILD_TYPE)
+        .add("threads", double(omp_get_max_threads()));
+
+    bool passed = true;
+    if (!regression_dir.empty())
+    {
+        std::clog << (bless ? "Blessing " : "Checking ") << regression_dir << ":\n";
+        std::vector<json_object> regression;
+        passed = run_regression(regression_dir, bless, tolerance, max_slowdown, actual_dir, regression);
+        result.add("tolerance", tolerance)
+            .add("max_slowdown_percent", max_slowdown)
+            .add("regression", regression);
+        return write_results(result, out_path) && passed ? 0 : 1;
+    }
+
+    double min_seconds = quick ? 0.05 : 0.5;
+    std::vector<ray> rays = make_probe_rays(1 << 14, 42);
+    auto mat = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+
+    std::clog << "Primitive intersection:\n";
+    std::vector<json_object> primitives;
+    primitives.push_back(bench_primitive("sphere", sphere(point3(0, 0, 0), 0.5, mat), rays, min_seconds));
+    primitives.push_back(bench_primitive("triangle", triangle(point3(-0.5, -0.5, 0), point3(0.5, -0.5, 0), point3(0, 0.5, 0), mat), rays, min_seconds));
+    primitives.push_back(bench_primitive("plane", plane(point3(0, 0, 0), vec3(0, 0, 0), vec3(1, 1, 1), mat), rays, min_seconds));
+    primitives.push_back(bench_primitive("cube", cube(point3(0, 0, 0), vec3(0, 0, 0), vec3(1, 1, 1), mat), rays, min_seconds));
+    primitives.push_back(bench_primitive("cylinder_16", cylinder(point3(0, 0, 0), vec3(0, 0, 0), vec3(1, 1, 1), 16, mat), rays, min_seconds));
+    primitives.push_back(bench_primitive("cone_16", cone(point3(0, -0.5, 0), vec3(0, 0, 0), vec3(1, 1, 1), 16, mat), rays, min_seconds));
+
+    std::clog << "Sphere sets:\n";
+    std::vector<json_object> sphere_sets;
+    for (int count : {8, 64, 1024})
+        for (auto &result : bench_sphere_set(count, rays, min_seconds))
+            sphere_sets.push_back(result);
+
+    std::clog << "End-to-end renders:\n";
+    std::vector<json_object> renders;
+    camera cam;
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.image_width = quick ? 80 : 200;
+    cam.samples_per_pixel = quick ? 4 : 16;
+    cam.max_depth = 50;
+    renders.push_back(bench_render("debug_world", debug_world(), cam));
+    renders.push_back(bench_render("debug_world_closed", flat_scene(debug_world()), cam));
+    cam.lookfrom = point3(2, 1.5, 1.5);
+    cam.lookat = point3(0.5, 1.25, -0.5);
+    renders.push_back(bench_render("main_world", main_world(), cam));
+    renders.push_back(bench_render("main_world_closed", flat_scene(main_world()), cam));
+
+    std::clog << "Scene scaling:\n";
+    std::vector<json_object> scaling;
+    for (int n = 10; n <= max_objects; n *= 10)
+        scaling.push_back(bench_scaling(n, quick ? 16 : 32, 1));
+
+    std::clog << "Bounding volume hierarchies:\n";
+    std::vector<json_object> hierarchies = bench_hierarchies(quick, min_seconds);
+
+    std::clog << "Ray queries:\n";
+    std::vector<json_object> queries = bench_ray_queries(quick, min_seconds);
+
+    result.add("primitives", primitives)
+        .add("sphere_sets", sphere_sets)
+        .add("renders", renders)
+        .add("scaling", scaling)
+        .add("bvh", hierarchies)
+        .add("ray_queries", queries);
+
+    if (thread_scaling)
+    {
+        std::clog << "Thread scaling:\n";
+        result.add("thread_scaling", bench_thread_scaling(quick));
+    }
+
+    return write_results(result, out_path) ? 0 : 1;
+}
@@ -1,40 +1,242 @@
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
 
 #include "utils/common.h"
+#include "world/bvh.h"
 #include "world/camera.h"
+#include "world/flat_scene.h"
 #include "world/hittable_list.h"
+#include "world/lazy_bvh.h"
+#include "world/multi_view.h"
+#include "world/out_of_core.h"
+#include "utils/render_stats.h"
+#include "utils/trace.h"
+#include "world/preview_renderer.h"
+#include "world/render_server.h"
+#include "world/scenes.h"
+#include "world/sphere_sets.h"
 
-// include objects
-#include "objects/cone.h"
-#include "objects/cube.h"
-#include "objects/cylinder.h"
-#include "objects/hittable.h"
-#include "objects/plane.h"
-#include "objects/sphere.h"
-#include "objects/triangle.h"
-
-// include materials
-#include "materials/metal.h"
-#include "materials/lambertian.h"
-#include "materials/dielectric.h"
-
-// world prototypes
-hittable_list debug_world();
-hittable_list main_world();
-
-int main()
+int main(int argc, char **argv)
 {
+    // Daemon mode: raytracer --serve <socket path> [--workers N]
+    if (argc > 2 && std::strcmp(argv[1], "--serve") == 0)
+    {
+        int workers = 1;
+        if (argc > 4 && std::strcmp(argv[3], "--workers") == 0)
+            workers = std::atoi(argv[4]);
+        render_server server(argv[2], workers);
+        return server.run();
+    }
+
+    // Writes the latest frame of a running preview: raytracer --preview-snapshot <shm name>
+    if (argc > 2 && std::strcmp(argv[1], "--preview-snapshot") == 0)
+    {
+        shared_framebuffer framebuffer;
+        std::vector<unsigned char> rgba;
+        uint64_t frame;
+        if (!framebuffer.open(argv[2]) || !framebuffer.read(rgba, frame))
+        {
+            std::cerr << "raytracer: no preview frame in " << argv[2] << '\n';
+            return 1;
+        }
+        std::cout << "P3\n"
+                  << framebuffer.width() << ' ' << framebuffer.height() << "\n255\n";
+        for (size_t k = 0; k < rgba.size(); k += 4)
+            std::cout << int(rgba[k]) << ' ' << int(rgba[k + 1]) << ' ' << int(rgba[k + 2]) << '\n';
+        return 0;
+    }
+
+    std::string heatmap_path;
+    std::string heatmap_metric = "time";
+    std::string trace_path;
+    std::string scheduler_name = "openmp";
+    int threads = 0;
+    bool pin_threads = false;
+    bool closed_world = false;
+    std::string scene_id = "debug";
+    std::string preview_name;
+    bool use_irradiance_cache = false;
+    bool show_cache = false;
+    bool use_guide = false;
+    double lod_error = 0;
+    std::string environment_path;
+    double environment_intensity = 1;
+    long caustic_photons = 0;
+    long caustic_budget_mb = 0;
+    std::string geometry_path, write_geometry_path;
+    long geometry_budget_mb = 0;
+    long sphere_set_size = 0;
+    int bvh_width = 0;
+    bool lazy_bvh_build = false;
+    bool rasterize = false;
+    double progress_interval = 1;
+    std::string integrator_name = "path";
+    int samples_per_pixel = 100;
+    double ao_distance = 1;
+    int ao_samples = 4;
+    double depth_range = 10;
+    std::string metrics_path;
+    std::vector<std::pair<size_t, vec3>> nudges;
+    std::string views_spec;
+    std::string view_prefix = "view";
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--heatmap") == 0 && i + 1 < argc)
+            heatmap_path = argv[++i];
+        else if (std::strcmp(argv[i], "--heatmap-metric") == 0 && i + 1 < argc)
+            heatmap_metric = argv[++i];
+        else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+            trace_path = argv[++i];
+        else if (std::strcmp(argv[i], "--scheduler") == 0 && i + 1 < argc)
+            scheduler_name = argv[++i];
+        else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--pin") == 0)
+            pin_threads = true;
+        else if (std::strcmp(argv[i], "--closed-world") == 0)
+            closed_world = true;
+        else if (std::strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+            scene_id = argv[++i];
+        else if (std::strcmp(argv[i], "--irradiance-cache") == 0)
+            use_irradiance_cache = true;
+        else if (std::strcmp(argv[i], "--show-cache") == 0)
+            use_irradiance_cache = show_cache = true;
+        else if (std::strcmp(argv[i], "--guide") == 0)
+            use_guide = true;
+        else if (std::strcmp(argv[i], "--lod") == 0 && i + 1 < argc)
+            lod_error = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--preview") == 0 && i + 1 < argc)
+            preview_name = argv[++i];
+        else if (std::strcmp(argv[i], "--env") == 0 && i + 1 < argc)
+            environment_path = argv[++i];
+        else if (std::strcmp(argv[i], "--env-intensity") == 0 && i + 1 < argc)
+            environment_intensity = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--caustics") == 0 && i + 1 < argc)
+            caustic_photons = std::atol(argv[++i]);
+        else if (std::strcmp(argv[i], "--caustic-budget") == 0 && i + 1 < argc)
+            caustic_budget_mb = std::atol(argv[++i]);
+        else if (std::strcmp(argv[i], "--out-of-core") == 0 && i + 1 < argc)
+            geometry_path = argv[++i];
+        else if (std::strcmp(argv[i], "--write-geometry") == 0 && i + 1 < argc)
+            write_geometry_path = argv[++i];
+        else if (std::strcmp(argv[i], "--geometry-budget") == 0 && i + 1 < argc)
+            geometry_budget_mb = std::atol(argv[++i]);
+        else if (std::strcmp(argv[i], "--sphere-sets") == 0 && i + 1 < argc)
+            sphere_set_size = std::atol(argv[++i]);
+        else if (std::strcmp(argv[i], "--bvh") == 0 && i + 1 < argc)
+            bvh_width = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--lazy-bvh") == 0)
+            lazy_bvh_build = true;
+        else if (std::strcmp(argv[i], "--rasterize") == 0)
+            rasterize = true;
+        else if (std::strcmp(argv[i], "--integrator") == 0 && i + 1 < argc)
+            integrator_name = argv[++i];
+        else if (std::strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+            samples_per_pixel = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--ao-distance") == 0 && i + 1 < argc)
+            ao_distance = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--ao-samples") == 0 && i + 1 < argc)
+            ao_samples = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--depth-range") == 0 && i + 1 < argc)
+            depth_range = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--progress-interval") == 0 && i + 1 < argc)
+            progress_interval = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--metrics") == 0 && i + 1 < argc)
+            metrics_path = argv[++i];
+        else if (std::strcmp(argv[i], "--views") == 0 && i + 1 < argc)
+            views_spec = argv[++i];
+        else if (std::strcmp(argv[i], "--view-prefix") == 0 && i + 1 < argc)
+            view_prefix = argv[++i];
+        else if (std::strcmp(argv[i], "--nudge") == 0 && i + 4 < argc)
+        {
+            size_t index = size_t(std::atol(argv[i + 1]));
+            nudges.push_back({index, vec3(std::atof(argv[i + 2]), std::atof(argv[i + 3]), std::atof(argv[i + 4]))});
+            i += 4;
+        }
+        else
+        {
+            std::cerr << "usage: raytracer [--scene id] [--scheduler openmp|steal] [--threads N] [--pin] [--closed-world]\n"
+                      << "                 [--samples N] [--integrator path|normals|eye-light|depth|ao|direct]\n"
+                      << "                 [--ao-distance d] [--ao-samples N] [--depth-range d]\n"
+                      << "                 [--env sky.pfm [--env-intensity k]] [--trace trace.json]\n"
+                      << "                 [--heatmap out.ppm [--heatmap-metric time|tests]]\n"
+                      << "                 [--irradiance-cache | --show-cache] [--preview <shm name>]\n"
+                      << "                 [--caustics photons [--caustic-budget MB]] [--guide]\n"
+                      << "                 [--lod max pixel error] [--out-of-core file.rtgeo [--geometry-budget MB]]\n"
+                      << "                 [--write-geometry file.rtgeo]\n"
+                      << "                 [--sphere-sets size] [--bvh 2|4|8 [--lazy-bvh]] [--rasterize]\n"
+                      << "                 [--nudge sphere index dx dy dz]...\n"
+                      << "                 [--views stereo[:sep]|cubemap|array:N[:spacing] [--view-prefix path]]\n"
+                      << "                 [--progress-interval seconds] [--metrics file.prom]\n"
+                      << "       raytracer --serve <socket path> [--workers N]\n"
+                      << "       raytracer --preview-snapshot <shm name>\n";
+            return 2;
+        }
+    }
+    if (scheduler_name != "openmp" && scheduler_name != "steal")
+    {
+        std::cerr << "raytracer: unknown scheduler " << scheduler_name << '\n';
+        return 2;
+    }
+#ifndef RAYTRACER_STATS
+    if (!heatmap_path.empty())
+    {
+        std::cerr << "raytracer: --heatmap needs a build with -DRAYTRACER_STATS=ON\n";
+        return 2;
+    }
+#endif
+    if (bvh_width != 0 && bvh_width != 2 && bvh_width != 4 && bvh_width != 8)
+    {
+        std::cerr << "raytracer: --bvh width must be 2, 4 or 8\n";
+        return 2;
+    }
+    if (lazy_bvh_build && !bvh_width)
+        bvh_width = 4;
+    if (!nudges.empty() && (closed_world || !preview_name.empty()))
+    {
+        std::cerr << "raytracer: --nudge needs an open-world render\n";
+        return 2;
+    }
+    if (!nudges.empty() && (bvh_width || sphere_set_size > 0))
+    {
+        std::cerr << "raytracer: --nudge cannot be combined with --bvh or --sphere-sets\n";
+        return 2;
+    }
+    if (!views_spec.empty() && (!nudges.empty() || !preview_name.empty()))
+    {
+        std::cerr << "raytracer: --views cannot be combined with --nudge or --preview\n";
+        return 2;
+    }
+    if (rasterize && (!nudges.empty() || !views_spec.empty() || !preview_name.empty() || closed_world))
+    {
+        std::cerr << "raytracer: --rasterize cannot be combined with --nudge, --views, --preview or --closed-world\n";
+        return 2;
+    }
+
+    if (!trace_path.empty())
+        trace::enable();
+
     auto start = std::chrono::high_resolution_clock::now();
     // World
-    hittable_list world = debug_world();
-    // hittable_list world = main_world();
+    hittable_list world;
+    {
+        trace::scope scope("scene build");
+        if (!make_scene(scene_id, world))
+        {
+            std::cerr << "raytracer: unknown scene " << scene_id << '\n';
+            return 2;
+        }
+    }
 
     // Camera
     camera cam;
 
     cam.aspect_ratio = 16.0 / 9.0;
     cam.image_width = 400;
-    cam.samples_per_pixel = 100;
+    cam.samples_per_pixel = samples_per_pixel;
     cam.max_depth = 50;
 
     // cam.lookfrom = point3(2, 1.5, 1.5);
@@ -48,105 +250,272 @@ int main()
     // cam.vfov = 60;
     // cam.vfov = 75;
 
-    cam.render(world);
+    if (!camera::integrator_named(integrator_name, cam.integrator))
+    {
+        std::cerr << "raytracer: unknown integrator " << integrator_name << '\n';
+        return 2;
+    }
+    if (samples_per_pixel < 1)
+    {
+        std::cerr << "raytracer: --samples must be at least 1\n";
+        return 2;
+    }
+    cam.ao_distance = ao_distance;
+    cam.ao_samples = ao_samples;
+    cam.depth_range = depth_range;
+
+    if (!environment_path.empty())
+    {
+        cam.environment = environment_map::load(environment_path, environment_intensity);
+        if (!cam.environment)
+        {
+            std::cerr << "raytracer: cannot read environment map " << environment_path << '\n';
+            return 2;
+        }
+    }
+
+    if (use_irradiance_cache)
+    {
+        cam.irradiance = make_shared<irradiance_cache>();
+        cam.irradiance->show_records = show_cache;
+    }
+
+    if (caustic_photons > 0)
+    {
+        cam.caustics = make_shared<photon_map>();
+        cam.caustics->photon_count = size_t(caustic_photons);
+        if (caustic_budget_mb > 0)
+            cam.caustics->memory_budget = size_t(caustic_budget_mb) << 20;
+    }
+
+    if (use_guide)
+        cam.guide = make_shared<path_guide>(world.bounding_box());
+
+    cam.progress = make_shared<render_progress>();
+    cam.progress->interval = progress_interval;
+    cam.progress->metrics_path = metrics_path;
+
+    if (scheduler_name == "steal")
+        cam.scheduler = make_shared<task_scheduler>(threads, pin_threads);
+    else if (threads > 0)
+        omp_set_num_threads(threads);
+
+    if (lod_error > 0)
+    {
+        trace::scope scope("tessellate");
+        cam.lod_error = lod_error;
+        world.update_lod(cam.lod());
+    }
+
+    if (!write_geometry_path.empty())
+    {
+        trace::scope scope("write geometry");
+        if (!write_scene_geometry(world, write_geometry_path))
+        {
+            std::cerr << "raytracer: cannot write geometry file " << write_geometry_path << '\n';
+            return 2;
+        }
+        geometry_file file;
+        file.open(write_geometry_path);
+        uint32_t unknown = 0;
+        for (uint32_t m = 0; m < file.material_count(); m++)
+            unknown += file.material(m).kind == geometry_material::unknown;
+        std::clog << "Wrote " << file.triangle_count() << " triangles and " << file.material_count()
+                  << " materials to " << write_geometry_path << '\n';
+        if (unknown > 0)
+            std::cerr << "raytracer: " << unknown << " materials of unsupported types will render magenta\n";
+        return 0;
+    }
+
+    shared_ptr<streamed_mesh> streamed;
+    if (!geometry_path.empty())
+    {
+        trace::scope scope("open geometry");
+        if (geometry_budget_mb > 0)
+            geometry_cache::global().set_budget(size_t(geometry_budget_mb) << 20);
+        streamed = open_scene_geometry(geometry_path);
+        if (!streamed)
+        {
+            std::cerr << "raytracer: cannot read geometry file " << geometry_path << '\n';
+            return 2;
+        }
+        world = without_triangles(world);
+        world.add(streamed);
+        std::clog << "Streamed triangles: " << streamed->triangle_count() << " from " << geometry_path << '\n';
+    }
+
+    if (sphere_set_size > 0)
+    {
+        trace::scope scope("sphere sets");
+        std::clog << "Sphere sets: " << make_sphere_sets(world, size_t(sphere_set_size)) << '\n';
+    }
+
+    if (rasterize)
+    {
+        // From the scene as it will be rendered, before any hierarchy hides its triangles.
+        cam.raster = make_shared<raster_scene>(world);
+        std::clog << "Rasterized: " << cam.raster->triangle_count() << " triangles, "
+                  << cam.raster->other_count() << " other primitives traced\n";
+    }
+
+    shared_ptr<hittable> lazy;
+    if (bvh_width && lazy_bvh_build)
+    {
+        // Only the coarse partition now; subtrees are built by the first rays to reach them.
+        if (bvh_width == 2)
+            lazy = make_shared<lazy_bvh<2>>(world);
+        else if (bvh_width == 4)
+            lazy = make_shared<lazy_bvh<4>>(world);
+        else
+            lazy = make_shared<lazy_bvh<8>>(world);
+        world = hittable_list(lazy);
+    }
+    else if (bvh_width)
+    {
+        trace::scope scope("build bvh");
+        auto build_start = std::chrono::high_resolution_clock::now();
+        shared_ptr<hittable> tree;
+        size_t nodes, bytes, primitives;
+        auto build = [&](auto made) {
+            nodes = made->node_count();
+            bytes = made->bytes();
+            primitives = made->primitive_count();
+            tree = made;
+        };
+        if (bvh_width == 2)
+            build(make_shared<bvh<2>>(world));
+        else if (bvh_width == 4)
+            build(make_shared<bvh<4>>(world));
+        else
+            build(make_shared<bvh<8>>(world));
+        world = hittable_list(tree);
+        std::chrono::duration<double> build_time = std::chrono::high_resolution_clock::now() - build_start;
+        std::clog << "BVH: " << bvh_width << "-wide, " << nodes << " nodes, " << bytes / 1024 << " KiB, "
+                  << (primitives ? double(bytes) / double(primitives) : 0) << " bytes per primitive, built in "
+                  << build_time.count() << " s\n";
+    }
+
+    if (cam.caustics)
+    {
+        cam.build_caustics(world);
+        std::clog << "Caustic photons: " << cam.caustics->size() << " of " << cam.caustics->emitted()
+                  << " emitted, " << cam.caustics->bytes() / 1024 << " KiB\n";
+    }
+
+    std::vector<view> views;
+    if (!views_spec.empty() && !make_views(views_spec, cam, views))
+    {
+        std::cerr << "raytracer: unknown views " << views_spec << '\n';
+        return 2;
+    }
+
+    if (!preview_name.empty())
+    {
+        if (closed_world)
+        {
+            flat_scene flat(world);
+            return run_preview(cam, flat, preview_name, std::cin);
+        }
+        return run_preview(cam, world, preview_name, std::cin);
+    }
+
+    if (closed_world)
+    {
+        flat_scene flat;
+        {
+            trace::scope scope("scene finalize");
+            flat = flat_scene(world);
+        }
+        if (views.empty())
+            cam.render(flat);
+        else if (!write_views(views, render_views(views, flat), view_prefix))
+            return 1;
+    }
+    else if (!views.empty())
+    {
+        if (!write_views(views, render_views(views, world), view_prefix))
+            return 1;
+    }
+    else if (!nudges.empty())
+    {
+        // Render, move the spheres, and render again through the dependency map.
+        for (const auto &nudge : nudges)
+        {
+            if (nudge.first >= world.objects.size() || !std::dynamic_pointer_cast<sphere>(world.objects[nudge.first]))
+            {
+                std::cerr << "raytracer: object " << nudge.first << " is not a sphere\n";
+                return 2;
+            }
+        }
+        cam.dependencies = make_shared<dependency_map>();
+        std::vector<color> pixels = cam.render_frame(world);
+        std::vector<size_t> changed;
+        for (const auto &[index, offset] : nudges)
+        {
+            auto s = std::dynamic_pointer_cast<sphere>(world.objects[index]);
+            aabb box = s->bounding_box();
+            world.objects[index] = make_shared<sphere>(box.center() + offset, 0.5 * box.extent().x(), s->material_ptr());
+            changed.push_back(index);
+        }
+        auto edit_start = std::chrono::high_resolution_clock::now();
+        pixels = cam.rerender_frame(world, std::move(pixels), changed);
+        std::chrono::duration<double> edit_time = std::chrono::high_resolution_clock::now() - edit_start;
+        cam.write_image(std::cout, pixels);
+        std::clog << "Done.\n"
+                  << "Re-rendered " << cam.last_rerendered_tiles() << " of " << cam.dependencies->tiles()
+                  << " tiles in " << edit_time.count() << " seconds (dependencies: "
+                  << cam.dependencies->bytes() / 1024 << " KiB)\n";
+    }
+    else
+        cam.render(world);
 
     auto end = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> elapsed = end - start;
     std::clog << "Time elapsed = " << elapsed.count() << " seconds.\n"
               << std::flush;
-}
+    if (cam.irradiance)
+        std::clog << "Irradiance cache records: " << cam.irradiance->size() << '\n';
+    if (cam.guide)
+        std::clog << "Guide cells: " << cam.guide->cells() << '\n';
+    if (!views.empty())
+        std::clog << "Views: " << views.size() << " written to " << view_prefix << "_*.ppm\n";
+    if (lazy)
+    {
+        auto report = [&](const auto &tree) {
+            std::clog << "BVH buckets built: " << tree.built_count() << " of " << tree.bucket_count() << ", "
+                      << tree.bytes() / 1024 << " KiB\n";
+        };
+        if (bvh_width == 2)
+            report(static_cast<const lazy_bvh<2> &>(*lazy));
+        else if (bvh_width == 4)
+            report(static_cast<const lazy_bvh<4> &>(*lazy));
+        else
+            report(static_cast<const lazy_bvh<8> &>(*lazy));
+    }
+    if (streamed)
+    {
+        auto s = streamed->stats();
+        uint64_t lookups = s.chunk_hits + s.chunk_loads;
+        std::clog << "Geometry chunks: " << s.chunk_loads << " paged in, " << s.evictions << " evicted, "
+                  << (lookups ? 100.0 * double(s.chunk_hits) / double(lookups) : 0.0) << "% hits, "
+                  << s.resident_bytes / 1024 << " KiB resident\n"
+                  << "Page faults: " << s.major_faults << " major, " << s.minor_faults << " minor\n";
+    }
 
-hittable_list main_world()
-{
-    // Materials
-    auto debug = make_shared<lambertian>(color(0.7, 0.7, 0.7));
-    auto cone_mat = make_shared<lambertian>(color(0.1, 0.1, 0.1));
-    auto floor_mat = make_shared<lambertian>(color(0.094, 0.094, 0.094));
-    auto wall_mat = make_shared<lambertian>(color(0.008, 0.188, 0.125));
-    auto wood_mat = make_shared<lambertian>(color(0.702, 0.373, 0.09));
-    auto dark_wood_mat = make_shared<lambertian>(color(0.569, 0.302, 0.071));
-    auto metal_mat = make_shared<metal>(color(0.9, 0.9, 0.9), 0.15);
-    auto cone_metal_mat = make_shared<metal>(color(0.5, 0.5, 0.5), 0.15);
-    auto glass_mat = make_shared<dielectric>(1.50);
-    auto air_mat = make_shared<dielectric>(1.00 / 1.50);
-
-    // Objects
-    hittable_list world;
+    if (!trace_path.empty())
+    {
+        trace::disable();
+        std::ofstream trace_file(trace_path);
+        trace::write_chrome_trace(trace_file);
+    }
 
-    // Planes
-    auto back_plane = make_shared<plane>(point3(1.5, 3.25, -3.5), point3(pi / 2, 0, 0), point3(7.5, 1, 7.5), wall_mat);
-    auto floor = make_shared<plane>(point3(0, 0, 0), point3(0, 0, 0), point3(20, 1, 20), floor_mat);
-    auto left_plane_1 = make_shared<plane>(point3(-1.5, 3, 2), point3(0, 0, -pi / 2), point3(6.5, 1, 3), wall_mat);
-    auto left_plane_2 = make_shared<plane>(point3(-1.5, 3, -2.5), point3(0, 0, -pi / 2), point3(7.5, 1, 3.5), wall_mat);
-    auto left_plane_3 = make_shared<plane>(point3(-1.5, 0.75, -0.25), point3(0, 0, -pi / 2), point3(2.5, 1, 2), wall_mat);
-    auto left_plane_4 = make_shared<plane>(point3(-1.5, 5.25, -0.25), point3(0, 0, -pi / 2), point3(2, 1, 2), wall_mat);
-
-    // Cubes
-    auto back_rest = make_shared<cube>(point3(0.5, 1.9, -1.25), point3(-pi / 18, 0, 0), point3(1.2, 1.6, 0.1), wood_mat);
-    auto left_arm_rest = make_shared<cube>(point3(1.1, 1.6, -0.6), point3(0, 0, 0), point3(0.15, 0.1, 1.4), dark_wood_mat);
-    auto right_arm_rest = make_shared<cube>(point3(-0.1, 1.6, -0.6), point3(0, 0, 0), point3(0.15, 0.1, 1.4), dark_wood_mat);
-    auto left_arm_rest_supp = make_shared<cube>(point3(1.1, 1.375, -0.05), point3(0, 0, 0), point3(0.05, 0.4, 0.15), dark_wood_mat);
-    auto right_arm_rest_supp = make_shared<cube>(point3(-0.1, 1.375, -0.05), point3(0, 0, 0), point3(0.05, 0.4, 0.15), dark_wood_mat);
-    auto seat = make_shared<cube>(point3(0.5, 1.1, -0.5), point3(0, 0, 0), point3(1.4, 0.15, 1.4), wood_mat);
-
-    // Cylinders
-    auto leg_1 = make_shared<cylinder>(point3(0, 0.5, 0), point3(-pi / 18 * 1.5, 0, 0), point3(0.1, 1.1, 0.1), 16, metal_mat);
-    auto leg_2 = make_shared<cylinder>(point3(1, 0.5, 0), point3(-pi / 18 * 1.5, 0, 0), point3(0.1, 1.1, 0.1), 16, metal_mat);
-    auto leg_3 = make_shared<cylinder>(point3(1, 0.5, -1), point3(pi / 18 * 1.5, 0, 0), point3(0.1, 1.1, 0.1), 16, metal_mat);
-    auto leg_4 = make_shared<cylinder>(point3(0, 0.5, -1), point3(pi / 18 * 1.5, 0, 0), point3(0.1, 1.1, 0.1), 16, metal_mat);
-
-    // Other Shapes
-    auto cone_obj = make_shared<cone>(point3(0.7, 1, -0.7), point3(0, 0, 0), point3(0.75, 1, 0.75), 16, cone_metal_mat);
-    auto sphere_obj = make_shared<sphere>(point3(0.3, 1.475, -0.25), 0.3, glass_mat);
-    auto inner_sphere_obj = make_shared<sphere>(point3(0.3, 1.475, -0.3), 0.25, air_mat);
-
-    world.add(back_plane);
-    world.add(floor);
-    world.add(left_plane_1);
-    world.add(left_plane_2);
-    world.add(left_plane_3);
-    world.add(left_plane_4);
-
-    world.add(back_rest);
-    world.add(left_arm_rest);
-    world.add(right_arm_rest);
-    world.add(left_arm_rest_supp);
-    world.add(right_arm_rest_supp);
-    world.add(seat);
-
-    world.add(leg_1);
-    world.add(leg_2);
-    world.add(leg_3);
-    world.add(leg_4);
-
-    world.add(cone_obj);
-    world.add(sphere_obj);
-    world.add(inner_sphere_obj);
-
-    return world;
+#ifdef RAYTRACER_STATS
+    print_stats(std::clog, merged_stats(), elapsed.count());
+    if (!heatmap_path.empty())
+    {
+        std::ofstream heatmap(heatmap_path);
+        write_heatmap(heatmap, cam.image_width, cam.height(),
+                      heatmap_metric == "tests" ? cam.last_pixel_tests() : cam.last_pixel_times());
+    }
+#endif
 }
-
-hittable_list debug_world()
-{
-    // Materials
-    auto material_ground = make_shared<lambertian>(color(0.8, 0.8, 0.0));
-    auto material_center = make_shared<lambertian>(color(0.1, 0.2, 0.5));
-    auto material_center2 = make_shared<lambertian>(color(0.1, 0.5, 0.2));
-    auto material_triangle = make_shared<lambertian>(color(0.5, 0.2, 0.1));
-    auto material_left = make_shared<dielectric>(1.50);
-    auto material_bubble = make_shared<dielectric>(1.00 / 1.50);
-    auto material_right = make_shared<metal>(color(0.8, 0.6, 0.2), 1);
-
-    // World
-    hittable_list world;
-
-    world.add(make_shared<plane>(point3(0, -0.5, 0), point3(0, 0, 0), point3(100, 1, 100), material_ground));
-    world.add(make_shared<cube>(point3(0, 0, -1.2), point3(pi / 4, -pi / 4, pi / 4), point3(1, 0.5, 0.5), material_center));
-    world.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), 0.5, material_left));
-    world.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), 0.4, material_bubble));
-    world.add(make_shared<cone>(point3(1.2, -0.3, -1), point3(-pi / 18 * 1.5, pi / 32, -pi / 18 * 2.5), point3(1, 1.5, 1), 16, material_right));
-    world.add(make_shared<cylinder>(point3(0.5, -0.45, -0.7), point3(0, pi / 32, 0), point3(0.7, 0.1, 0.7), 20, material_center2));
-    // world.add(make_shared<sphere>(point3(1.0, 0.0, -1.0), 0.5, material_right));
-
-    return world;
-}
\ No newline at end of file
@@ -1,8 +1,11 @@
+#ifndef DIELECTRIC_H
+#define DIELECTRIC_H
+
 #include "material.h"
 #include "vec3.h"
 #include "color.h"
 
-class dielectric : public material
+class dielectric final : public material
 {
 public:
     dielectric(double refraction_index) : refraction_index(refraction_index) {}
@@ -10,6 +13,7 @@ public:
     bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered)
         const override
     {
+        RT_STAT(local_stats().scatters[stat_dielectric]++);
         attenuation = color(1.0, 1.0, 1.0);
         double ri = rec.front_face ? (1.0 / refraction_index) : refraction_index;
 
@@ -29,6 +33,10 @@ public:
         return true;
     }
 
+    bool is_specular() const override { return true; }
+
+    double index() const { return refraction_index; }
+
 private:
     // Refractive index in vacuum or air, or the ratio of the material's refractive index over
     // the refractive index of the enclosing media
@@ -41,4 +49,6 @@ private:
         r0 = r0 * r0;
         return r0 + (1 - r0) * std::pow((1 - cosine), 5);
     }
-};
\ No newline at end of file
+};
+
+#endif
\ No newline at end of file
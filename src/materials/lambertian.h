@@ -1,21 +1,50 @@
+#ifndef LAMBERTIAN_H
+#define LAMBERTIAN_H
+
 #include "material.h"
+#include "../textures/texture.h"
 
-class lambertian : public material
+class lambertian final : public material
 {
 public:
     lambertian(const color &albedo) : albedo(albedo) {}
 
+    lambertian(shared_ptr<texture> tex) : albedo(0, 0, 0), tex(tex) {}
+
     bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered)
         const override
     {
+        RT_STAT(local_stats().scatters[stat_lambertian]++);
         auto scatter_direction = rec.normal + random_unit_vector();
         if (scatter_direction.near_zero())
             scatter_direction = rec.normal;
         scattered = ray(rec.p, scatter_direction);
-        attenuation = albedo;
+        attenuation = albedo_at(r_in, rec);
         return true;
     }
 
+    // scatter() samples the cosine-weighted hemisphere.
+    double scatter_pdf(const ray &, const hit_record &rec, const vec3 &wi) const override
+    {
+        return std::fmax(0.0, dot(rec.normal, unit_vector(wi))) / pi;
+    }
+
+    color eval_scatter(const ray &r_in, const hit_record &rec, const vec3 &wi) const override
+    {
+        return albedo_at(r_in, rec) * (std::fmax(0.0, dot(rec.normal, unit_vector(wi))) / pi);
+    }
+
+    const color &albedo_color() const { return albedo; }
+    const shared_ptr<texture> &albedo_texture() const { return tex; }
+
 private:
     color albedo;
-};
\ No newline at end of file
+    shared_ptr<texture> tex; // overrides albedo when set
+
+    color albedo_at(const ray &r_in, const hit_record &rec) const
+    {
+        return tex ? texture_value(*tex, r_in, rec) : albedo;
+    }
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define MATERIAL_H
 
 #include "../objects/hittable.h"
+#include "../utils/render_stats.h"
 
 class material
 {
@@ -13,6 +14,24 @@ public:
     {
         return false;
     }
+
+    // Materials whose scatter() draws directions from a density (rather than a mirror or
+    // refraction direction) report that density for direction wi here, and the matching
+    // BSDF * cos(theta) from eval_scatter(). The camera uses both to add light samples with
+    // multiple importance sampling. The default 0 marks the material as specular.
+    virtual double scatter_pdf(const ray &r_in, const hit_record &rec, const vec3 &wi) const
+    {
+        return 0;
+    }
+
+    virtual color eval_scatter(const ray &r_in, const hit_record &rec, const vec3 &wi) const
+    {
+        return color(0, 0, 0);
+    }
+
+    // True for materials that only reflect or refract (the ones with scatter_pdf 0 that do
+    // scatter), so the light paths they redirect form caustics.
+    virtual bool is_specular() const { return false; }
 };
 
 #endif
\ No newline at end of file
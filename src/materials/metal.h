@@ -1,6 +1,9 @@
+#ifndef METAL_H
+#define METAL_H
+
 #include "material.h"
 
-class metal : public material
+class metal final : public material
 {
 public:
     metal(const color &albedo, double fuzz) : albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1) {}
@@ -8,6 +11,7 @@ public:
     bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered)
         const override
     {
+        RT_STAT(local_stats().scatters[stat_metal]++);
         vec3 reflected = reflect(r_in.direction(), rec.normal);
         reflected = unit_vector(reflected) + (fuzz * random_unit_vector());
         scattered = ray(rec.p, reflected);
@@ -15,7 +19,14 @@ public:
         return (dot(scattered.direction(), rec.normal) > 0);
     }
 
+    bool is_specular() const override { return true; }
+
+    const color &albedo_color() const { return albedo; }
+    double fuzziness() const { return fuzz; }
+
 private:
     color albedo;
     double fuzz;
-};
\ No newline at end of file
+};
+
+#endif
\ No newline at end of file
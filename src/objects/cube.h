@@ -1,6 +1,7 @@
 #ifndef CUBE_H
 #define CUBE_H
 #include "../utils/vec3.h"
+#include "../utils/render_stats.h"
 #include "hittable.h"
 #include "triangle.h"
 
@@ -15,6 +16,7 @@ public:
 
     bool hit(const ray &r, interval ray_t, hit_record &rec) const override
     {
+        RT_STAT(local_stats().tests[stat_cube]++);
         hit_record temp_rec;
         bool hit_anything = false;
         auto closest_so_far = ray_t.max;
@@ -31,11 +33,19 @@ public:
         return hit_anything;
     }
 
+    aabb bounding_box() const override { return bbox; }
+
+    aabb specular_bounds() const override
+    {
+        return mat && mat->is_specular() ? bbox : aabb();
+    }
+
     const std::vector<std::shared_ptr<triangle>> &triangles() const { return tris; }
 
 private:
     std::vector<std::shared_ptr<triangle>> tris;
     shared_ptr<material> mat;
+    aabb bbox;
 
     void build(const point3 &loc, const vec3 &rot, const vec3 &scale, std::shared_ptr<material> mat)
     {
@@ -82,13 +92,17 @@ private:
             {1, 6, 2}};
 
         tris.clear();
+        bbox = aabb();
         tris.reserve(12);
         for (int i = 0; i < 12; ++i)
         {
             point3 A = v[t[i][0]];
             point3 B = v[t[i][1]];
             point3 C = v[t[i][2]];
-            tris.push_back(std::make_shared<triangle>(A, B, C, mat));
+            vec3 uvs[3];
+            base_mesh_uvs(base[t[i][0]], base[t[i][1]], base[t[i][2]], false, uvs);
+            tris.push_back(std::make_shared<triangle>(A, B, C, mat, uvs[0], uvs[1], uvs[2]));
+            bbox = aabb(bbox, tris.back()->bounding_box());
         }
     }
 };
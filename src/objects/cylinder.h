@@ -1,6 +1,7 @@
 #ifndef CYLINDER_H
 #define CYLINDER_H
 #include "../utils/vec3.h"
+#include "../utils/render_stats.h"
 #include "hittable.h"
 #include "triangle.h"
 
@@ -8,13 +9,15 @@ class cylinder : public hittable
 {
 public:
     // rot must be in radians
-    cylinder(const point3 &loc, const vec3 &rot, const vec3 &scale, int divisions, std::shared_ptr<material> mat) : mat(mat)
+    cylinder(const point3 &loc, const vec3 &rot, const vec3 &scale, int divisions, std::shared_ptr<material> mat)
+        : mat(mat), location(loc), rotation(rot), scaling(scale)
     {
         build(loc, rot, scale, divisions, mat);
     }
 
     bool hit(const ray &r, interval ray_t, hit_record &rec) const override
     {
+        RT_STAT(local_stats().tests[stat_cylinder]++);
         hit_record temp_rec;
         bool hit_anything = false;
         auto closest_so_far = ray_t.max;
@@ -31,11 +34,34 @@ public:
         return hit_anything;
     }
 
+    aabb bounding_box() const override { return bbox; }
+
+    aabb specular_bounds() const override
+    {
+        return mat && mat->is_specular() ? bbox : aabb();
+    }
+
+    // Replaces the divisions given at construction with as many as the circle needs on screen.
+    bool update_lod(const lod_view &view) override
+    {
+        int needed = lod_segments(view, bbox, 0.5 * std::fmax(scaling.x(), scaling.z()));
+        if (!lod_rebuild(divisions, needed))
+            return false;
+        build(location, rotation, scaling, needed, mat);
+        return true;
+    }
+
     const std::vector<std::shared_ptr<triangle>> &triangles() const { return tris; }
+    int segments() const { return divisions; }
 
 private:
     std::vector<std::shared_ptr<triangle>> tris;
     shared_ptr<material> mat;
+    aabb bbox;
+    point3 location;
+    vec3 rotation;
+    vec3 scaling;
+    int divisions = 0;
 
     std::vector<vec3> make_cylinder(int n)
     {
@@ -127,14 +153,19 @@ private:
         // 4 * divisions triangles
         std::vector<std::vector<int>> t = make_cone_triangles(divisions);
 
+        this->divisions = divisions;
         tris.clear();
+        bbox = aabb();
         tris.reserve(4 * divisions);
         for (int i = 0; i < 4 * divisions; ++i)
         {
             point3 A = v[t[i][0]];
             point3 B = v[t[i][1]];
             point3 C = v[t[i][2]];
-            tris.push_back(std::make_shared<triangle>(A, B, C, mat));
+            vec3 uvs[3];
+            base_mesh_uvs(base[t[i][0]], base[t[i][1]], base[t[i][2]], true, uvs);
+            tris.push_back(std::make_shared<triangle>(A, B, C, mat, uvs[0], uvs[1], uvs[2]));
+            bbox = aabb(bbox, tris.back()->bounding_box());
         }
     }
 };
@@ -0,0 +1,339 @@
+#ifndef GEOMETRY_FILE_H
+#define GEOMETRY_FILE_H
+
+#include "../utils/aabb.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Triangle geometry split into spatial chunks (.rtgeo), with the materials it uses. Layout,
+// all numbers in the writing host's native byte order:
+//
+//   header      magic "RTGEO02\0", uint32 node_count, uint32 material_count,
+//               uint64 triangle_count, uint64 string_bytes, uint64 offset of the triangle data
+//   materials   per material index, float bounds[6] (lo xyz, hi xyz) of its triangles, then
+//               uint32 kind, double albedo[3], double parameter, uint32 texture_offset and
+//               uint32 texture_length (its texture's path in the strings)
+//   strings     string_bytes of texture paths
+//   nodes       kd-tree over the chunks, root first
+//   triangles   packed_triangle records, each chunk's contiguous
+//
+// Every leaf node is a chunk: triangles [first, first + count) of the triangle data, a block
+// that is read as a unit.
+struct packed_triangle
+{
+    float vertex[9];
+    float uv[6];
+    uint32_t material;
+};
+
+// A material as a geometry file stores it: enough to recreate the scene's own lambertian,
+// metal and dielectric materials, with lambertian albedo from an image texture when texture
+// is set. Materials of other types are stored as unknown.
+struct geometry_material
+{
+    enum kind_t : uint32_t
+    {
+        unknown,
+        lambertian,
+        metal,
+        dielectric
+    };
+
+    kind_t kind = unknown;
+    double albedo[3] = {0, 0, 0};
+    double parameter = 0; // fuzz of metal, refraction index of dielectric, repeat of texture
+    std::string texture;  // image path, for lambertian
+};
+
+struct geometry_node
+{
+    float lo[3];
+    float hi[3];
+    int32_t child[2]; // -1 for leaves
+    uint32_t first;
+    uint32_t count;   // triangles, 0 for interior nodes
+};
+
+namespace geometry_detail
+{
+    const char magic[8] = {'R', 'T', 'G', 'E', 'O', '0', '2', '\0'};
+    const size_t header_size = sizeof(magic) + 2 * sizeof(uint32_t) + 3 * sizeof(uint64_t);
+    const size_t material_size = 6 * sizeof(float) + sizeof(uint32_t) + 4 * sizeof(double) + 2 * sizeof(uint32_t);
+
+    inline float centroid(const packed_triangle &t, int axis)
+    {
+        return (t.vertex[axis] + t.vertex[3 + axis] + t.vertex[6 + axis]) / 3;
+    }
+
+    inline void grow(float lo[3], float hi[3], const packed_triangle &t)
+    {
+        for (int v = 0; v < 3; v++)
+            for (int a = 0; a < 3; a++)
+            {
+                lo[a] = std::min(lo[a], t.vertex[3 * v + a]);
+                hi[a] = std::max(hi[a], t.vertex[3 * v + a]);
+            }
+    }
+
+    // Splits triangles [begin, end) at the median centroid of their widest axis until chunks
+    // hold at most chunk_size triangles. Returns the node index.
+    inline int32_t split(std::vector<packed_triangle> &tris, std::vector<geometry_node> &nodes,
+                         uint32_t begin, uint32_t end, uint32_t chunk_size)
+    {
+        geometry_node node;
+        for (int a = 0; a < 3; a++)
+        {
+            node.lo[a] = infinity;
+            node.hi[a] = -infinity;
+        }
+        float clo[3] = {float(infinity), float(infinity), float(infinity)};
+        float chi[3] = {float(-infinity), float(-infinity), float(-infinity)};
+        for (uint32_t i = begin; i < end; i++)
+        {
+            grow(node.lo, node.hi, tris[i]);
+            for (int a = 0; a < 3; a++)
+            {
+                clo[a] = std::min(clo[a], centroid(tris[i], a));
+                chi[a] = std::max(chi[a], centroid(tris[i], a));
+            }
+        }
+        node.child[0] = node.child[1] = -1;
+        node.first = begin;
+        node.count = end - begin;
+
+        int32_t index = int32_t(nodes.size());
+        nodes.push_back(node);
+        if (end - begin <= chunk_size)
+            return index;
+
+        int axis = 0;
+        for (int a = 1; a < 3; a++)
+            if (chi[a] - clo[a] > chi[axis] - clo[axis])
+                axis = a;
+        uint32_t mid = begin + (end - begin) / 2;
+        std::nth_element(tris.begin() + begin, tris.begin() + mid, tris.begin() + end,
+                         [axis](const packed_triangle &a, const packed_triangle &b) {
+                             return centroid(a, axis) < centroid(b, axis);
+                         });
+        int32_t left = split(tris, nodes, begin, mid, chunk_size);
+        int32_t right = split(tris, nodes, mid, end, chunk_size);
+        nodes[index].child[0] = left;
+        nodes[index].child[1] = right;
+        nodes[index].count = 0;
+        return index;
+    }
+}
+
+// Partitions tris spatially and writes them to path, chunk_size triangles per chunk at most.
+// materials[i] is the material of triangles with material index i. Returns false on I/O
+// errors.
+inline bool write_geometry_file(const std::string &path, std::vector<packed_triangle> tris,
+                                const std::vector<geometry_material> &materials, uint32_t chunk_size = 4096)
+{
+    std::vector<geometry_node> nodes;
+    if (!tris.empty())
+        geometry_detail::split(tris, nodes, 0, uint32_t(tris.size()), std::max<uint32_t>(chunk_size, 1));
+
+    uint32_t material_count = uint32_t(materials.size());
+    std::vector<float> bounds(size_t(material_count) * 6);
+    for (uint32_t m = 0; m < material_count; m++)
+        for (int a = 0; a < 3; a++)
+        {
+            bounds[6 * m + a] = infinity;
+            bounds[6 * m + 3 + a] = -infinity;
+        }
+    for (const auto &t : tris)
+        if (t.material < material_count)
+            geometry_detail::grow(&bounds[6 * t.material], &bounds[6 * t.material + 3], t);
+
+    std::string strings;
+    for (const auto &m : materials)
+        strings += m.texture;
+
+    // Triangle data starts on a page boundary, so chunks can be released page by page.
+    uint64_t offset = geometry_detail::header_size + material_count * geometry_detail::material_size + strings.size() +
+                      nodes.size() * sizeof(geometry_node);
+    uint64_t page = uint64_t(sysconf(_SC_PAGESIZE));
+    offset = (offset + page - 1) / page * page;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+    uint32_t counts[2] = {uint32_t(nodes.size()), material_count};
+    uint64_t sizes[3] = {uint64_t(tris.size()), uint64_t(strings.size()), offset};
+    out.write(geometry_detail::magic, sizeof(geometry_detail::magic));
+    out.write(reinterpret_cast<const char *>(counts), sizeof(counts));
+    out.write(reinterpret_cast<const char *>(sizes), sizeof(sizes));
+    uint32_t texture_offset = 0;
+    for (uint32_t m = 0; m < material_count; m++)
+    {
+        const geometry_material &mat = materials[m];
+        uint32_t kind = mat.kind;
+        double values[4] = {mat.albedo[0], mat.albedo[1], mat.albedo[2], mat.parameter};
+        uint32_t texture[2] = {texture_offset, uint32_t(mat.texture.size())};
+        texture_offset += texture[1];
+        out.write(reinterpret_cast<const char *>(&bounds[6 * m]), 6 * sizeof(float));
+        out.write(reinterpret_cast<const char *>(&kind), sizeof(kind));
+        out.write(reinterpret_cast<const char *>(values), sizeof(values));
+        out.write(reinterpret_cast<const char *>(texture), sizeof(texture));
+    }
+    out.write(strings.data(), std::streamsize(strings.size()));
+    out.write(reinterpret_cast<const char *>(nodes.data()), std::streamsize(nodes.size() * sizeof(geometry_node)));
+    std::vector<char> padding(size_t(offset) - size_t(out.tellp()), 0);
+    out.write(padding.data(), std::streamsize(padding.size()));
+    out.write(reinterpret_cast<const char *>(tris.data()), std::streamsize(tris.size() * sizeof(packed_triangle)));
+    return bool(out);
+}
+
+// Read-only memory mapping of a geometry file. Chunks are read straight from the mapping and
+// can be released again with release(), so resident memory stays with the caller's cache.
+class geometry_file
+{
+public:
+    geometry_file() {}
+
+    explicit geometry_file(const std::string &path) { open(path); }
+
+    ~geometry_file() { close(); }
+
+    geometry_file(const geometry_file &) = delete;
+    geometry_file &operator=(const geometry_file &) = delete;
+
+    // Maps path and validates its header. Returns false if it is missing or malformed.
+    bool open(const std::string &path)
+    {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < geometry_detail::header_size)
+        {
+            ::close(fd);
+            return false;
+        }
+        size = size_t(st.st_size);
+        void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+            return false;
+        data = static_cast<const unsigned char *>(mapped);
+        // Traversal pages chunks in out of order; readahead would only pull in unused ones.
+        madvise(mapped, size, MADV_RANDOM);
+
+        if (!parse())
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (data)
+            munmap(const_cast<unsigned char *>(data), size);
+        data = nullptr;
+        size = 0;
+        nodes.clear();
+        bounds.clear();
+        materials.clear();
+    }
+
+    bool is_open() const { return data != nullptr; }
+    size_t bytes() const { return size; }
+    uint64_t triangle_count() const { return triangles; }
+    const std::vector<geometry_node> &tree() const { return nodes; }
+    uint32_t material_count() const { return uint32_t(bounds.size()); }
+    const aabb &material_bounds(uint32_t m) const { return bounds[m]; }
+    const geometry_material &material(uint32_t m) const { return materials[m]; }
+
+    const packed_triangle *chunk(const geometry_node &node) const
+    {
+        return reinterpret_cast<const packed_triangle *>(data + triangle_offset) + node.first;
+    }
+
+    // Drops the mapped pages wholly inside node's chunk; they are read from disk again if the
+    // chunk is touched later.
+    void release(const geometry_node &node) const
+    {
+        uintptr_t page = uintptr_t(sysconf(_SC_PAGESIZE));
+        uintptr_t begin = reinterpret_cast<uintptr_t>(chunk(node));
+        uintptr_t end = begin + node.count * sizeof(packed_triangle);
+        begin = (begin + page - 1) / page * page;
+        end = end / page * page;
+        if (end > begin)
+            madvise(reinterpret_cast<void *>(begin), end - begin, MADV_DONTNEED);
+    }
+
+private:
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+    uint64_t triangles = 0;
+    uint64_t triangle_offset = 0;
+    std::vector<geometry_node> nodes;
+    std::vector<aabb> bounds;
+    std::vector<geometry_material> materials;
+
+    bool parse()
+    {
+        if (std::memcmp(data, geometry_detail::magic, sizeof(geometry_detail::magic)) != 0)
+            return false;
+        uint32_t counts[2];
+        uint64_t sizes[3];
+        std::memcpy(counts, data + sizeof(geometry_detail::magic), sizeof(counts));
+        std::memcpy(sizes, data + sizeof(geometry_detail::magic) + sizeof(counts), sizeof(sizes));
+        triangles = sizes[0];
+        uint64_t string_bytes = sizes[1];
+        triangle_offset = sizes[2];
+
+        uint64_t materials_bytes = uint64_t(counts[1]) * geometry_detail::material_size;
+        uint64_t nodes_bytes = uint64_t(counts[0]) * sizeof(geometry_node);
+        if (geometry_detail::header_size + materials_bytes + string_bytes + nodes_bytes > triangle_offset ||
+            triangle_offset + triangles * sizeof(packed_triangle) > size)
+            return false;
+
+        const unsigned char *at = data + geometry_detail::header_size;
+        const char *strings = reinterpret_cast<const char *>(at + materials_bytes);
+        bounds.resize(counts[1]);
+        materials.resize(counts[1]);
+        for (uint32_t m = 0; m < counts[1]; m++, at += geometry_detail::material_size)
+        {
+            float b[6];
+            double values[4];
+            uint32_t kind, texture[2];
+            std::memcpy(b, at, sizeof(b));
+            std::memcpy(&kind, at + sizeof(b), sizeof(kind));
+            std::memcpy(values, at + sizeof(b) + sizeof(kind), sizeof(values));
+            std::memcpy(texture, at + sizeof(b) + sizeof(kind) + sizeof(values), sizeof(texture));
+            if (uint64_t(texture[0]) + texture[1] > string_bytes)
+                return false;
+            bounds[m] = b[0] <= b[3] ? aabb(point3(b[0], b[1], b[2]), point3(b[3], b[4], b[5])) : aabb();
+            geometry_material &mat = materials[m];
+            mat.kind = kind <= geometry_material::dielectric ? geometry_material::kind_t(kind) : geometry_material::unknown;
+            std::copy(values, values + 3, mat.albedo);
+            mat.parameter = values[3];
+            mat.texture.assign(strings + texture[0], texture[1]);
+        }
+        at += string_bytes;
+        nodes.resize(counts[0]);
+        std::memcpy(nodes.data(), at, nodes_bytes);
+        for (const auto &node : nodes)
+            if ((node.count > 0 && uint64_t(node.first) + node.count > triangles) ||
+                node.child[0] >= int32_t(nodes.size()) || node.child[1] >= int32_t(nodes.size()))
+                return false;
+        return true;
+    }
+};
+
+#endif
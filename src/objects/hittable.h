@@ -1,6 +1,11 @@
 #ifndef HITTABLE_H
 #define HITTABLE_H
 
+#include "../utils/aabb.h"
+#include "lod.h"
+
+#include <algorithm>
+
 class material;
 
 class hit_record
@@ -9,13 +14,44 @@ public:
     point3 p;
     vec3 normal;
     shared_ptr<material> mat;
+    int material_id = -1; // index into flat_scene::materials when hit through a flat_scene
+    int object = -1;      // index of the object hit in the outermost hittable_list
+    int primitive = -1;   // bvh_primitives reference of the primitive hit, when hit through a bvh
     double t;
     bool front_face;
+    // Surface parameterization at p, and the world-space length of one unit of (u, v) there,
+    // which converts a ray footprint into a texture-space filter width. Read them through
+    // surface_uv(): spheres leave them unset and record their radius in sphere_radius instead.
+    double u = 0;
+    double v = 0;
+    double uv_scale = 1;
+    double sphere_radius = 0;
 
     void set_face_normal(const ray &r, const vec3 &outward_normal)
     {
         front_face = dot(r.direction(), outward_normal) < 0;
         normal = front_face ? outward_normal : -outward_normal;
+        sphere_radius = 0;
+    }
+
+    // u, v and uv_scale of the hit. For a sphere they are derived here from the normal, as a
+    // latitude-longitude parameterization, so only hits that are textured pay for the
+    // trigonometry. One unit of uv spans about pi * radius, less toward the poles where u lines
+    // converge.
+    void surface_uv(double &u_out, double &v_out, double &scale_out) const
+    {
+        if (sphere_radius <= 0)
+        {
+            u_out = u;
+            v_out = v;
+            scale_out = uv_scale;
+            return;
+        }
+        vec3 outward = front_face ? normal : -normal;
+        double theta = std::acos(std::clamp(-outward.y(), -1.0, 1.0));
+        u_out = (std::atan2(-outward.z(), outward.x()) + pi) / (2 * pi);
+        v_out = theta / pi;
+        scale_out = pi * sphere_radius * std::sqrt(2 * std::fmax(std::sin(theta), 1e-3));
     }
 };
 
@@ -24,5 +60,15 @@ class hittable
 public:
     virtual ~hittable() = default;
     virtual bool hit(const ray &r, interval ray_t, hit_record &rec) const = 0;
+
+    virtual aabb bounding_box() const = 0;
+
+    // Bounds of the parts of the object with a specular material, which is where caustic
+    // photons are aimed.
+    virtual aabb specular_bounds() const { return aabb(); }
+
+    // Re-tessellates objects whose level of detail follows the camera (cylinders and cones) for
+    // view. Returns true if any geometry changed. Not safe to call while rendering.
+    virtual bool update_lod(const lod_view &) { return false; }
 };
 #endif
\ No newline at end of file
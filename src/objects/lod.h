@@ -0,0 +1,43 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include "../utils/aabb.h"
+
+#include <algorithm>
+
+// What the camera sees, for objects that tessellate themselves to their size on screen.
+struct lod_view
+{
+    point3 eye;
+    double pixels_per_unit = 0; // pixels spanned by a unit length at unit distance
+    double max_error = 0.5;     // largest allowed distance from the true surface, in pixels
+};
+
+const int lod_min_segments = 3;
+const int lod_max_segments = 512;
+
+// Segments a circle of the given radius needs, seen from view at the distance of bounds, for
+// every chord to stay within view.max_error pixels of the circle.
+inline int lod_segments(const lod_view &view, const aabb &bounds, double radius)
+{
+    double distance = (bounds.center() - view.eye).length() - 0.5 * bounds.extent().length();
+    if (distance <= 1e-6)
+        return lod_max_segments;
+    double projected = radius * view.pixels_per_unit / distance;
+    if (projected <= view.max_error)
+        return lod_min_segments;
+
+    // A chord of an n-gon strays radius * (1 - cos(pi / n)) from the circle.
+    double n = std::ceil(pi / std::acos(1 - view.max_error / projected));
+    return int(std::clamp(n, double(lod_min_segments), double(lod_max_segments)));
+}
+
+// Whether a mesh of current segments should be rebuilt with needed ones: always when it is too
+// coarse, but only when it is more than twice as fine as needed, so that small camera moves
+// keep the mesh.
+inline bool lod_rebuild(int current, int needed)
+{
+    return needed > current || 2 * needed < current;
+}
+
+#endif
@@ -1,9 +1,11 @@
 #ifndef SPHERE_H
 #define SPHERE_H
 #include "../utils/vec3.h"
+#include "../utils/render_stats.h"
 #include "hittable.h"
+#include "../materials/material.h"
 
-class sphere : public hittable
+class sphere final : public hittable
 {
 public:
     sphere(const point3 &center, double radius, shared_ptr<material> mat)
@@ -11,6 +13,16 @@ public:
 
     bool hit(const ray &r, interval ray_t, hit_record &rec) const override
     {
+        if (!hit_surface(r, ray_t, rec))
+            return false;
+        rec.mat = mat;
+        return true;
+    }
+
+    // Geometric part of hit(): fills in everything but the material.
+    bool hit_surface(const ray &r, interval ray_t, hit_record &rec) const
+    {
+        RT_STAT(local_stats().tests[stat_sphere]++);
         vec3 oc = center - r.origin();
         auto a = r.direction().length_squared();
         auto h = dot(r.direction(), oc);
@@ -30,15 +42,37 @@ public:
                 return false;
         }
 
-        rec.t = root;
+        surface(r, center, radius, root, rec);
+        return true;
+    }
+
+    // Fills in rec, but for the material, for the hit at distance t of ray r on the sphere
+    // (center, radius). Texture coordinates are left to hit_record::surface_uv. Only hits get
+    // here, so it stays out of line and the intersection test itself stays small.
+    [[gnu::noinline]] static void surface(const ray &r, const point3 &center, double radius, double t, hit_record &rec)
+    {
+        rec.t = t;
         rec.p = r.at(rec.t);
         vec3 outward_normal = (rec.p - center) / radius;
         rec.set_face_normal(r, outward_normal);
-        rec.mat = mat;
+        rec.sphere_radius = radius;
+    }
 
-        return true;
+    aabb bounding_box() const override
+    {
+        vec3 rvec(radius, radius, radius);
+        return aabb(center - rvec, center + rvec);
     }
 
+    aabb specular_bounds() const override
+    {
+        return mat && mat->is_specular() ? bounding_box() : aabb();
+    }
+
+    const shared_ptr<material> &material_ptr() const { return mat; }
+    const point3 &center_point() const { return center; }
+    double radius_length() const { return radius; }
+
 private:
     point3 center;
     double radius;
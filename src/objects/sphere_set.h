@@ -0,0 +1,147 @@
+#ifndef SPHERE_SET_H
+#define SPHERE_SET_H
+
+#include "../utils/render_stats.h"
+#include "sphere.h"
+
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <vector>
+
+// Many spheres as one primitive, for particle-like scenes. Centers and radii are stored as
+// arrays of doubles (structure of arrays) in blocks of lanes spheres, so one loop tests a ray
+// against a whole block in SIMD registers: 2 spheres per instruction with SSE2, 4 with AVX2
+// and 8 with AVX-512 (see RAYTRACER_NATIVE). Only the nearest sphere hit gets its record
+// filled in. Materials are kept once in a table and referenced by index.
+//
+// The set is an ordinary hittable, so any hierarchy can hold it as a leaf; make_sphere_sets
+// groups the loose spheres of a scene into sets of nearby spheres.
+class sphere_set final : public hittable
+{
+public:
+    static constexpr int lanes = 8;
+
+    sphere_set() {}
+
+    void add(const point3 &center, double radius, const shared_ptr<material> &mat)
+    {
+        size_t k = count++;
+        if (k % lanes == 0)
+            grow();
+        radius = std::fmax(0, radius);
+        for (int a = 0; a < 3; a++)
+            centers[a][k] = center[a];
+        radii[k] = radius;
+        material_ids[k] = material_id(mat);
+        aabb box(center - vec3(radius, radius, radius), center + vec3(radius, radius, radius));
+        bounds = aabb(bounds, box);
+        if (mat && mat->is_specular())
+            specular = aabb(specular, box);
+    }
+
+    void add(const sphere &s) { add(s.center_point(), s.radius_length(), s.material_ptr()); }
+
+    size_t size() const { return count; }
+
+    // The k-th sphere added, as a sphere of its own.
+    sphere at(size_t k) const
+    {
+        return sphere(point3(centers[0][k], centers[1][k], centers[2][k]), radii[k], materials[material_ids[k]]);
+    }
+
+    bool hit(const ray &r, interval ray_t, hit_record &rec) const override
+    {
+        RT_STAT(local_stats().tests[stat_sphere] += count);
+        const double ox = r.origin().x(), oy = r.origin().y(), oz = r.origin().z();
+        const double dx = r.direction().x(), dy = r.direction().y(), dz = r.direction().z();
+        const double a = dx * dx + dy * dy + dz * dz;
+        const double t_min = ray_t.min;
+        double closest = ray_t.max;
+        size_t nearest = count;
+
+        for (size_t block = 0; block < centers[0].size(); block += lanes)
+        {
+            const double *cx = &centers[0][block], *cy = &centers[1][block], *cz = &centers[2][block];
+            const double *radius = &radii[block];
+            double h[lanes], discriminant[lanes];
+
+            // Same arithmetic as sphere::hit_surface, a lane per sphere, up to the discriminant.
+            // Padding lanes hold NaN centers, which fail the test below.
+            #pragma omp simd
+            for (int k = 0; k < lanes; k++)
+            {
+                double ocx = cx[k] - ox, ocy = cy[k] - oy, ocz = cz[k] - oz;
+                h[k] = dx * ocx + dy * ocy + dz * ocz;
+                double c = ocx * ocx + ocy * ocy + ocz * ocz - radius[k] * radius[k];
+                discriminant[k] = h[k] * h[k] - a * c;
+            }
+
+            // Most rays miss most spheres, so roots are found one sphere at a time.
+            for (int k = 0; k < lanes; k++)
+            {
+                if (!(discriminant[k] >= 0))
+                    continue;
+                double sqrtd = std::sqrt(discriminant[k]);
+                double root = (h[k] - sqrtd) / a;
+                if (!(root > t_min && root < closest))
+                {
+                    root = (h[k] + sqrtd) / a;
+                    if (!(root > t_min && root < closest))
+                        continue;
+                }
+                closest = root;
+                nearest = block + size_t(k);
+            }
+        }
+
+        if (nearest == count)
+            return false;
+        sphere::surface(r, point3(centers[0][nearest], centers[1][nearest], centers[2][nearest]), radii[nearest],
+                        closest, rec);
+        rec.mat = materials[material_ids[nearest]];
+        return true;
+    }
+
+    aabb bounding_box() const override { return bounds; }
+
+    aabb specular_bounds() const override { return specular; }
+
+    size_t bytes() const
+    {
+        return centers[0].size() * (4 * sizeof(double) + sizeof(uint32_t)) + materials.size() * sizeof(shared_ptr<material>);
+    }
+
+private:
+    std::vector<double> centers[3]; // x, y and z, padded to whole blocks
+    std::vector<double> radii;
+    std::vector<uint32_t> material_ids;
+    std::vector<shared_ptr<material>> materials;
+    std::map<const material *, uint32_t> material_index;
+    size_t count = 0;
+    aabb bounds;
+    aabb specular;
+
+    void grow()
+    {
+        double nan = std::numeric_limits<double>::quiet_NaN();
+        for (auto &axis : centers)
+            axis.resize(axis.size() + lanes, nan);
+        radii.resize(radii.size() + lanes, 0);
+        material_ids.resize(material_ids.size() + lanes, 0);
+    }
+
+    uint32_t material_id(const shared_ptr<material> &mat)
+    {
+        auto found = material_index.find(mat.get());
+        if (found == material_index.end())
+        {
+            found = material_index.emplace(mat.get(), uint32_t(materials.size())).first;
+            materials.push_back(mat);
+        }
+        return found->second;
+    }
+};
+
+#endif
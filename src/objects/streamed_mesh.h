@@ -0,0 +1,176 @@
+#ifndef STREAMED_MESH_H
+#define STREAMED_MESH_H
+
+#include "../utils/sharded_cache.h"
+#include "geometry_file.h"
+#include "triangle.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+// One chunk of a geometry file, decoded into triangles.
+struct geometry_chunk
+{
+    std::vector<triangle> triangles;
+};
+
+inline size_t cache_bytes(const geometry_chunk &chunk)
+{
+    return sizeof(geometry_chunk) + chunk.triangles.capacity() * sizeof(triangle);
+}
+
+using geometry_cache = sharded_cache<geometry_chunk>;
+
+// Out-of-core triangle mesh. Only the chunk tree of its geometry file stays in memory; a chunk
+// whose bounds a ray reaches is decoded from the file mapping into the cache on first use, its
+// mapped pages are released straight away, and the cache evicts least recently used chunks
+// once its budget is exceeded. Scene size is then bounded by disk rather than memory.
+class streamed_mesh : public hittable
+{
+public:
+    struct counters
+    {
+        uint64_t chunk_hits;     // chunk lookups served from the cache
+        uint64_t chunk_loads;    // chunks paged in from the file
+        uint64_t evictions;
+        size_t resident_bytes;   // decoded chunks held by the cache
+        long major_faults;       // process page faults that read from disk, since open()
+        long minor_faults;
+    };
+
+    // materials[i] is the material of triangles stored with material index i.
+    streamed_mesh(const std::string &path, std::vector<shared_ptr<material>> materials,
+                  geometry_cache &cache = geometry_cache::global())
+        : materials(std::move(materials)), cache(cache), id(next_id().fetch_add(1))
+    {
+        if (!file.open(path))
+            return;
+        const auto &tree = file.tree();
+        nodes.reserve(tree.size());
+        for (const auto &n : tree)
+            nodes.push_back({aabb(point3(n.lo[0], n.lo[1], n.lo[2]), point3(n.hi[0], n.hi[1], n.hi[2])),
+                             {n.child[0], n.child[1]}});
+        for (uint32_t m = 0; m < file.material_count() && m < this->materials.size(); m++)
+        {
+            if (this->materials[m] && this->materials[m]->is_specular())
+                specular = aabb(specular, file.material_bounds(m));
+        }
+        faults_at_open = faults();
+    }
+
+    bool is_open() const { return file.is_open(); }
+    uint64_t triangle_count() const { return file.triangle_count(); }
+
+    bool hit(const ray &r, interval ray_t, hit_record &rec) const override
+    {
+        if (nodes.empty())
+            return false;
+
+        bool hit_anything = false;
+        auto closest_so_far = ray_t.max;
+        int32_t stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const node &n = nodes[size_t(stack[--top])];
+            if (!n.bounds.hit(r, interval(ray_t.min, closest_so_far)))
+                continue;
+            if (n.child[0] < 0)
+            {
+                auto chunk = load(size_t(&n - nodes.data()));
+                for (const auto &tri : chunk->triangles)
+                {
+                    if (tri.hit(r, interval(ray_t.min, closest_so_far), rec))
+                    {
+                        hit_anything = true;
+                        closest_so_far = rec.t;
+                    }
+                }
+                continue;
+            }
+
+            // Visit the child nearer along the ray first, so far chunks are often culled by
+            // the closest hit before they are paged in.
+            const node &a = nodes[size_t(n.child[0])], &b = nodes[size_t(n.child[1])];
+            bool a_first = dot(a.bounds.center() - r.origin(), r.direction()) <=
+                           dot(b.bounds.center() - r.origin(), r.direction());
+            stack[top++] = a_first ? n.child[1] : n.child[0];
+            stack[top++] = a_first ? n.child[0] : n.child[1];
+        }
+        return hit_anything;
+    }
+
+    aabb bounding_box() const override { return nodes.empty() ? aabb() : nodes[0].bounds; }
+
+    aabb specular_bounds() const override { return specular; }
+
+    counters stats() const
+    {
+        auto c = cache.stats();
+        rusage now = faults();
+        return {chunk_hits.load(), chunk_loads.load(), c.evictions, c.resident_bytes,
+                now.ru_majflt - faults_at_open.ru_majflt, now.ru_minflt - faults_at_open.ru_minflt};
+    }
+
+private:
+    struct node
+    {
+        aabb bounds;
+        int32_t child[2];
+    };
+
+    geometry_file file;
+    std::vector<node> nodes;
+    std::vector<shared_ptr<material>> materials;
+    geometry_cache &cache;
+    uint64_t id;
+    aabb specular;
+    rusage faults_at_open;
+    mutable std::atomic<uint64_t> chunk_hits{0};
+    mutable std::atomic<uint64_t> chunk_loads{0};
+
+    static std::atomic<uint64_t> &next_id()
+    {
+        static std::atomic<uint64_t> id{0};
+        return id;
+    }
+
+    static rusage faults()
+    {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage;
+    }
+
+    geometry_cache::entry_ptr load(size_t index) const
+    {
+        bool loaded = false;
+        auto chunk = cache.get(id << 32 | index, [&] {
+            loaded = true;
+            const geometry_node &n = file.tree()[index];
+            const packed_triangle *packed = file.chunk(n);
+            auto decoded = std::make_shared<geometry_chunk>();
+            decoded->triangles.reserve(n.count);
+            for (uint32_t i = 0; i < n.count; i++)
+            {
+                const packed_triangle &t = packed[i];
+                const float *v = t.vertex;
+                shared_ptr<material> mat = t.material < materials.size() ? materials[t.material] : nullptr;
+                decoded->triangles.emplace_back(point3(v[0], v[1], v[2]), point3(v[3], v[4], v[5]),
+                                                point3(v[6], v[7], v[8]), mat, vec3(t.uv[0], t.uv[1], 0),
+                                                vec3(t.uv[2], t.uv[3], 0), vec3(t.uv[4], t.uv[5], 0));
+            }
+            file.release(n);
+            return geometry_cache::entry_ptr(std::move(decoded));
+        });
+        (loaded ? chunk_loads : chunk_hits).fetch_add(1, std::memory_order_relaxed);
+        return chunk;
+    }
+};
+
+#endif
@@ -1,16 +1,39 @@
 #ifndef TRIANGLE_H
 #define TRIANGLE_H
 #include "../utils/vec3.h"
+#include "../utils/render_stats.h"
 #include "hittable.h"
+#include "../materials/material.h"
 
-class triangle : public hittable
+class triangle final : public hittable
 {
 public:
     triangle(const point3 &A, const point3 &B, const point3 &C, shared_ptr<material> mat)
-        : A(A), B(B), C(C), mat(mat) {}
+        : triangle(A, B, C, mat, vec3(0, 0, 0), vec3(1, 0, 0), vec3(0, 1, 0)) {}
+
+    // uvA, uvB and uvC are the texture coordinates of the vertices (z is ignored).
+    triangle(const point3 &A, const point3 &B, const point3 &C, shared_ptr<material> mat,
+             const vec3 &uvA, const vec3 &uvB, const vec3 &uvC)
+        : A(A), B(B), C(C), mat(mat),
+          uv{uvA.x(), uvA.y(), uvB.x() - uvA.x(), uvB.y() - uvA.y(), uvC.x() - uvA.x(), uvC.y() - uvA.y()}
+    {
+        double world_area = cross(B - A, C - A).length();
+        double uv_area = std::fabs(uv[2] * uv[5] - uv[3] * uv[4]);
+        uv_scale = uv_area > 0 ? std::sqrt(world_area / uv_area) : 1;
+    }
 
     bool hit(const ray &r, interval ray_t, hit_record &rec) const override
     {
+        if (!hit_surface(r, ray_t, rec))
+            return false;
+        rec.mat = mat;
+        return true;
+    }
+
+    // Geometric part of hit(): fills in everything but the material.
+    bool hit_surface(const ray &r, interval ray_t, hit_record &rec) const
+    {
+        RT_STAT(local_stats().tests[stat_triangle]++);
         const double EPS = 1e-6;
         vec3 E1 = B - A;
         vec3 E2 = C - A;
@@ -36,17 +59,110 @@ public:
         if (!ray_t.surrounds(t))
             return false;
 
-        rec.t = t;
-        rec.p = r.at(rec.t);
-        vec3 outward_normal = unit_vector(cross(E1, E2));
-        rec.set_face_normal(r, outward_normal);
-        rec.mat = mat;
+        set_surface(r, t, u, v, E1, E2, rec);
+        return true;
+    }
 
+    // Fills in rec for ray r meeting the triangle's plane where the barycentric coordinates of
+    // B and C are u and v, as a rasterizer found them; the inside test is the caller's. Returns
+    // false when r runs parallel to the plane.
+    bool hit_at(const ray &r, double u, double v, hit_record &rec) const
+    {
+        vec3 E1 = B - A;
+        vec3 E2 = C - A;
+        vec3 N = cross(E1, E2);
+        double facing = dot(r.direction(), N);
+        if (facing == 0)
+            return false;
+        set_surface(r, dot(A - r.origin(), N) / facing, u, v, E1, E2, rec);
+        rec.mat = mat;
         return true;
     }
 
+    aabb bounding_box() const override
+    {
+        return aabb(aabb(A, B), aabb(C, C));
+    }
+
+    aabb specular_bounds() const override
+    {
+        return mat && mat->is_specular() ? bounding_box() : aabb();
+    }
+
+    const shared_ptr<material> &material_ptr() const { return mat; }
+
+    // Vertex k (A, B, C) and its texture coordinates.
+    const point3 &vertex(int k) const { return k == 0 ? A : k == 1 ? B : C; }
+    vec3 texture_coordinates(int k) const
+    {
+        return k == 0 ? vec3(uv[0], uv[1], 0) : vec3(uv[0] + uv[2 * k], uv[1] + uv[2 * k + 1], 0);
+    }
+
 private:
     point3 A, B, C;
     shared_ptr<material> mat;
+    // uv at A followed by the uv edge vectors to B and C, matching the barycentrics above.
+    double uv[6];
+    double uv_scale;
+
+    // Called once per hit rather than per test; not inlined, to keep hit_surface lean.
+    [[gnu::noinline]] void set_surface(const ray &r, double t, double u, double v, const vec3 &E1, const vec3 &E2, hit_record &rec) const
+    {
+        rec.t = t;
+        rec.p = r.at(rec.t);
+        vec3 outward_normal = unit_vector(cross(E1, E2));
+        rec.set_face_normal(r, outward_normal);
+        rec.u = uv[0] + u * uv[2] + v * uv[4];
+        rec.v = uv[1] + u * uv[3] + v * uv[5];
+        rec.uv_scale = uv_scale;
+    }
 };
+
+// Texture coordinates for a triangle of a primitive's unit base mesh (before scale, rotation
+// and translation). Faces are projected along the axis they face most; with cylindrical set,
+// faces around the y axis instead wrap u once around it, with v running up the side.
+inline void base_mesh_uvs(const vec3 &a, const vec3 &b, const vec3 &c, bool cylindrical, vec3 uvs[3])
+{
+    const vec3 *p[3] = {&a, &b, &c};
+    vec3 n = cross(b - a, c - a);
+    double nx = std::fabs(n.x()), ny = std::fabs(n.y()), nz = std::fabs(n.z());
+
+    if (cylindrical && ny < std::max(nx, nz))
+    {
+        // A vertex on the axis (a cone tip) takes the mean u of the other two.
+        double u[3];
+        int on_axis = -1;
+        for (int k = 0; k < 3; k++)
+        {
+            if (p[k]->x() * p[k]->x() + p[k]->z() * p[k]->z() < 1e-12)
+                on_axis = k;
+            else
+                u[k] = std::atan2(p[k]->z(), p[k]->x()) / (2 * pi) + 0.5;
+        }
+        // Keep triangles that straddle the seam at u = 0 contiguous.
+        double lo = 1, hi = 0;
+        for (int k = 0; k < 3; k++)
+            if (k != on_axis)
+                lo = std::min(lo, u[k]), hi = std::max(hi, u[k]);
+        if (hi - lo > 0.5)
+            for (int k = 0; k < 3; k++)
+                if (k != on_axis && u[k] < 0.5)
+                    u[k] += 1;
+        if (on_axis >= 0)
+            u[on_axis] = 0.5 * (u[(on_axis + 1) % 3] + u[(on_axis + 2) % 3]);
+        for (int k = 0; k < 3; k++)
+            uvs[k] = vec3(u[k], p[k]->y() + 0.5, 0);
+        return;
+    }
+
+    for (int k = 0; k < 3; k++)
+    {
+        if (nx >= ny && nx >= nz)
+            uvs[k] = vec3(p[k]->z() + 0.5, p[k]->y() + 0.5, 0);
+        else if (ny >= nz)
+            uvs[k] = vec3(p[k]->x() + 0.5, p[k]->z() + 0.5, 0);
+        else
+            uvs[k] = vec3(p[k]->x() + 0.5, p[k]->y() + 0.5, 0);
+    }
+}
 #endif
\ No newline at end of file
@@ -0,0 +1,106 @@
+#ifndef ENVIRONMENT_H
+#define ENVIRONMENT_H
+
+#include "../utils/alias_table.h"
+#include "../utils/common.h"
+#include "../utils/pfm.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// HDR environment light in latitude-longitude layout: the top row of the image is straight up,
+// the bottom row straight down, and the middle column looks down -z. Radiance is piecewise
+// constant per pixel. An alias table over the pixels, weighted by luminance and by the solid
+// angle each row covers, lets the integrator sample directions toward the bright parts.
+class environment_map
+{
+public:
+    environment_map(int width, int height, std::vector<color> pixels, double intensity = 1)
+        : width(width), height(height), pixels(std::move(pixels))
+    {
+        std::vector<double> weights(this->pixels.size());
+        for (int y = 0; y < height; y++)
+        {
+            double sin_theta = std::sin(pi * (y + 0.5) / height);
+            for (int x = 0; x < width; x++)
+            {
+                auto &c = this->pixels[size_t(y) * width + x];
+                c *= intensity;
+                weights[size_t(y) * width + x] = luminance(c) * sin_theta;
+            }
+        }
+        table = alias_table(weights);
+    }
+
+    // Loads a PFM image. Returns nullptr if it cannot be read.
+    static shared_ptr<environment_map> load(const std::string &path, double intensity = 1)
+    {
+        int w, h;
+        std::vector<color> pixels;
+        if (!read_pfm(path, w, h, pixels))
+            return nullptr;
+        return make_shared<environment_map>(w, h, std::move(pixels), intensity);
+    }
+
+    // Radiance arriving from direction dir (any length).
+    color value(const vec3 &dir) const
+    {
+        return pixels[pixel_index(unit_vector(dir))];
+    }
+
+    // Draws a unit direction with probability proportional to radiance, and returns its density
+    // with respect to solid angle.
+    vec3 sample(double &pdf) const
+    {
+        size_t index = table.sample(random_double());
+        int x = int(index % width), y = int(index / width);
+        double u = (x + random_double()) / width;
+        double v = (y + random_double()) / height;
+
+        double theta = pi * v, phi = 2 * pi * u - pi;
+        double sin_theta = std::sin(theta);
+        vec3 dir(sin_theta * std::sin(phi), std::cos(theta), -sin_theta * std::cos(phi));
+        pdf = density(index, sin_theta);
+        return dir;
+    }
+
+    // Solid-angle density with which sample() returns the unit direction dir.
+    double pdf(const vec3 &dir) const
+    {
+        double sin_theta = std::sqrt(std::fmax(0.0, 1 - dir.y() * dir.y()));
+        return density(pixel_index(dir), sin_theta);
+    }
+
+private:
+    int width;
+    int height;
+    std::vector<color> pixels;
+    alias_table table;
+
+    static double luminance(const color &c)
+    {
+        return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+    }
+
+    size_t pixel_index(const vec3 &dir) const
+    {
+        double theta = std::acos(std::clamp(dir.y(), -1.0, 1.0));
+        double phi = std::atan2(dir.x(), -dir.z());
+        int x = int((phi + pi) / (2 * pi) * width);
+        int y = int(theta / pi * height);
+        x = std::clamp(x, 0, width - 1);
+        y = std::clamp(y, 0, height - 1);
+        return size_t(y) * width + x;
+    }
+
+    // A pixel spans 2*pi/width by pi/height in (phi, theta); d(solid angle) = sin(theta) dtheta dphi.
+    double density(size_t index, double sin_theta) const
+    {
+        if (sin_theta <= 0)
+            return 0;
+        return table.probability(index) * double(width) * height / (2 * pi * pi * sin_theta);
+    }
+};
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef IMAGE_TEXTURE_H
+#define IMAGE_TEXTURE_H
+
+#include "mip_file.h"
+#include "texture.h"
+#include "tile_cache.h"
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+// Mip-mapped image texture backed by a memory-mapped .rtmip file. Texels are fetched through the
+// global tile_cache and filtered trilinearly: the mip level comes from the ray footprint, so
+// distant or grazing surfaces read small, pre-filtered levels instead of aliasing the full
+// image. Coordinates wrap, and v = 0 is the bottom row of the image.
+class image_texture final : public texture
+{
+public:
+    // path is a .rtmip file, or a PPM image that is converted to path + ".rtmip" the first time
+    // it is used (and again whenever the PPM is newer than the converted file). The image is
+    // repeated `repeat` times across one unit of surface uv.
+    explicit image_texture(const std::string &path, double repeat = 1, tile_cache &cache = tile_cache::global())
+        : cache(cache), id(next_id()++), repeat(repeat), source(path)
+    {
+        std::string mip_path = path;
+        if (!ends_with(path, ".rtmip"))
+        {
+            mip_path = path + ".rtmip";
+            struct stat src, dst;
+            bool stale = stat(mip_path.c_str(), &dst) != 0 ||
+                         (stat(path.c_str(), &src) == 0 && src.st_mtime > dst.st_mtime);
+            if (stale && !build_mip_file(path, mip_path))
+                std::cerr << "image_texture: cannot convert " << path << " to " << mip_path << '\n';
+        }
+        if (!file.open(mip_path))
+            std::cerr << "image_texture: cannot open " << mip_path << '\n';
+    }
+
+    bool valid() const { return file.is_open(); }
+
+    // The path and repeat it was made with.
+    const std::string &source_path() const { return source; }
+    double repeat_count() const { return repeat; }
+
+    color value(double u, double v, const point3 &, double footprint) const override
+    {
+        // Missing textures render magenta so they stand out.
+        if (!file.is_open())
+            return color(1, 0, 1);
+
+        u *= repeat;
+        v *= repeat;
+        footprint *= repeat;
+        u -= std::floor(u);
+        v = 1 - (v - std::floor(v));
+
+        const auto &base = file.level(0);
+        int last = file.level_count() - 1;
+        double level = std::log2(std::fmax(footprint * std::max(base.width, base.height), 1.0));
+        if (level >= last)
+            return bilinear(last, u, v);
+        int l0 = int(level);
+        double f = level - l0;
+        color c = bilinear(l0, u, v);
+        if (f > 0)
+            c = (1 - f) * c + f * bilinear(l0 + 1, u, v);
+        return c;
+    }
+
+private:
+    tile_cache &cache;
+    uint64_t id;
+    double repeat;
+    std::string source;
+    mip_file file;
+
+    static std::atomic<uint64_t> &next_id()
+    {
+        static std::atomic<uint64_t> id{0};
+        return id;
+    }
+
+    static bool ends_with(const std::string &s, const std::string &suffix)
+    {
+        return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    // Stored components are gamma encoded the same way write_color encodes output.
+    static double decode(unsigned char c)
+    {
+        static const auto table = [] {
+            std::array<double, 256> t;
+            for (int i = 0; i < 256; i++)
+                t[size_t(i)] = (i / 255.0) * (i / 255.0);
+            return t;
+        }();
+        return table[c];
+    }
+
+    // Filters one level at (u, v) in [0, 1). Consecutive texels usually share a tile, so the
+    // last tile is kept to avoid going back to the cache for it.
+    color bilinear(int l, double u, double v) const
+    {
+        const auto &level = file.level(l);
+        int w = int(level.width), h = int(level.height);
+        double x = u * w - 0.5, y = v * h - 0.5;
+        int x0 = int(std::floor(x)), y0 = int(std::floor(y));
+        double fx = x - x0, fy = y - y0;
+
+        tile_cache::entry_ptr tile;
+        uint64_t tile_key = ~uint64_t(0);
+        auto texel = [&](int tx, int ty) {
+            tx = (tx % w + w) % w;
+            ty = (ty % h + h) % h;
+            int size = file.tile_size();
+            uint64_t key = id << 44 | uint64_t(l) << 40 | uint64_t(ty / size) << 20 | uint64_t(tx / size);
+            if (key != tile_key)
+            {
+                tile = cache.get(key, [&] {
+                    auto t = std::make_shared<texture_tile>();
+                    t->size = size;
+                    const unsigned char *src = file.tile_data(l, tx / size, ty / size);
+                    t->texels.assign(src, src + file.tile_bytes());
+                    return std::shared_ptr<const texture_tile>(std::move(t));
+                });
+                tile_key = key;
+            }
+            const unsigned char *c = &tile->texels[(size_t(ty % size) * size + tx % size) * 3];
+            return color(decode(c[0]), decode(c[1]), decode(c[2]));
+        };
+
+        return (1 - fy) * ((1 - fx) * texel(x0, y0) + fx * texel(x0 + 1, y0)) +
+               fy * ((1 - fx) * texel(x0, y0 + 1) + fx * texel(x0 + 1, y0 + 1));
+    }
+};
+
+#endif
@@ -0,0 +1,227 @@
+#ifndef MIP_FILE_H
+#define MIP_FILE_H
+
+#include "../utils/ppm.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Tiled, mip-mapped texture file (.rtmip), a local cache of its PPM. Layout, all integers in
+// the writing host's native byte order:
+//
+//   header      magic "RTMIP01\0", uint32 tile_size, uint32 level_count
+//   level[n]    uint32 width, height, tiles_x, tiles_y, uint64 offset of the level's first tile
+//   tiles       per level, tiles row-major; each tile is tile_size^2 RGB texels, 8 bits per
+//               component, row-major. Texels past the level's edge repeat the last row/column.
+//
+// Level 0 is the source image and each further level halves both dimensions (rounding down,
+// never below 1) until a 1x1 level. Components are stored gamma encoded like the renderer's
+// output; levels are downsampled in linear space.
+struct mip_level
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t tiles_x;
+    uint32_t tiles_y;
+    uint64_t offset;
+};
+
+namespace mip_detail
+{
+    const char magic[8] = {'R', 'T', 'M', 'I', 'P', '0', '1', '\0'};
+    const size_t header_size = sizeof(magic) + 2 * sizeof(uint32_t);
+
+    inline unsigned char encode(double linear)
+    {
+        return (unsigned char)(255.0 * std::sqrt(std::clamp(linear, 0.0, 1.0)) + 0.5);
+    }
+}
+
+// Converts a PPM image into a tiled mip file at out_path. Returns false on I/O errors.
+inline bool build_mip_file(const std::string &ppm_path, const std::string &out_path, int tile_size = 32)
+{
+    int width, height;
+    std::vector<color> pixels;
+    if (!read_ppm(ppm_path, width, height, pixels))
+        return false;
+
+    // Linear-space pyramid, level 0 first.
+    for (auto &p : pixels)
+        p = p * p;
+    std::vector<std::vector<color>> images = {std::move(pixels)};
+    std::vector<mip_level> levels = {{uint32_t(width), uint32_t(height), 0, 0, 0}};
+    while (levels.back().width > 1 || levels.back().height > 1)
+    {
+        const auto &src = images.back();
+        int sw = int(levels.back().width), sh = int(levels.back().height);
+        int w = std::max(1, sw / 2), h = std::max(1, sh / 2);
+        std::vector<color> dst(size_t(w) * h);
+        for (int y = 0; y < h; y++)
+        {
+            for (int x = 0; x < w; x++)
+            {
+                // 2x2 box filter, clamped at odd edges.
+                int x0 = std::min(2 * x, sw - 1), x1 = std::min(2 * x + 1, sw - 1);
+                int y0 = std::min(2 * y, sh - 1), y1 = std::min(2 * y + 1, sh - 1);
+                dst[size_t(y) * w + x] = 0.25 * (src[size_t(y0) * sw + x0] + src[size_t(y0) * sw + x1] +
+                                                 src[size_t(y1) * sw + x0] + src[size_t(y1) * sw + x1]);
+            }
+        }
+        images.push_back(std::move(dst));
+        levels.push_back({uint32_t(w), uint32_t(h), 0, 0, 0});
+    }
+
+    size_t tile_bytes = size_t(tile_size) * tile_size * 3;
+    uint64_t offset = mip_detail::header_size + levels.size() * sizeof(mip_level);
+    for (auto &level : levels)
+    {
+        level.tiles_x = (level.width + tile_size - 1) / tile_size;
+        level.tiles_y = (level.height + tile_size - 1) / tile_size;
+        level.offset = offset;
+        offset += uint64_t(level.tiles_x) * level.tiles_y * tile_bytes;
+    }
+
+    std::ofstream out(out_path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+    uint32_t header[2] = {uint32_t(tile_size), uint32_t(levels.size())};
+    out.write(mip_detail::magic, sizeof(mip_detail::magic));
+    out.write(reinterpret_cast<const char *>(header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(levels.data()), std::streamsize(levels.size() * sizeof(mip_level)));
+
+    std::vector<unsigned char> tile(tile_bytes);
+    for (size_t l = 0; l < levels.size(); l++)
+    {
+        const auto &level = levels[l];
+        const auto &image = images[l];
+        for (uint32_t ty = 0; ty < level.tiles_y; ty++)
+        {
+            for (uint32_t tx = 0; tx < level.tiles_x; tx++)
+            {
+                for (int y = 0; y < tile_size; y++)
+                {
+                    uint32_t sy = std::min(ty * tile_size + y, level.height - 1);
+                    for (int x = 0; x < tile_size; x++)
+                    {
+                        uint32_t sx = std::min(tx * tile_size + x, level.width - 1);
+                        const color &c = image[size_t(sy) * level.width + sx];
+                        unsigned char *texel = &tile[(size_t(y) * tile_size + x) * 3];
+                        texel[0] = mip_detail::encode(c.x());
+                        texel[1] = mip_detail::encode(c.y());
+                        texel[2] = mip_detail::encode(c.z());
+                    }
+                }
+                out.write(reinterpret_cast<const char *>(tile.data()), std::streamsize(tile.size()));
+            }
+        }
+    }
+    return bool(out);
+}
+
+// Read-only memory mapping of a mip file. Tiles are read straight from the mapping, so only the
+// pages of tiles that are actually sampled are ever loaded from disk.
+class mip_file
+{
+public:
+    mip_file() {}
+
+    explicit mip_file(const std::string &path) { open(path); }
+
+    ~mip_file() { close(); }
+
+    mip_file(const mip_file &) = delete;
+    mip_file &operator=(const mip_file &) = delete;
+
+    // Maps path and validates its header. Returns false if it is missing or malformed.
+    bool open(const std::string &path)
+    {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < mip_detail::header_size)
+        {
+            ::close(fd);
+            return false;
+        }
+        size = size_t(st.st_size);
+        void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+            return false;
+        data = static_cast<const unsigned char *>(mapped);
+        // Texture lookups jump around the file; don't waste I/O on readahead.
+        madvise(mapped, size, MADV_RANDOM);
+
+        if (!parse())
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (data)
+            munmap(const_cast<unsigned char *>(data), size);
+        data = nullptr;
+        size = 0;
+        levels.clear();
+    }
+
+    bool is_open() const { return data != nullptr; }
+    int tile_size() const { return tile; }
+    int level_count() const { return int(levels.size()); }
+    const mip_level &level(int l) const { return levels[size_t(l)]; }
+
+    // First texel of tile (tx, ty) of level l.
+    const unsigned char *tile_data(int l, int tx, int ty) const
+    {
+        const auto &level = levels[size_t(l)];
+        return data + level.offset + (uint64_t(ty) * level.tiles_x + tx) * tile_bytes();
+    }
+
+    size_t tile_bytes() const { return size_t(tile) * tile * 3; }
+
+private:
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+    int tile = 0;
+    std::vector<mip_level> levels;
+
+    bool parse()
+    {
+        if (std::memcmp(data, mip_detail::magic, sizeof(mip_detail::magic)) != 0)
+            return false;
+        uint32_t header[2];
+        std::memcpy(header, data + sizeof(mip_detail::magic), sizeof(header));
+        tile = int(header[0]);
+        if (tile < 1 || tile > 4096 || header[1] < 1 || header[1] > 32 ||
+            size < mip_detail::header_size + header[1] * sizeof(mip_level))
+            return false;
+
+        levels.resize(header[1]);
+        std::memcpy(levels.data(), data + mip_detail::header_size, levels.size() * sizeof(mip_level));
+        for (const auto &level : levels)
+        {
+            if (level.width < 1 || level.height < 1 || level.tiles_x != (level.width + tile - 1) / tile ||
+                level.tiles_y != (level.height + tile - 1) / tile ||
+                level.offset + uint64_t(level.tiles_x) * level.tiles_y * tile_bytes() > size)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include "../utils/common.h"
+#include "../objects/hittable.h"
+
+// Surface color as a function of the hit's texture coordinates. footprint is the width of the
+// ray footprint in uv units (0 for a point sample), so filtered textures can pick a mip level.
+class texture
+{
+public:
+    virtual ~texture() = default;
+    virtual color value(double u, double v, const point3 &p, double footprint) const = 0;
+};
+
+class solid_color final : public texture
+{
+public:
+    solid_color(const color &albedo) : albedo(albedo) {}
+
+    color value(double, double, const point3 &, double) const override
+    {
+        return albedo;
+    }
+
+    const color &albedo_color() const { return albedo; }
+
+private:
+    color albedo;
+};
+
+// Value of tex at the hit in rec, filtered over the footprint of r_in there.
+inline color texture_value(const texture &tex, const ray &r_in, const hit_record &rec)
+{
+    double u, v, uv_scale;
+    rec.surface_uv(u, v, uv_scale);
+    return tex.value(u, v, rec.p, r_in.footprint(rec.t) / uv_scale);
+}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef TILE_CACHE_H
+#define TILE_CACHE_H
+
+#include "../utils/sharded_cache.h"
+
+#include <vector>
+
+// One square block of texels from a mip level, 8-bit RGB as stored in the texture file.
+struct texture_tile
+{
+    int size;
+    std::vector<unsigned char> texels; // size * size * 3, row-major
+};
+
+inline size_t cache_bytes(const texture_tile &tile)
+{
+    return sizeof(texture_tile) + tile.texels.size();
+}
+
+// Bounded cache of decoded texture tiles; the global() one is shared by all image textures.
+using tile_cache = sharded_cache<texture_tile>;
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef ALIAS_TABLE_H
+#define ALIAS_TABLE_H
+
+#include <cstdint>
+#include <vector>
+
+// Walker/Vose alias table: after O(n) construction, draws index i with probability
+// weights[i] / sum(weights) in constant time from a single uniform number.
+class alias_table
+{
+public:
+    alias_table() {}
+
+    explicit alias_table(const std::vector<double> &weights)
+    {
+        size_t n = weights.size();
+        double total = 0;
+        for (double w : weights)
+            total += w;
+
+        entries.resize(n);
+        probabilities.resize(n);
+        if (n == 0 || total <= 0)
+        {
+            // Degenerate input: fall back to uniform.
+            for (size_t i = 0; i < n; i++)
+            {
+                entries[i] = {1.0, uint32_t(i)};
+                probabilities[i] = 1.0 / double(n);
+            }
+            return;
+        }
+
+        // Scaled so the average bucket holds exactly 1.
+        std::vector<double> scaled(n);
+        std::vector<uint32_t> small, large;
+        for (size_t i = 0; i < n; i++)
+        {
+            probabilities[i] = weights[i] / total;
+            scaled[i] = probabilities[i] * double(n);
+            (scaled[i] < 1 ? small : large).push_back(uint32_t(i));
+        }
+
+        while (!small.empty() && !large.empty())
+        {
+            uint32_t s = small.back(), l = large.back();
+            small.pop_back();
+            entries[s] = {scaled[s], l};
+            scaled[l] -= 1 - scaled[s];
+            if (scaled[l] < 1)
+            {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        // Whatever is left is 1 up to rounding.
+        for (uint32_t i : large)
+            entries[i] = {1.0, i};
+        for (uint32_t i : small)
+            entries[i] = {1.0, i};
+    }
+
+    size_t size() const { return entries.size(); }
+
+    // Probability of drawing index i.
+    double probability(size_t i) const { return probabilities[i]; }
+
+    // Maps xi in [0, 1) to an index.
+    size_t sample(double xi) const
+    {
+        double x = xi * double(entries.size());
+        size_t i = size_t(x);
+        if (i >= entries.size())
+            i = entries.size() - 1;
+        return (x - double(i)) < entries[i].threshold ? i : entries[i].alias;
+    }
+
+private:
+    struct entry
+    {
+        double threshold;
+        uint32_t alias;
+    };
+
+    std::vector<entry> entries;
+    std::vector<double> probabilities;
+};
+
+#endif
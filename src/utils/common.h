@@ -2,6 +2,7 @@
 #define COMMON_H
 
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <limits>
@@ -20,9 +21,33 @@ inline double degrees_to_radians(double degrees)
 {
     return degrees * pi / 180.0;
 }
+
+// Random numbers come from a per-thread xorshift64* generator, so threads never share state and
+// a render is reproducible when each pixel reseeds it (see camera::seed).
+inline uint64_t splitmix64(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+inline uint64_t &random_state()
+{
+    thread_local uint64_t state = 0x853C49E6748FEA9Bull;
+    return state;
+}
+inline void seed_random(uint64_t seed)
+{
+    uint64_t state = splitmix64(seed);
+    random_state() = state ? state : 1;
+}
 inline double random_double()
 {
-    return std::rand() / (RAND_MAX + 1.0);
+    uint64_t &x = random_state();
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    return ((x * 0x2545F4914F6CDD1Dull) >> 11) * 0x1.0p-53;
 }
 inline double random_double(double min, double max)
 {
@@ -10,6 +10,10 @@ public:
 
     interval(double min, double max) : min(min), max(max) {}
 
+    // The tightest interval enclosing both a and b.
+    interval(const interval &a, const interval &b)
+        : min(a.min <= b.min ? a.min : b.min), max(a.max >= b.max ? a.max : b.max) {}
+
     double size() const
     {
         return max - min;
@@ -22,6 +26,11 @@ public:
     {
         return min < x && x < max;
     }
+    interval expand(double delta) const
+    {
+        auto padding = delta / 2;
+        return interval(min - padding, max + padding);
+    }
     double clamp(double x) const
     {
         if (x < min)
@@ -34,7 +43,7 @@ public:
     static const interval empty, universe;
 };
 
-const interval interval::empty = interval(+infinity, -infinity);
-const interval interval::universe = interval(-infinity, +infinity);
+inline const interval interval::empty = interval(+infinity, -infinity);
+inline const interval interval::universe = interval(-infinity, +infinity);
 
 #endif
\ No newline at end of file
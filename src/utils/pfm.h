@@ -0,0 +1,61 @@
+#ifndef PFM_H
+#define PFM_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+// Reads a color (PF) or grayscale (Pf) Portable Float Map. Pixels are returned row-major with
+// the top row first (PFM stores rows bottom to top), as linear floating-point radiance. Returns
+// false if the file cannot be read or is not a PFM.
+inline bool read_pfm(const std::string &path, int &width, int &height, std::vector<color> &pixels)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+
+    std::string magic;
+    double scale;
+    in >> magic >> width >> height >> scale;
+    if (!in || (magic != "PF" && magic != "Pf") || width < 1 || height < 1 || scale == 0)
+        return false;
+    in.get(); // single whitespace after the header
+
+    int channels = magic == "PF" ? 3 : 1;
+    std::vector<float> raw(size_t(width) * height * channels);
+    in.read(reinterpret_cast<char *>(raw.data()), std::streamsize(raw.size() * sizeof(float)));
+    if (!in)
+        return false;
+
+    // A negative scale marks little-endian data.
+    const uint16_t probe = 1;
+    bool host_little = *reinterpret_cast<const unsigned char *>(&probe) == 1;
+    if ((scale < 0) != host_little)
+    {
+        for (auto &f : raw)
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &f, sizeof(bits));
+            bits = (bits >> 24) | ((bits >> 8) & 0xff00) | ((bits << 8) & 0xff0000) | (bits << 24);
+            std::memcpy(&f, &bits, sizeof(bits));
+        }
+    }
+
+    pixels.assign(size_t(width) * height, color());
+    for (int y = 0; y < height; y++)
+    {
+        const float *row = &raw[size_t(height - 1 - y) * width * channels];
+        for (int x = 0; x < width; x++)
+        {
+            const float *c = row + size_t(x) * channels;
+            pixels[size_t(y) * width + x] = channels == 3 ? color(c[0], c[1], c[2]) : color(c[0], c[0], c[0]);
+        }
+    }
+    return true;
+}
+
+#endif
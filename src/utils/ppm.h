@@ -0,0 +1,85 @@
+#ifndef PPM_H
+#define PPM_H
+
+#include <cctype>
+#include <fstream>
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+// Reads a plain (P3) or binary (P6) PPM image. Pixels are returned row-major with components
+// scaled to [0, 1], exactly as stored (no gamma conversion). Returns false if the stream does
+// not hold a PPM.
+inline bool read_ppm(std::istream &in, int &width, int &height, std::vector<color> &pixels)
+{
+    // Skips whitespace and '#' comments between header fields.
+    auto skip = [&in] {
+        while (true)
+        {
+            int c = in.peek();
+            if (c == '#')
+            {
+                std::string comment;
+                std::getline(in, comment);
+            }
+            else if (std::isspace(c))
+                in.get();
+            else
+                return;
+        }
+    };
+
+    std::string magic;
+    int max_value;
+    in >> magic;
+    skip();
+    in >> width;
+    skip();
+    in >> height;
+    skip();
+    in >> max_value;
+    if (!in || (magic != "P3" && magic != "P6") || width < 1 || height < 1 || max_value < 1 || max_value > 65535)
+        return false;
+
+    pixels.assign(size_t(width) * height, color());
+    double scale = 1.0 / max_value;
+    if (magic == "P3")
+    {
+        for (auto &p : pixels)
+        {
+            int r, g, b;
+            in >> r >> g >> b;
+            p = color(r * scale, g * scale, b * scale);
+        }
+    }
+    else
+    {
+        in.get(); // single whitespace after the header
+        int bytes = max_value < 256 ? 1 : 2;
+        std::vector<unsigned char> raw(pixels.size() * 3 * bytes);
+        in.read(reinterpret_cast<char *>(raw.data()), std::streamsize(raw.size()));
+        for (size_t k = 0; k < pixels.size(); k++)
+        {
+            double c[3];
+            for (int n = 0; n < 3; n++)
+            {
+                size_t at = (k * 3 + n) * bytes;
+                c[n] = (bytes == 1 ? raw[at] : (raw[at] << 8 | raw[at + 1])) * scale;
+            }
+            pixels[k] = color(c[0], c[1], c[2]);
+        }
+    }
+
+    return bool(in);
+}
+
+// As above, from the file at path. Returns false if it cannot be read or is not a PPM.
+inline bool read_ppm(const std::string &path, int &width, int &height, std::vector<color> &pixels)
+{
+    std::ifstream in(path, std::ios::binary);
+    return in && read_ppm(in, width, height, pixels);
+}
+
+#endif
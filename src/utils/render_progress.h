@@ -0,0 +1,205 @@
+#ifndef RENDER_PROGRESS_H
+#define RENDER_PROGRESS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+// Live progress of a render, updated from the render threads and reported while they run.
+//
+// Renderers count the rays of each pixel as they trace it and add them, with the pixel and its
+// samples, to one of a set of cache-line sized shards when the pixel is done (pixel_done). Each
+// thread keeps to its own shard, so the adds rarely contend. Between start() and finish() a
+// reporter thread sums the shards every interval seconds and prints completion, samples,
+// rays per second and the estimated time left to std::clog. With metrics_path set, the same
+// figures are written there in the Prometheus text format, replaced atomically for scrapers.
+class render_progress
+{
+public:
+    double interval = 1;      // seconds between reports; 0 prints only the final line
+    std::string metrics_path; // Prometheus text file, written when not empty
+    std::ostream *out = &std::clog;
+
+    render_progress() = default;
+    render_progress(const render_progress &) = delete;
+    render_progress &operator=(const render_progress &) = delete;
+
+    ~render_progress() { finish(); }
+
+    // Starts reporting a render of total_pixels pixel passes and total_samples samples.
+    void start(uint64_t total_pixels, uint64_t total_samples)
+    {
+        finish();
+        for (auto &s : shards)
+        {
+            s.pixels.store(0, std::memory_order_relaxed);
+            s.samples.store(0, std::memory_order_relaxed);
+            s.rays.store(0, std::memory_order_relaxed);
+        }
+        pixels_total = total_pixels;
+        samples_total = total_samples;
+        started = clock::now();
+        last_time = started;
+        last_rays = 0;
+        stopping = false;
+        running = true;
+        reporter = std::thread([this] { report_loop(); });
+    }
+
+    // Stops reporting, after a final report. Does nothing if not started.
+    void finish()
+    {
+        if (!running)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        reporter.join();
+        running = false;
+    }
+
+    // Adds a finished pixel pass of samples samples that traced rays rays.
+    void pixel_done(int samples, uint64_t rays)
+    {
+        shard &s = shards[shard_index()];
+        s.pixels.fetch_add(1, std::memory_order_relaxed);
+        s.samples.fetch_add(uint64_t(samples), std::memory_order_relaxed);
+        s.rays.fetch_add(rays, std::memory_order_relaxed);
+    }
+
+    struct snapshot
+    {
+        uint64_t pixels, pixels_total;
+        uint64_t samples, samples_total;
+        uint64_t rays;
+        double elapsed;        // seconds since start()
+        double rays_per_sec;   // since the previous report
+        double eta;            // seconds, or -1 before any sample is done
+    };
+
+private:
+    using clock = std::chrono::steady_clock;
+    static constexpr int shard_count = 64;
+
+    struct alignas(64) shard
+    {
+        std::atomic<uint64_t> pixels{0};
+        std::atomic<uint64_t> samples{0};
+        std::atomic<uint64_t> rays{0};
+    };
+
+    shard shards[shard_count];
+    uint64_t pixels_total = 0, samples_total = 0;
+    clock::time_point started, last_time;
+    uint64_t last_rays = 0;
+
+    std::thread reporter;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    bool running = false;
+
+    static int shard_index()
+    {
+        static std::atomic<int> next{0};
+        static thread_local int index = next.fetch_add(1, std::memory_order_relaxed) % shard_count;
+        return index;
+    }
+
+    snapshot take()
+    {
+        snapshot s{0, pixels_total, 0, samples_total, 0, 0, 0, -1};
+        for (const auto &sh : shards)
+        {
+            s.pixels += sh.pixels.load(std::memory_order_relaxed);
+            s.samples += sh.samples.load(std::memory_order_relaxed);
+            s.rays += sh.rays.load(std::memory_order_relaxed);
+        }
+        auto now = clock::now();
+        s.elapsed = std::chrono::duration<double>(now - started).count();
+        double since_last = std::chrono::duration<double>(now - last_time).count();
+        s.rays_per_sec = since_last > 0 ? double(s.rays - last_rays) / since_last : 0;
+        last_time = now;
+        last_rays = s.rays;
+        if (s.samples > 0)
+            s.eta = s.elapsed * double(s.samples_total - std::min(s.samples, s.samples_total)) / double(s.samples);
+        return s;
+    }
+
+    void report_loop()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping)
+        {
+            if (interval > 0)
+                wake.wait_for(lock, std::chrono::duration<double>(interval), [this] { return stopping; });
+            else
+                wake.wait(lock, [this] { return stopping; });
+            if (stopping)
+                break;
+            report(take(), false);
+        }
+
+        // Rates of the final report cover the whole render.
+        last_time = started;
+        last_rays = 0;
+        report(take(), true);
+    }
+
+    void report(const snapshot &s, bool final)
+    {
+        if (out)
+        {
+            double percent = s.samples_total ? 100.0 * double(s.samples) / double(s.samples_total) : 100;
+            std::ostringstream line;
+            line << std::fixed << std::setprecision(1) << "\rRendered " << percent << "% (" << s.pixels << '/'
+                 << s.pixels_total << " pixels, " << s.samples << " samples), " << std::setprecision(2)
+                 << s.rays_per_sec / 1e6 << " Mrays/s";
+            if (!final && s.eta >= 0)
+                line << ", ETA " << std::setprecision(0) << s.eta << " s";
+            line << "      ";
+            *out << line.str() << (final ? "\n" : "") << std::flush;
+        }
+        if (!metrics_path.empty())
+            write_metrics(s, final);
+    }
+
+    void write_metrics(const snapshot &s, bool final) const
+    {
+        std::string temporary = metrics_path + ".tmp";
+        {
+            std::ofstream file(temporary);
+            auto metric = [&](const char *name, const char *type, const char *help, double value) {
+                file << "# HELP raytracer_" << name << ' ' << help << "\n# TYPE raytracer_" << name << ' ' << type
+                     << "\nraytracer_" << name << ' ' << value << '\n';
+            };
+            file.precision(12);
+            metric("render_active", "gauge", "1 while a frame is rendering.", final ? 0 : 1);
+            metric("pixels_completed", "gauge", "Pixel passes completed in the current frame.", double(s.pixels));
+            metric("pixels_total", "gauge", "Pixel passes in the current frame.", double(s.pixels_total));
+            metric("samples_completed", "gauge", "Samples completed in the current frame.", double(s.samples));
+            metric("samples_total", "gauge", "Samples in the current frame.", double(s.samples_total));
+            metric("rays_traced", "gauge", "Rays traced in the current frame.", double(s.rays));
+            metric("rays_per_second", "gauge", "Rays traced per second over the last interval.", s.rays_per_sec);
+            metric("elapsed_seconds", "gauge", "Seconds since the frame started.", s.elapsed);
+            metric("eta_seconds", "gauge", "Estimated seconds until the frame is done, -1 if unknown.",
+                   final ? 0 : s.eta);
+            if (!file)
+                return;
+        }
+        std::rename(temporary.c_str(), metrics_path.c_str());
+    }
+};
+
+#endif
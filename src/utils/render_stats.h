@@ -0,0 +1,204 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "common.h"
+
+// Per-ray statistics. Counters live in one render_stats block per thread, so the hot path only
+// touches thread-local memory; blocks are summed by merged_stats() after a render. Everything is
+// compiled out unless the build defines RAYTRACER_STATS (cmake -DRAYTRACER_STATS=ON).
+#ifdef RAYTRACER_STATS
+#define RT_STAT(statement) statement
+#else
+#define RT_STAT(statement)
+#endif
+
+enum stat_primitive
+{
+    stat_sphere,
+    stat_triangle,
+    stat_plane,
+    stat_cube,
+    stat_cylinder,
+    stat_cone,
+    stat_primitive_count
+};
+
+enum stat_material
+{
+    stat_lambertian,
+    stat_metal,
+    stat_dielectric,
+    stat_material_count
+};
+
+struct render_stats
+{
+    static const int path_length_buckets = 64;
+
+    uint64_t primary_rays = 0;
+    uint64_t secondary_rays = 0;
+    uint64_t tests[stat_primitive_count] = {};
+    uint64_t scatters[stat_material_count] = {};
+    // path_length[n] counts paths that ended after n bounces (the last bucket collects longer ones).
+    uint64_t path_length[path_length_buckets] = {};
+    uint64_t pixels = 0;
+    uint64_t pixel_time_ns = 0;
+
+    uint64_t total_tests() const
+    {
+        uint64_t sum = 0;
+        for (auto t : tests)
+            sum += t;
+        return sum;
+    }
+
+    void record_path(int bounces)
+    {
+        path_length[std::min(bounces, path_length_buckets - 1)]++;
+    }
+
+    render_stats &operator+=(const render_stats &other)
+    {
+        primary_rays += other.primary_rays;
+        secondary_rays += other.secondary_rays;
+        for (int i = 0; i < stat_primitive_count; i++)
+            tests[i] += other.tests[i];
+        for (int i = 0; i < stat_material_count; i++)
+            scatters[i] += other.scatters[i];
+        for (int i = 0; i < path_length_buckets; i++)
+            path_length[i] += other.path_length[i];
+        pixels += other.pixels;
+        pixel_time_ns += other.pixel_time_ns;
+        return *this;
+    }
+};
+
+namespace stats_detail
+{
+    // Owns every thread's counter block so they outlive their threads and can be merged.
+    struct registry
+    {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<render_stats>> blocks;
+    };
+
+    inline registry &global_registry()
+    {
+        static registry r;
+        return r;
+    }
+}
+
+// The calling thread's counter block, registered on first use.
+inline render_stats &local_stats()
+{
+    thread_local render_stats *block = nullptr;
+    if (!block)
+    {
+        auto &r = stats_detail::global_registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.blocks.push_back(std::make_unique<render_stats>());
+        block = r.blocks.back().get();
+    }
+    return *block;
+}
+
+// Sums all thread blocks. Only meaningful while no render is running.
+inline render_stats merged_stats()
+{
+    auto &r = stats_detail::global_registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    render_stats total;
+    for (const auto &block : r.blocks)
+        total += *block;
+    return total;
+}
+
+// Zeroes all thread blocks. Only call while no render is running.
+inline void reset_stats()
+{
+    auto &r = stats_detail::global_registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (auto &block : r.blocks)
+        *block = render_stats();
+}
+
+inline void print_stats(std::ostream &out, const render_stats &s, double seconds)
+{
+    static const char *primitive_names[stat_primitive_count] = {"sphere", "triangle", "plane", "cube", "cylinder", "cone"};
+    static const char *material_names[stat_material_count] = {"lambertian", "metal", "dielectric"};
+
+    uint64_t rays = s.primary_rays + s.secondary_rays;
+    out << "Ray statistics:\n"
+        << "  primary rays:      " << s.primary_rays << '\n'
+        << "  secondary rays:    " << s.secondary_rays << '\n';
+    if (seconds > 0)
+        out << "  rays/sec:          " << rays / seconds << '\n';
+
+    out << "  intersection tests:\n";
+    for (int i = 0; i < stat_primitive_count; i++)
+        out << "    " << std::setw(10) << std::left << primitive_names[i] << s.tests[i] << '\n';
+
+    out << "  scatter calls:\n";
+    for (int i = 0; i < stat_material_count; i++)
+        out << "    " << std::setw(10) << std::left << material_names[i] << s.scatters[i] << '\n';
+
+    uint64_t paths = 0, bounces = 0;
+    int longest = 0;
+    for (int i = 0; i < render_stats::path_length_buckets; i++)
+    {
+        paths += s.path_length[i];
+        bounces += s.path_length[i] * uint64_t(i);
+        if (s.path_length[i])
+            longest = i;
+    }
+    out << "  path length (bounces):\n";
+    for (int i = 0; i <= longest; i++)
+        out << "    " << std::setw(4) << std::right << i << "  " << s.path_length[i] << '\n';
+    if (paths)
+        out << "  mean path length:  " << double(bounces) / paths << '\n';
+    if (s.pixels)
+        out << "  mean time/pixel:   " << double(s.pixel_time_ns) / s.pixels / 1000.0 << " us\n";
+    out << std::right;
+}
+
+// Maps t in [0, 1] onto a blue-cyan-green-yellow-red ramp.
+inline color heat_color(double t)
+{
+    t = std::clamp(t, 0.0, 1.0);
+    static const color stops[5] = {
+        color(0.0, 0.0, 0.5), color(0.0, 0.8, 1.0), color(0.1, 0.9, 0.1), color(1.0, 0.9, 0.0), color(1.0, 0.0, 0.0)};
+    double x = t * 4;
+    int i = std::min(int(x), 3);
+    double f = x - i;
+    return (1 - f) * stops[i] + f * stops[i + 1];
+}
+
+// Writes a false-color PPM of per-pixel costs (row-major, width * height entries). Costs are
+// normalized to the 99th percentile so a few outliers do not wash out the rest of the image.
+inline void write_heatmap(std::ostream &out, int width, int height, const std::vector<double> &costs)
+{
+    std::vector<double> sorted(costs);
+    std::sort(sorted.begin(), sorted.end());
+    double scale = sorted.empty() ? 0 : sorted[std::min(sorted.size() - 1, sorted.size() * 99 / 100)];
+    if (scale <= 0)
+        scale = 1;
+
+    out << "P3\n"
+        << width << ' ' << height << "\n255\n";
+    for (size_t k = 0; k < size_t(width) * height; k++)
+    {
+        color c = heat_color(costs[k] / scale);
+        out << int(255.999 * c.x()) << ' ' << int(255.999 * c.y()) << ' ' << int(255.999 * c.z()) << '\n';
+    }
+}
+
+#endif
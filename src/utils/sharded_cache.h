@@ -0,0 +1,147 @@
+#ifndef SHARDED_CACHE_H
+#define SHARDED_CACHE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Bounded cache of decoded blocks of file data (texture tiles, geometry chunks), keyed by 64-bit
+// ids. Keys are split over shards, each with its own mutex, LRU list and share of the byte
+// budget, so render threads looking up different entries rarely contend. Entries are handed
+// out as shared_ptr, so one evicted while a thread is still using it stays valid until that
+// thread lets go. cache_bytes(const value_t &) gives the size charged per entry.
+template <typename value_t>
+class sharded_cache
+{
+public:
+    using entry_ptr = std::shared_ptr<const value_t>;
+
+    struct counters
+    {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        size_t resident_bytes;
+    };
+
+    explicit sharded_cache(size_t budget_bytes = size_t(64) << 20)
+    {
+        set_budget(budget_bytes);
+    }
+
+    sharded_cache(const sharded_cache &) = delete;
+    sharded_cache &operator=(const sharded_cache &) = delete;
+
+    // The process-wide cache for this kind of entry.
+    static sharded_cache &global()
+    {
+        static sharded_cache cache;
+        return cache;
+    }
+
+    // Takes effect as entries are next inserted; does not evict immediately.
+    void set_budget(size_t budget_bytes)
+    {
+        shard_budget.store(std::max<size_t>(budget_bytes / shard_count, 1));
+    }
+
+    size_t budget() const { return shard_budget.load() * shard_count; }
+
+    // Returns the entry for key, calling load() to produce it on a miss. load runs without any
+    // lock held; if two threads miss on the same key at once, the first insert wins.
+    template <typename loader_t>
+    entry_ptr get(uint64_t key, loader_t &&load)
+    {
+        auto &s = shards[shard_of(key)];
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            auto it = s.index.find(key);
+            if (it != s.index.end())
+            {
+                s.lru.splice(s.lru.begin(), s.lru, it->second);
+                hit_count.fetch_add(1, std::memory_order_relaxed);
+                return it->second->second;
+            }
+        }
+        miss_count.fetch_add(1, std::memory_order_relaxed);
+
+        entry_ptr entry = load();
+        size_t bytes = cache_bytes(*entry);
+
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it = s.index.find(key);
+        if (it != s.index.end())
+            return it->second->second;
+
+        s.lru.emplace_front(key, entry);
+        s.index[key] = s.lru.begin();
+        s.bytes += bytes;
+
+        // Evict least recently used entries, always keeping the one just inserted.
+        size_t limit = shard_budget.load(std::memory_order_relaxed);
+        while (s.bytes > limit && s.lru.size() > 1)
+        {
+            auto &victim = s.lru.back();
+            s.bytes -= cache_bytes(*victim.second);
+            s.index.erase(victim.first);
+            s.lru.pop_back();
+            eviction_count.fetch_add(1, std::memory_order_relaxed);
+        }
+        return entry;
+    }
+
+    counters stats()
+    {
+        counters c{hit_count.load(), miss_count.load(), eviction_count.load(), 0};
+        for (auto &s : shards)
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            c.resident_bytes += s.bytes;
+        }
+        return c;
+    }
+
+    void clear()
+    {
+        for (auto &s : shards)
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            s.lru.clear();
+            s.index.clear();
+            s.bytes = 0;
+        }
+    }
+
+private:
+    static const int shard_count = 16;
+
+    struct shard
+    {
+        std::mutex mutex;
+        std::list<std::pair<uint64_t, entry_ptr>> lru; // most recently used first
+        std::unordered_map<uint64_t, typename std::list<std::pair<uint64_t, entry_ptr>>::iterator> index;
+        size_t bytes = 0;
+    };
+
+    shard shards[shard_count];
+    std::atomic<size_t> shard_budget{0};
+    std::atomic<uint64_t> hit_count{0};
+    std::atomic<uint64_t> miss_count{0};
+    std::atomic<uint64_t> eviction_count{0};
+
+    static int shard_of(uint64_t key)
+    {
+        key ^= key >> 29;
+        key *= 0xbf58476d1ce4e5b9ull;
+        key ^= key >> 32;
+        return int(key % shard_count);
+    }
+};
+
+#endif
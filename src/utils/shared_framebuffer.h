@@ -0,0 +1,165 @@
+#ifndef SHARED_FRAMEBUFFER_H
+#define SHARED_FRAMEBUFFER_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common.h"
+
+// Framebuffer in POSIX shared memory (/dev/shm/<name>) that a renderer publishes progressive
+// frames to and any local process can poll. Layout:
+//
+//   header   magic "RTFB01\0\0", uint32 width, uint32 height, uint64 sequence, uint64 frame
+//   pixels   width * height RGBA, 8 bits per component, gamma encoded like write_color
+//
+// Writers follow a sequence lock: sequence is odd while a frame is being copied in and even
+// when it is complete, so a reader retries if the sequence changed (or was odd) around its copy.
+class shared_framebuffer
+{
+public:
+    struct header
+    {
+        char magic[8];
+        uint32_t width;
+        uint32_t height;
+        std::atomic<uint64_t> sequence;
+        uint64_t frame; // number of frames published so far
+    };
+
+    shared_framebuffer() {}
+    ~shared_framebuffer() { close(); }
+
+    shared_framebuffer(const shared_framebuffer &) = delete;
+    shared_framebuffer &operator=(const shared_framebuffer &) = delete;
+
+    // Creates (or resizes) the segment for writing. name is a POSIX shm name such as "/preview".
+    bool create(const std::string &name, int width, int height)
+    {
+        close();
+        size_t bytes = sizeof(header) + size_t(width) * height * 4;
+        int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+        if (fd < 0)
+            return false;
+        if (ftruncate(fd, off_t(bytes)) != 0 || !map(fd, bytes, true))
+        {
+            ::close(fd);
+            return false;
+        }
+        ::close(fd);
+
+        std::memcpy(head->magic, magic, sizeof(magic));
+        head->width = uint32_t(width);
+        head->height = uint32_t(height);
+        head->frame = 0;
+        head->sequence.store(0, std::memory_order_release);
+        owner_name = name;
+        return true;
+    }
+
+    // Opens an existing segment for reading.
+    bool open(const std::string &name)
+    {
+        close();
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        bool ok = fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(header) && map(fd, size_t(st.st_size), false);
+        ::close(fd);
+        if (!ok)
+            return false;
+        if (std::memcmp(head->magic, magic, sizeof(magic)) != 0 ||
+            mapped_size < sizeof(header) + size_t(head->width) * head->height * 4)
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    // Unmaps the segment. The creator also removes the name.
+    void close()
+    {
+        if (head)
+            munmap(head, mapped_size);
+        if (!owner_name.empty())
+            shm_unlink(owner_name.c_str());
+        head = nullptr;
+        mapped_size = 0;
+        owner_name.clear();
+    }
+
+    bool is_open() const { return head != nullptr; }
+    int width() const { return int(head->width); }
+    int height() const { return int(head->height); }
+
+    // Publishes linear colors (row-major, width * height of them) as the next frame.
+    void publish(const std::vector<color> &pixels)
+    {
+        uint64_t seq = head->sequence.load(std::memory_order_relaxed);
+        head->sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        static const interval intensity(0.000, 0.999);
+        unsigned char *out = data();
+        for (size_t k = 0; k < size_t(head->width) * head->height; k++)
+        {
+            out[4 * k + 0] = (unsigned char)(256 * intensity.clamp(linear_to_gamma(pixels[k].x())));
+            out[4 * k + 1] = (unsigned char)(256 * intensity.clamp(linear_to_gamma(pixels[k].y())));
+            out[4 * k + 2] = (unsigned char)(256 * intensity.clamp(linear_to_gamma(pixels[k].z())));
+            out[4 * k + 3] = 255;
+        }
+        head->frame++;
+        head->sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    // Copies out the latest complete frame. Returns false if none has been published yet or the
+    // writer kept overwriting it.
+    bool read(std::vector<unsigned char> &rgba, uint64_t &frame) const
+    {
+        for (int attempt = 0; attempt < 100; attempt++)
+        {
+            uint64_t before = head->sequence.load(std::memory_order_acquire);
+            if (before & 1)
+            {
+                usleep(1000);
+                continue;
+            }
+            rgba.assign(data(), data() + size_t(head->width) * head->height * 4);
+            frame = head->frame;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (head->sequence.load(std::memory_order_relaxed) == before)
+                return frame > 0;
+        }
+        return false;
+    }
+
+private:
+    static constexpr char magic[8] = {'R', 'T', 'F', 'B', '0', '1', '\0', '\0'};
+
+    header *head = nullptr;
+    size_t mapped_size = 0;
+    std::string owner_name;
+
+    unsigned char *data() const { return reinterpret_cast<unsigned char *>(head + 1); }
+
+    bool map(int fd, size_t bytes, bool writable)
+    {
+        void *p = mmap(nullptr, bytes, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+            return false;
+        head = static_cast<header *>(p);
+        mapped_size = bytes;
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,215 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Work-stealing scheduler used by camera as an alternative to OpenMP. Owns a fixed set of
+// worker threads, each with its own task deque. parallel_for deals contiguous index ranges out
+// to the deques; a worker takes tasks from the front of its own deque and, when it runs dry,
+// steals from the back of another worker's deque, so neighbouring tasks tend to stay on one
+// thread. Workers can optionally be pinned to CPUs, which makes Linux first-touch allocation
+// place memory a task allocates on that worker's NUMA node.
+class task_scheduler
+{
+public:
+    // threads <= 0 uses one worker per hardware thread.
+    explicit task_scheduler(int threads = 0, bool pin_threads = false)
+    {
+        if (threads <= 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+
+        for (int w = 0; w < threads; w++)
+            queues.push_back(std::make_unique<worker_queue>());
+        for (int w = 0; w < threads; w++)
+            workers.emplace_back([this, w, pin_threads] { worker_loop(w, pin_threads); });
+    }
+
+    ~task_scheduler()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        work_ready.notify_all();
+        for (auto &t : workers)
+            t.join();
+    }
+
+    task_scheduler(const task_scheduler &) = delete;
+    task_scheduler &operator=(const task_scheduler &) = delete;
+
+    int size() const { return int(workers.size()); }
+
+    // Calls fn(index, worker) for every index in [0, count) and returns once all calls have
+    // finished. Calls from different threads are serialized.
+    void parallel_for(int count, const std::function<void(int, int)> &fn)
+    {
+        if (count <= 0)
+            return;
+
+        std::lock_guard<std::mutex> run_lock(run_mutex);
+
+        // The count is in place before any task is visible: a worker still scanning after the
+        // previous call may pick the new tasks up before it sees the new generation.
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            remaining = count;
+        }
+
+        int n = size();
+        for (int w = 0; w < n; w++)
+        {
+            std::lock_guard<std::mutex> lock(queues[w]->mutex);
+            int begin = int(int64_t(count) * w / n);
+            int end = int(int64_t(count) * (w + 1) / n);
+            for (int i = begin; i < end; i++)
+                queues[w]->tasks.push_back({&fn, i});
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            generation++;
+        }
+        work_ready.notify_all();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        work_done.wait(lock, [this] { return remaining == 0; });
+    }
+
+    // Number of tasks taken from another worker's deque since construction.
+    uint64_t steals() const { return steal_count.load(); }
+
+private:
+    // Each queued task carries its function, so a worker that is still looking for work when
+    // one parallel_for ends can never pair the next call's indices with the old function.
+    struct task_item
+    {
+        const std::function<void(int, int)> *fn;
+        int index;
+    };
+
+    struct worker_queue
+    {
+        std::mutex mutex;
+        std::deque<task_item> tasks;
+    };
+
+    std::vector<std::unique_ptr<worker_queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex run_mutex;
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    std::condition_variable work_done;
+    int remaining = 0;
+    uint64_t generation = 0;
+    bool stopping = false;
+    std::atomic<uint64_t> steal_count{0};
+
+    static void pin_to_cpu(int worker)
+    {
+#ifdef __linux__
+        cpu_set_t allowed;
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+            return;
+        int usable = CPU_COUNT(&allowed);
+        if (usable == 0)
+            return;
+
+        // Pick the (worker mod usable)-th CPU this process may run on.
+        int target = worker % usable;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (CPU_ISSET(cpu, &allowed) && target-- == 0)
+            {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(cpu, &set);
+                pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+                return;
+            }
+        }
+#else
+        (void)worker;
+#endif
+    }
+
+    bool pop_own(int worker, task_item &item)
+    {
+        auto &q = *queues[worker];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.tasks.empty())
+            return false;
+        item = q.tasks.front();
+        q.tasks.pop_front();
+        return true;
+    }
+
+    bool steal(int worker, task_item &item)
+    {
+        int n = size();
+        for (int k = 1; k < n; k++)
+        {
+            auto &q = *queues[(worker + k) % n];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (!q.tasks.empty())
+            {
+                item = q.tasks.back();
+                q.tasks.pop_back();
+                steal_count++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void worker_loop(int worker, bool pin_threads)
+    {
+        if (pin_threads)
+            pin_to_cpu(worker);
+
+        uint64_t seen = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                work_ready.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+
+            task_item item;
+            int done = 0;
+            while (pop_own(worker, item) || steal(worker, item))
+            {
+                (*item.fn)(item.index, worker);
+                done++;
+            }
+
+            if (done > 0)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                remaining -= done;
+                if (remaining == 0)
+                    work_done.notify_all();
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Timeline tracing. While enabled, trace::scope objects record complete events (name, thread,
+// start, duration) into a buffer owned by the recording thread, so recording never takes a
+// lock. write_chrome_trace() exports everything in the Chrome trace-event JSON format, which
+// chrome://tracing and Perfetto can open.
+namespace trace
+{
+    struct event
+    {
+        const char *name;
+        int64_t arg; // shown as args.index when >= 0 (row, job id, ...)
+        int64_t start_ns;
+        int64_t duration_ns;
+    };
+
+    struct thread_buffer
+    {
+        int tid;
+        std::vector<event> events;
+    };
+
+    namespace detail
+    {
+        struct registry
+        {
+            std::atomic<bool> enabled{false};
+            std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+            std::mutex mutex;
+            std::vector<std::unique_ptr<thread_buffer>> buffers;
+        };
+
+        inline registry &global_registry()
+        {
+            static registry r;
+            return r;
+        }
+
+        inline int64_t now_ns()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - global_registry().epoch)
+                .count();
+        }
+
+        // The calling thread's buffer; only registration takes the registry lock.
+        inline thread_buffer &local_buffer()
+        {
+            thread_local thread_buffer *buffer = nullptr;
+            if (!buffer)
+            {
+                auto &r = global_registry();
+                std::lock_guard<std::mutex> lock(r.mutex);
+                r.buffers.push_back(std::make_unique<thread_buffer>());
+                buffer = r.buffers.back().get();
+                buffer->tid = int(r.buffers.size());
+                buffer->events.reserve(4096);
+            }
+            return *buffer;
+        }
+    }
+
+    inline bool enabled()
+    {
+        return detail::global_registry().enabled.load(std::memory_order_relaxed);
+    }
+
+    // Starts recording. Timestamps are relative to this call.
+    inline void enable()
+    {
+        auto &r = detail::global_registry();
+        r.epoch = std::chrono::steady_clock::now();
+        r.enabled = true;
+    }
+
+    inline void disable()
+    {
+        detail::global_registry().enabled = false;
+    }
+
+    // Records the lifetime of the object as one event. name must outlive the trace.
+    class scope
+    {
+    public:
+        explicit scope(const char *name, int64_t arg = -1)
+            : name(name), arg(arg), start_ns(enabled() ? detail::now_ns() : -1) {}
+
+        ~scope()
+        {
+            if (start_ns >= 0)
+                detail::local_buffer().events.push_back({name, arg, start_ns, detail::now_ns() - start_ns});
+        }
+
+        scope(const scope &) = delete;
+        scope &operator=(const scope &) = delete;
+
+    private:
+        const char *name;
+        int64_t arg;
+        int64_t start_ns;
+    };
+
+    // Writes all recorded events. Only call while no thread is recording.
+    inline void write_chrome_trace(std::ostream &out)
+    {
+        auto &r = detail::global_registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+
+        auto flags = out.flags();
+        auto precision = out.precision();
+        out << std::fixed << std::setprecision(3);
+        out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        bool first = true;
+        auto separator = [&] {
+            if (!first)
+                out << ",\n";
+            first = false;
+        };
+
+        for (const auto &buffer : r.buffers)
+        {
+            separator();
+            out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->tid
+                << ", \"args\": {\"name\": \"thread " << buffer->tid << "\"}}";
+
+            for (const auto &e : buffer->events)
+            {
+                separator();
+                out << "{\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->tid
+                    << ", \"ts\": " << e.start_ns / 1000.0 << ", \"dur\": " << e.duration_ns / 1000.0;
+                if (e.arg >= 0)
+                    out << ", \"args\": {\"index\": " << e.arg << "}";
+                out << "}";
+            }
+        }
+        out << "\n]}\n";
+        out.flags(flags);
+        out.precision(precision);
+    }
+}
+
+#endif
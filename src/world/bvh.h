@@ -0,0 +1,762 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "../utils/common.h"
+#include "hittable_list.h"
+
+#include "../objects/cone.h"
+#include "../objects/cube.h"
+#include "../objects/cylinder.h"
+#include "../objects/plane.h"
+#include "../objects/sphere.h"
+#include "../objects/triangle.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// The primitives a bvh's leaves point at. Composite objects are split into their triangles and
+// nested lists are flattened, so leaves hold single triangles and spheres by value and test
+// them without virtual calls; objects of other types are kept behind their pointer. Each
+// primitive remembers the index of the top-level object it came from, for hit_record::object,
+// and hits record the primitive's reference in hit_record::primitive.
+class bvh_primitives
+{
+public:
+    // A reference packs the primitive's kind into the top two bits and its index below.
+    enum kind : uint32_t
+    {
+        kind_triangle,
+        kind_sphere,
+        kind_other
+    };
+    static constexpr int kind_shift = 30;
+    static constexpr uint32_t index_mask = (uint32_t(1) << kind_shift) - 1;
+
+    std::vector<triangle> triangles;
+    std::vector<sphere> spheres;
+    std::vector<shared_ptr<hittable>> others;
+
+    void add(const hittable_list &world)
+    {
+        for (size_t k = 0; k < world.objects.size(); k++)
+            add(world.objects[k], int(k));
+    }
+
+    // Adds the primitives of from in order, except that those of each top-level object set in
+    // objects (indexed like the owners) are added again from the object. With objects re-
+    // tessellated since from was filled, this gives what add() of the whole world now would.
+    void add(const bvh_primitives &from, const std::vector<shared_ptr<hittable>> &objects)
+    {
+        size_t next = 0;
+        for (size_t k = 0; k < objects.size(); k++)
+        {
+            size_t end = next;
+            while (end < from.refs.size() && from.owner(from.refs[end]) == int(k))
+                end++;
+            if (objects[k])
+            {
+                add(objects[k], int(k));
+            }
+            else
+            {
+                for (; next < end; next++)
+                    copy(from, from.refs[next]);
+            }
+            next = end;
+        }
+    }
+
+    // Whether the primitives add() copies from object stand in for it completely: spheres,
+    // triangles and meshes whose tessellation is fixed. Other objects may change under
+    // update_lod.
+    static bool captures(const shared_ptr<hittable> &object)
+    {
+        return std::dynamic_pointer_cast<sphere>(object) || std::dynamic_pointer_cast<triangle>(object) ||
+               std::dynamic_pointer_cast<plane>(object) || std::dynamic_pointer_cast<cube>(object);
+    }
+
+    // Memory of the primitive copies, pointers and references.
+    size_t bytes() const
+    {
+        return triangles.size() * sizeof(triangle) + spheres.size() * sizeof(sphere) +
+               others.size() * sizeof(shared_ptr<hittable>) + refs.size() * (sizeof(uint32_t) + sizeof(int));
+    }
+
+    // Every primitive, in the order they were added.
+    const std::vector<uint32_t> &references() const { return refs; }
+
+    aabb bounds(uint32_t ref) const
+    {
+        uint32_t index = ref & index_mask;
+        switch (ref >> kind_shift)
+        {
+        case kind_triangle:
+            return triangles[index].bounding_box();
+        case kind_sphere:
+            return spheres[index].bounding_box();
+        default:
+            return others[index]->bounding_box();
+        }
+    }
+
+    bool hit(uint32_t ref, const ray &r, interval ray_t, hit_record &rec) const
+    {
+        uint32_t index = ref & index_mask;
+        bool hit;
+        switch (ref >> kind_shift)
+        {
+        case kind_triangle:
+            hit = triangles[index].hit(r, ray_t, rec);
+            break;
+        case kind_sphere:
+            hit = spheres[index].hit(r, ray_t, rec);
+            break;
+        default:
+            hit = others[index]->hit(r, ray_t, rec);
+            break;
+        }
+        if (hit)
+        {
+            rec.object = owners[ref >> kind_shift][index];
+            rec.primitive = int(ref);
+        }
+        return hit;
+    }
+
+    // Index of the top-level object primitive ref came from.
+    int owner(uint32_t ref) const { return owners[ref >> kind_shift][ref & index_mask]; }
+
+private:
+    std::vector<uint32_t> refs;
+    std::vector<int> owners[3];
+
+    void push(kind k, size_t index, int owner)
+    {
+        refs.push_back(uint32_t(k) << kind_shift | uint32_t(index));
+        owners[k].push_back(owner);
+    }
+
+    void copy(const bvh_primitives &from, uint32_t ref)
+    {
+        uint32_t index = ref & index_mask;
+        switch (ref >> kind_shift)
+        {
+        case kind_triangle:
+            triangles.push_back(from.triangles[index]);
+            push(kind_triangle, triangles.size() - 1, from.owner(ref));
+            break;
+        case kind_sphere:
+            spheres.push_back(from.spheres[index]);
+            push(kind_sphere, spheres.size() - 1, from.owner(ref));
+            break;
+        default:
+            others.push_back(from.others[index]);
+            push(kind_other, others.size() - 1, from.owner(ref));
+            break;
+        }
+    }
+
+    template <typename mesh_t>
+    bool add_mesh(const shared_ptr<hittable> &object, int owner)
+    {
+        auto mesh = std::dynamic_pointer_cast<mesh_t>(object);
+        if (!mesh)
+            return false;
+        for (const auto &tri : mesh->triangles())
+        {
+            triangles.push_back(*tri);
+            push(kind_triangle, triangles.size() - 1, owner);
+        }
+        return true;
+    }
+
+    void add(const shared_ptr<hittable> &object, int owner)
+    {
+        if (auto s = std::dynamic_pointer_cast<sphere>(object))
+        {
+            spheres.push_back(*s);
+            push(kind_sphere, spheres.size() - 1, owner);
+        }
+        else if (auto t = std::dynamic_pointer_cast<triangle>(object))
+        {
+            triangles.push_back(*t);
+            push(kind_triangle, triangles.size() - 1, owner);
+        }
+        else if (auto list = std::dynamic_pointer_cast<hittable_list>(object))
+        {
+            for (const auto &child : list->objects)
+                add(child, owner);
+        }
+        else if (!add_mesh<plane>(object, owner) && !add_mesh<cube>(object, owner) &&
+                 !add_mesh<cylinder>(object, owner) && !add_mesh<cone>(object, owner))
+        {
+            others.push_back(object);
+            push(kind_other, others.size() - 1, owner);
+        }
+    }
+};
+
+namespace bvh_detail
+{
+    struct item
+    {
+        aabb box;
+        point3 centroid;
+        uint32_t ref;
+    };
+
+    struct build_node
+    {
+        aabb bounds;
+        int child[2] = {-1, -1};
+        uint32_t first = 0; // leaves: items [first, first + count)
+        uint32_t count = 0;
+    };
+
+    const int max_leaf = 4;
+    const int bins = 16;
+    const double node_cost = 4; // cost of visiting a node, in primitive intersections
+    const int max_depth = 48;   // below this, nodes are split at the median, which bounds traversal stacks
+
+    inline double area(const aabb &box)
+    {
+        if (box.is_empty())
+            return 0;
+        vec3 e = box.extent();
+        return 2 * (e.x() * e.y() + e.y() * e.z() + e.z() * e.x());
+    }
+
+    // Binary BVH over items [begin, end) by the surface area heuristic, evaluated at bins
+    // candidate planes along the widest centroid axis. Returns the node index.
+    inline int build(std::vector<build_node> &nodes, std::vector<item> &items, uint32_t begin, uint32_t end,
+                     int depth = 0)
+    {
+        build_node node;
+        aabb centroids;
+        for (uint32_t i = begin; i < end; i++)
+        {
+            node.bounds = aabb(node.bounds, items[i].box);
+            centroids = aabb(centroids, aabb(items[i].centroid, items[i].centroid));
+        }
+        node.first = begin;
+        node.count = end - begin;
+        int index = int(nodes.size());
+        nodes.push_back(node);
+        if (end - begin <= 1)
+            return index;
+
+        int axis = 0;
+        vec3 extent = centroids.extent();
+        for (int a = 1; a < 3; a++)
+            if (extent[a] > extent[axis])
+                axis = a;
+        double lo = centroids.axis_interval(axis).min, width = extent[axis];
+
+        uint32_t mid = begin + (end - begin) / 2;
+        if (width > 0 && depth >= max_depth)
+            std::nth_element(items.begin() + begin, items.begin() + mid, items.begin() + end,
+                             [&](const item &a, const item &b) { return a.centroid[axis] < b.centroid[axis]; });
+        else if (width > 0)
+        {
+            auto bin_of = [&](const item &it) {
+                return std::min(bins - 1, int(bins * (it.centroid[axis] - lo) / width));
+            };
+            aabb bin_bounds[bins];
+            uint32_t bin_count[bins] = {};
+            for (uint32_t i = begin; i < end; i++)
+            {
+                int b = bin_of(items[i]);
+                bin_bounds[b] = aabb(bin_bounds[b], items[i].box);
+                bin_count[b]++;
+            }
+
+            // Cost of splitting after bin b, from prefix and suffix sweeps.
+            double right_cost[bins];
+            aabb right;
+            uint32_t right_count = 0;
+            for (int b = bins - 1; b > 0; b--)
+            {
+                right = aabb(right, bin_bounds[b]);
+                right_count += bin_count[b];
+                right_cost[b] = area(right) * right_count;
+            }
+            aabb left;
+            uint32_t left_count = 0;
+            double best = infinity;
+            int best_bin = -1;
+            for (int b = 0; b < bins - 1; b++)
+            {
+                left = aabb(left, bin_bounds[b]);
+                left_count += bin_count[b];
+                double cost = area(left) * left_count + right_cost[b + 1];
+                if (left_count > 0 && left_count < end - begin && cost < best)
+                {
+                    best = cost;
+                    best_bin = b;
+                }
+            }
+
+            double split_cost = node_cost + best / area(node.bounds);
+            if (end - begin <= uint32_t(max_leaf) && split_cost >= double(end - begin))
+                return index;
+            if (best_bin >= 0)
+                mid = uint32_t(std::partition(items.begin() + begin, items.begin() + end,
+                                              [&](const item &it) { return bin_of(it) <= best_bin; }) -
+                               items.begin());
+        }
+        else if (end - begin <= uint32_t(max_leaf))
+            return index;
+
+        int left_child = build(nodes, items, begin, mid, depth + 1);
+        int right_child = build(nodes, items, mid, end, depth + 1);
+        nodes[size_t(index)].child[0] = left_child;
+        nodes[size_t(index)].child[1] = right_child;
+        nodes[size_t(index)].count = 0;
+        return index;
+    }
+
+    // Ray in single precision, with reciprocal directions for slab tests. Zero components get
+    // a huge reciprocal instead of an infinite one, which keeps 0 * inf NaNs out of the tests.
+    struct ray_setup
+    {
+        float origin[3];
+        float inverse[3];
+
+        explicit ray_setup(const ray &r)
+        {
+            for (int a = 0; a < 3; a++)
+            {
+                double d = r.direction()[a];
+                origin[a] = float(r.origin()[a]);
+                inverse[a] = std::fabs(d) > 1e-30 ? float(1 / d) : std::copysign(1e30f, float(d));
+            }
+        }
+    };
+
+    // Slab tests round; stretching the far distance by a few ulps keeps grazing rays from
+    // slipping between boxes that touch.
+    const float far_scale = 1 + 4 * FLT_EPSILON;
+
+    inline float lower(double v)
+    {
+        float f = float(v);
+        return double(f) > v ? std::nextafter(f, -FLT_MAX) : f;
+    }
+
+    inline float upper(double v)
+    {
+        float f = float(v);
+        return double(f) < v ? std::nextafter(f, FLT_MAX) : f;
+    }
+
+    // 2^e for the exponents of a wide node, without a libm call.
+    inline float power_of_two(int e)
+    {
+        uint32_t bits = uint32_t(e + 127) << 23;
+        float f;
+        std::memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+}
+
+// Node of the binary layout: float bounds and, for inner nodes, the right child (the left one
+// follows the node). 32 bytes.
+struct bvh_binary_node
+{
+    float lo[3];
+    uint32_t count; // primitives for leaves, 0 for inner nodes
+    float hi[3];
+    uint32_t index; // first reference for leaves, right child for inner nodes
+};
+
+// Node of a wide layout with width children. Child boxes are stored to 8 bits per plane, as
+// multiples of a power of two (2^exponent per axis) above origin, rounded outward, and laid
+// out by axis so one loop over the children tests them all in a single SIMD step. A 4-wide
+// node fits one 64-byte cache line and an 8-wide node two.
+template <int width>
+struct alignas(64) bvh_wide_node
+{
+    float origin[3];
+    int8_t exponent[3];
+    uint8_t children;        // slots in use
+    uint8_t lo[3][width];
+    uint8_t hi[3][width];
+    uint8_t count[width];    // primitives for leaf children, 0 for inner ones
+    uint32_t index[width];   // first reference for leaf children, node index for inner ones
+};
+
+// Bounding volume hierarchy over a scene, built by the surface area heuristic. width 2 keeps
+// the binary tree with float bounds; width 4 or 8 collapses it into wide nodes with quantized
+// child bounds, whose children are tested together and visited nearest first. Leaves test
+// copies of the scene's triangles and spheres, so only the objects update_lod() may
+// re-tessellate are kept, to rebuild from. A bvh can also be built over some of the primitives
+// of another, as lazy_bvh does for its subtrees.
+template <int width>
+class bvh : public hittable
+{
+    static_assert(width == 2 || width == 4 || width == 8, "bvh width must be 2, 4 or 8");
+
+public:
+    using node = std::conditional_t<width == 2, bvh_binary_node, bvh_wide_node<width>>;
+
+    explicit bvh(const hittable_list &world) : specular(world.specular_bounds())
+    {
+        owned = std::make_unique<bvh_primitives>();
+        owned->add(world);
+        primitives = owned.get();
+        build(primitives->references());
+        for (const auto &object : world.objects)
+            lod_objects.push_back(bvh_primitives::captures(object) ? nullptr : object);
+    }
+
+    // Hierarchy over the primitives at subset, which must outlive it.
+    bvh(const bvh_primitives &primitives, const std::vector<uint32_t> &subset) : primitives(&primitives)
+    {
+        build(subset);
+    }
+
+    bool hit(const ray &r, interval ray_t, hit_record &rec) const override
+    {
+        if (nodes.empty())
+            return false;
+        if constexpr (width == 2)
+            return hit_binary<false>(r, ray_t, rec);
+        else
+            return hit_wide<false>(r, ray_t, rec);
+    }
+
+    // Whether r hits anything within ray_t. Traversal stops at the first hit found, which need
+    // not be the closest.
+    bool occluded(const ray &r, interval ray_t) const
+    {
+        if (nodes.empty())
+            return false;
+        hit_record rec;
+        if constexpr (width == 2)
+            return hit_binary<true>(r, ray_t, rec);
+        else
+            return hit_wide<true>(r, ray_t, rec);
+    }
+
+    aabb bounding_box() const override { return bounds; }
+
+    aabb specular_bounds() const override { return specular; }
+
+    bool update_lod(const lod_view &view) override
+    {
+        bool changed = false;
+        for (const auto &object : lod_objects)
+            if (object)
+                changed = object->update_lod(view) || changed;
+        if (!changed)
+            return false;
+        auto refreshed = std::make_unique<bvh_primitives>();
+        refreshed->add(*owned, lod_objects);
+        owned = std::move(refreshed);
+        primitives = owned.get();
+        build(primitives->references());
+        return true;
+    }
+
+    size_t node_count() const { return nodes.size(); }
+    size_t primitive_count() const { return refs.size(); }
+    size_t triangle_count() const
+    {
+        return size_t(std::count_if(refs.begin(), refs.end(), [](uint32_t ref) {
+            return ref >> bvh_primitives::kind_shift == bvh_primitives::kind_triangle;
+        }));
+    }
+
+    // Memory of the nodes and leaf references, and of the primitive copies unless built over a
+    // subset of another's.
+    size_t bytes() const
+    {
+        return nodes.size() * sizeof(node) + refs.size() * sizeof(uint32_t) + (owned ? owned->bytes() : 0);
+    }
+
+private:
+    std::vector<shared_ptr<hittable>> lod_objects; // by index in the world; null for captured ones
+    aabb specular;
+    std::unique_ptr<bvh_primitives> owned; // flattened world, unless built over a subset
+    const bvh_primitives *primitives = nullptr;
+    std::vector<node> nodes;
+    std::vector<uint32_t> refs; // primitive references in leaf order
+    aabb bounds;
+
+    void build(const std::vector<uint32_t> &subset)
+    {
+        std::vector<bvh_detail::item> items;
+        items.reserve(subset.size());
+        for (uint32_t ref : subset)
+        {
+            aabb box = primitives->bounds(ref);
+            items.push_back({box, box.center(), ref});
+        }
+
+        std::vector<bvh_detail::build_node> tree;
+        if (!items.empty())
+            bvh_detail::build(tree, items, 0, uint32_t(items.size()));
+        refs.resize(items.size());
+        for (size_t k = 0; k < items.size(); k++)
+            refs[k] = items[k].ref;
+        bounds = tree.empty() ? aabb() : tree[0].bounds;
+
+        nodes.clear();
+        if (tree.empty())
+            return;
+        if constexpr (width == 2)
+            flatten(tree, 0);
+        else
+            collapse(tree, 0);
+    }
+
+    // Writes tree node b and its subtree depth first; returns its index.
+    uint32_t flatten(const std::vector<bvh_detail::build_node> &tree, int b)
+    {
+        const auto &in = tree[size_t(b)];
+        uint32_t index = uint32_t(nodes.size());
+        nodes.emplace_back();
+        for (int a = 0; a < 3; a++)
+        {
+            nodes[index].lo[a] = bvh_detail::lower(in.bounds.axis_interval(a).min);
+            nodes[index].hi[a] = bvh_detail::upper(in.bounds.axis_interval(a).max);
+        }
+        nodes[index].count = in.count;
+        nodes[index].index = in.first;
+        if (in.count == 0)
+        {
+            flatten(tree, in.child[0]);
+            uint32_t right = flatten(tree, in.child[1]);
+            nodes[index].index = right;
+        }
+        return index;
+    }
+
+    // Makes a wide node of tree node b: its children, with the inner child of largest surface
+    // area replaced by its own two children until all width slots are used. Returns its index.
+    uint32_t collapse(const std::vector<bvh_detail::build_node> &tree, int b)
+    {
+        std::vector<int> slots;
+        if (tree[size_t(b)].count > 0)
+            slots.push_back(b);
+        else
+            slots = {tree[size_t(b)].child[0], tree[size_t(b)].child[1]};
+        while (int(slots.size()) < width)
+        {
+            int widest = -1;
+            for (int s = 0; s < int(slots.size()); s++)
+                if (tree[size_t(slots[s])].count == 0 &&
+                    (widest < 0 || bvh_detail::area(tree[size_t(slots[s])].bounds) >
+                                       bvh_detail::area(tree[size_t(slots[widest])].bounds)))
+                    widest = s;
+            if (widest < 0)
+                break;
+            const auto &open = tree[size_t(slots[widest])];
+            slots[widest] = open.child[0];
+            slots.push_back(open.child[1]);
+        }
+
+        uint32_t index = uint32_t(nodes.size());
+        nodes.emplace_back();
+        node n = {};
+        n.children = uint8_t(slots.size());
+        const aabb &parent = tree[size_t(b)].bounds;
+        for (int a = 0; a < 3; a++)
+        {
+            const interval &range = parent.axis_interval(a);
+            n.origin[a] = bvh_detail::lower(range.min);
+            // Smallest power of two step that spans the box in 255 steps.
+            int e = int(std::ceil(std::log2(std::fmax((range.max - n.origin[a]) / 255, 1e-30))));
+            n.exponent[a] = int8_t(std::clamp(e, -100, 100));
+        }
+        for (int s = 0; s < int(slots.size()); s++)
+        {
+            const auto &child = tree[size_t(slots[s])];
+            for (int a = 0; a < 3; a++)
+            {
+                float step = bvh_detail::power_of_two(n.exponent[a]);
+                const interval &range = child.bounds.axis_interval(a);
+                int qlo = std::clamp(int(std::floor((range.min - n.origin[a]) / step)), 0, 255);
+                int qhi = std::clamp(int(std::ceil((range.max - n.origin[a]) / step)), 0, 255);
+                while (qlo > 0 && n.origin[a] + qlo * step > range.min)
+                    qlo--;
+                while (qhi < 255 && n.origin[a] + qhi * step < range.max)
+                    qhi++;
+                n.lo[a][s] = uint8_t(qlo);
+                n.hi[a][s] = uint8_t(qhi);
+            }
+            n.count[s] = uint8_t(child.count);
+            n.index[s] = child.first;
+        }
+        for (int s = 0; s < int(slots.size()); s++)
+            if (tree[size_t(slots[s])].count == 0)
+                n.index[s] = collapse(tree, slots[s]);
+        nodes[index] = n;
+        return index;
+    }
+
+    // With any, returns at the first hit.
+    template <bool any>
+    bool hit_leaf(uint32_t first, uint32_t count, const ray &r, interval ray_t, double &closest, hit_record &rec) const
+    {
+        bool hit_anything = false;
+        for (uint32_t k = first; k < first + count; k++)
+        {
+            if (primitives->hit(refs[k], r, interval(ray_t.min, closest), rec))
+            {
+                if constexpr (any)
+                    return true;
+                hit_anything = true;
+                closest = rec.t;
+            }
+        }
+        return hit_anything;
+    }
+
+    // Entry distance of ray s into the box [lo, hi] within [t0, t1], or infinity on a miss.
+    static float enter(const bvh_detail::ray_setup &s, const float lo[3], const float hi[3], float t0, float t1)
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            float near = (lo[a] - s.origin[a]) * s.inverse[a];
+            float far = (hi[a] - s.origin[a]) * s.inverse[a];
+            t0 = std::max(t0, std::min(near, far));
+            t1 = std::min(t1, std::max(near, far) * bvh_detail::far_scale);
+        }
+        return t0 <= t1 ? t0 : FLT_MAX;
+    }
+
+    template <bool any>
+    bool hit_binary(const ray &r, interval ray_t, hit_record &rec) const
+    {
+        bvh_detail::ray_setup s(r);
+        float t0 = float(ray_t.min);
+        double closest = ray_t.max;
+        if (enter(s, nodes[0].lo, nodes[0].hi, t0, float(std::fmin(closest, FLT_MAX))) == FLT_MAX)
+            return false;
+
+        bool hit_anything = false;
+        struct entry
+        {
+            uint32_t node;
+            float t;
+        } stack[128];
+        int top = 0;
+        stack[top++] = {0, t0};
+        while (top > 0)
+        {
+            entry e = stack[--top];
+            if (e.t > closest)
+                continue;
+            const bvh_binary_node &n = nodes[e.node];
+            if (n.count > 0)
+            {
+                hit_anything |= hit_leaf<any>(n.index, n.count, r, ray_t, closest, rec);
+                if (any && hit_anything)
+                    return true;
+                continue;
+            }
+            float t1 = float(std::fmin(closest, FLT_MAX));
+            uint32_t left = e.node + 1, right = n.index;
+            float tl = enter(s, nodes[left].lo, nodes[left].hi, t0, t1);
+            float tr = enter(s, nodes[right].lo, nodes[right].hi, t0, t1);
+            if (tl > tr)
+            {
+                std::swap(tl, tr);
+                std::swap(left, right);
+            }
+            if (tr != FLT_MAX)
+                stack[top++] = {right, tr};
+            if (tl != FLT_MAX)
+                stack[top++] = {left, tl};
+        }
+        return hit_anything;
+    }
+
+    template <bool any>
+    bool hit_wide(const ray &r, interval ray_t, hit_record &rec) const
+    {
+        bvh_detail::ray_setup s(r);
+        float t0 = float(ray_t.min);
+        double closest = ray_t.max;
+
+        bool hit_anything = false;
+        struct entry
+        {
+            uint32_t node;
+            float t;
+        } stack[128 * width];
+        int top = 0;
+        stack[top++] = {0, t0};
+        while (top > 0)
+        {
+            entry e = stack[--top];
+            if (e.t > closest)
+                continue;
+            const node &n = nodes[e.node];
+
+            // All children in one go: box planes are origin + q * step, so each slab distance
+            // is a multiply-add of the quantized plane.
+            float base[3], scale[3];
+            for (int a = 0; a < 3; a++)
+            {
+                base[a] = (n.origin[a] - s.origin[a]) * s.inverse[a];
+                scale[a] = bvh_detail::power_of_two(n.exponent[a]) * s.inverse[a];
+            }
+            float t1 = float(std::fmin(closest, FLT_MAX));
+            float tnear[width], tfar[width];
+            #pragma omp simd
+            for (int c = 0; c < width; c++)
+            {
+                float x0 = base[0] + n.lo[0][c] * scale[0], x1 = base[0] + n.hi[0][c] * scale[0];
+                float y0 = base[1] + n.lo[1][c] * scale[1], y1 = base[1] + n.hi[1][c] * scale[1];
+                float z0 = base[2] + n.lo[2][c] * scale[2], z1 = base[2] + n.hi[2][c] * scale[2];
+                float near = std::max(std::max(std::min(x0, x1), std::min(y0, y1)), std::max(std::min(z0, z1), t0));
+                float far = std::min(std::min(std::max(x0, x1), std::max(y0, y1)), std::max(z0, z1)) * bvh_detail::far_scale;
+                tnear[c] = near;
+                tfar[c] = std::min(far, t1);
+            }
+
+            // Children hit, nearest first.
+            int order[width], hits = 0;
+            for (int c = 0; c < n.children; c++)
+            {
+                if (tnear[c] > tfar[c])
+                    continue;
+                int k = hits++;
+                while (k > 0 && tnear[order[k - 1]] > tnear[c])
+                {
+                    order[k] = order[k - 1];
+                    k--;
+                }
+                order[k] = c;
+            }
+
+            // Leaves are tested right away, which may cull the inner children behind them;
+            // inner children are pushed far to near.
+            for (int k = 0; k < hits; k++)
+            {
+                int c = order[k];
+                if (n.count[c] > 0 && tnear[c] <= closest)
+                    hit_anything |= hit_leaf<any>(n.index[c], n.count[c], r, ray_t, closest, rec);
+            }
+            if (any && hit_anything)
+                return true;
+            for (int k = hits - 1; k >= 0; k--)
+            {
+                int c = order[k];
+                if (n.count[c] == 0 && tnear[c] <= closest)
+                    stack[top++] = {n.index[c], tnear[c]};
+            }
+        }
+        return hit_anything;
+    }
+};
+
+#endif
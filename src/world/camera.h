@@ -3,8 +3,24 @@
 
 #include "../objects/hittable.h"
 #include "../materials/material.h"
+#include "../textures/environment.h"
+#include "../utils/render_progress.h"
+#include "../utils/render_stats.h"
+#include "../utils/task_scheduler.h"
+#include "../utils/trace.h"
+#include "dependency_map.h"
+#include "hittable_list.h"
+#include "irradiance_cache.h"
+#include "path_guide.h"
+#include "photon_map.h"
+#include "rasterizer.h"
 
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <omp.h>
+#include <string>
+#include <type_traits>
 #include <vector>
 
 class camera
@@ -24,47 +40,401 @@ public:
     double defocus_angle = 0;
     double focus_dist = 10;
 
-    void render(const hittable &world)
+    // Every pixel reseeds the random generator from (seed, pixel), so a frame is identical for
+    // a given seed regardless of thread count or scheduling.
+    uint64_t seed = 1;
+
+    // When set, frames are rendered in tiles on this work-stealing scheduler instead of with
+    // OpenMP. Each tile's pixels are allocated by the worker that renders it, so with pinned
+    // workers the framebuffer pages end up on the rendering thread's NUMA node.
+    shared_ptr<task_scheduler> scheduler;
+    int tile_size = 16;
+
+    // Light arriving from outside the scene. Without one the background is the default sky
+    // gradient. With one, diffuse hits also sample the map directly (unless light_sampling is
+    // off) and combine those samples with scatter() by multiple importance sampling.
+    shared_ptr<environment_map> environment;
+    bool light_sampling = true;
+
+    // When set, the first diffuse hit of each camera path (possibly seen through mirrors or
+    // glass) is shaded from cached irradiance instead of continuing the path.
+    shared_ptr<irradiance_cache> irradiance;
+
+    // When set (and filled by build_caustics), light that reaches the first diffuse hit of a
+    // camera path through mirrors or glass is estimated from these photons, and path tracing
+    // stops counting it.
+    shared_ptr<photon_map> caustics;
+
+    // When set, render_frame first spends part of the sample budget on training passes that
+    // teach the guide where light comes from, then samples diffuse bounces from a mix of the
+    // guide and the material.
+    shared_ptr<path_guide> guide;
+
+    // Screen-space error, in pixels, that cylinders and cones tessellated through update_lod
+    // may show; 0 leaves their tessellation fixed.
+    double lod_error = 0;
+
+    // When set, render_frame of a hittable_list records which objects and parts of the scene
+    // each tile's paths touched, and rerender_frame uses that to redo only the tiles an edit
+    // can change. Not recorded with an irradiance cache, caustics or a guide, whose shared
+    // state lets every pixel depend on every object.
+    shared_ptr<dependency_map> dependencies;
+
+    // When set, render_frame and rerender_frame count pixels, samples and rays as they are
+    // traced and report them while rendering.
+    shared_ptr<render_progress> progress;
+
+    // When set, camera rays of pinhole frames with the path or direct integrator are not traced
+    // through the world: each tile first rasterizes the scene's triangles into a visibility
+    // buffer of its samples, and paths continue from the hits found there. The scene must hold
+    // the world's geometry; only what it has outside triangles is traced for the first hit.
+    shared_ptr<raster_scene> raster;
+
+    // What each camera sample computes. path is the full path tracer; the others are cheap
+    // previews of the same camera and scene for framing shots:
+    //
+    //   normals            the first hit's surface normal, mapped to [0, 1]
+    //   eye_light          gray shading by the cosine between the view ray and the surface, as
+    //                      if lit from the eye
+    //   depth              distance to the first hit, white at the eye and black from
+    //                      depth_range on
+    //   ambient_occlusion  the fraction of ao_samples cosine-distributed rays from the first hit
+    //                      that travel ao_distance without hitting anything
+    //   direct             the path tracer stopped after one bounce
+    //
+    // Rays that hit nothing show the sky, except in depth and normals, where they are black.
+    enum integrator_kind
     {
-        initialize();
+        integrator_path,
+        integrator_normals,
+        integrator_eye_light,
+        integrator_depth,
+        integrator_ambient_occlusion,
+        integrator_direct
+    };
+    integrator_kind integrator = integrator_path;
+    double depth_range = 10;
+    double ao_distance = 1;
+    int ao_samples = 4;
 
-        std::cout << "P3\n"
-                  << image_width << ' ' << image_height << "\n255\n";
+    // Integrator for a name as given on the command line: path, normals, eye-light, depth, ao or
+    // direct. Returns false for an unknown name.
+    static bool integrator_named(const std::string &name, integrator_kind &kind)
+    {
+        const char *names[] = {"path", "normals", "eye-light", "depth", "ao", "direct"};
+        for (int k = 0; k < 6; k++)
+        {
+            if (name == names[k])
+            {
+                kind = integrator_kind(k);
+                return true;
+            }
+        }
+        return false;
+    }
 
-        // Pre-allocate storage for all pixel colors
-        std::vector<std::vector<color>> pixels(image_height, std::vector<color>(image_width));
+    // world is a hittable (the authoring form) or a flat_scene; anything with matching hit()
+    // and scatter() members works.
+    template <typename world_t>
+    void render(const world_t &world)
+    {
+        render(world, std::cout);
+    }
 
-        #pragma omp parallel for collapse(2) schedule(dynamic)
-        for (int j = 0; j < image_height; j++)
+    template <typename world_t>
+    void render(const world_t &world, std::ostream &out)
+    {
+        std::vector<color> pixels = render_frame(world);
+        trace::scope scope("write image");
+        write_image(out, pixels);
+        std::clog << "Done.\n";
+    }
+
+    // Traces every pixel of the frame and returns the colors in row-major order. If cancel is
+    // set while rendering, the remaining pixels are skipped and left black.
+    template <typename world_t>
+    std::vector<color> render_frame(const world_t &world, const std::atomic<bool> *cancel = nullptr)
+    {
+        trace::scope frame_scope("render frame");
+        std::vector<color> pixels = start_frame();
+        if (progress)
+            progress->start(uint64_t(pixels.size()) * frame_passes(), uint64_t(pixels.size()) * samples_per_pixel);
+        if constexpr (std::is_same_v<world_t, hittable_list>)
         {
-            for (int i = 0; i < image_width; i++)
+            if (dependencies && !irradiance && !caustics && !guide)
             {
-                color pixel_color(0, 0, 0);
-                for (int sample = 0; sample < samples_per_pixel; sample++)
-                {
-                    ray r = get_ray(i, j);
-                    pixel_color += ray_color(r, max_depth, world);
-                }
-                pixels[j][i] = pixel_samples_scale * pixel_color;
+                dependencies->reset(tiles_x(), tiles_y(), tile_extent(), world.bounding_box());
+                tracking = true;
             }
         }
 
+        if (!guide || integrator != integrator_path)
+        {
+            render_pass(world, pixels, cancel);
+            if (progress)
+                progress->finish();
+            return pixels;
+        }
+
+        // Training passes are unbiased too, so they are kept, weighted by their sample counts.
+        std::vector<color> training = train_guide(world, pixels, cancel);
+        render_pass(world, pixels, cancel);
+        for (size_t k = 0; k < pixels.size(); k++)
+            pixels[k] = (training[k] + double(pass_samples) * pixels[k]) / samples_per_pixel;
+        if (progress)
+            progress->finish();
+        return pixels;
+    }
+
+    // Updates previous, a frame rendered by render_frame with dependencies, after the objects
+    // at the indices in changed were replaced in world (or appended to it). Only tiles whose
+    // paths hit one of them before, or passed through where they are now, are traced again;
+    // with the same camera and seed the result is the frame render_frame would now produce.
+    // Renders the whole frame when the dependencies do not match this camera.
+    std::vector<color> rerender_frame(const hittable_list &world, std::vector<color> previous,
+                                      const std::vector<size_t> &changed, const std::atomic<bool> *cancel = nullptr)
+    {
+        trace::scope frame_scope("rerender frame");
+        initialize();
+        if (!dependencies || irradiance || caustics || guide || previous.size() != size_t(image_width) * image_height ||
+            !dependencies->matches(tiles_x(), tiles_y(), tile_extent()))
+        {
+            rerendered_tiles = tiles_x() * tiles_y();
+            return render_frame(world, cancel);
+        }
+
+        std::vector<aabb> bounds;
+        for (size_t k : changed)
+            if (k < world.objects.size())
+                bounds.push_back(world.objects[k]->bounding_box());
+        std::vector<int> dirty = dependencies->affected(changed, bounds);
+        rerendered_tiles = int(dirty.size());
+        tracking = true;
+        if (progress)
+        {
+            uint64_t dirty_pixels = 0;
+            for (int t : dirty)
+                dirty_pixels += uint64_t(tile_pixels(t));
+            progress->start(dirty_pixels, dirty_pixels * samples_per_pixel);
+        }
+
+        auto render_tile = [&](int n, auto flags) {
+            dependencies->clear(dirty[size_t(n)]);
+            trace_tile<decltype(flags)::value>(dirty[size_t(n)], world, previous, cancel);
+        };
+        with_kernel(world, [&](auto flags) {
+            if (scheduler)
+                scheduler->parallel_for(int(dirty.size()), [&](int n, int) { render_tile(n, flags); });
+            else
+            {
+                #pragma omp parallel for schedule(dynamic)
+                for (int n = 0; n < int(dirty.size()); n++)
+                    render_tile(n, flags);
+            }
+        });
+        if (progress)
+            progress->finish();
+        return previous;
+    }
+
+    // Tiles traced by the last rerender_frame call.
+    int last_rerendered_tiles() const { return rerendered_tiles; }
+
+    // Building blocks for renderers that schedule the tiles of several frames together (see
+    // render_views). start_frame() prepares a frame as render_frame does and returns its
+    // pixels, still black; render_tile() then traces tile t of them, for t below tile_count(),
+    // and may run concurrently for different tiles. Frames that train a guide need
+    // render_frame.
+    std::vector<color> start_frame()
+    {
+        initialize();
+        std::vector<color> pixels(size_t(image_width) * image_height);
+        RT_STAT(pixel_time_ns.assign(pixels.size(), 0.0));
+        RT_STAT(pixel_tests.assign(pixels.size(), 0.0));
+        return pixels;
+    }
+
+    int tile_count() const { return tiles_x() * tiles_y(); }
+
+    // Pixels in tile t, fewer than tile_size squared along the right and bottom edges.
+    int tile_pixels(int t) const
+    {
+        int size = tile_extent();
+        return std::min(size, image_width - (t % tiles_x()) * size) * std::min(size, image_height - (t / tiles_x()) * size);
+    }
+
+    template <typename world_t>
+    void render_tile(int t, const world_t &world, std::vector<color> &pixels, const std::atomic<bool> *cancel = nullptr)
+    {
+        with_kernel(world, [&](auto flags) { trace_tile<decltype(flags)::value>(t, world, pixels, cancel); });
+    }
+
+    // Writes a frame produced by render_frame as a plain PPM image.
+    void write_image(std::ostream &out, const std::vector<color> &pixels) const
+    {
+        out << "P3\n"
+            << image_width << ' ' << image_height << "\n255\n";
+
         // Write pixels to output (single-threaded)
         for (int j = 0; j < image_height; j++)
         {
             for (int i = 0; i < image_width; i++)
             {
-                write_color(std::cout, pixels[j][i]);
+                write_color(out, pixels[size_t(j) * image_width + i]);
             }
-            std::clog << "\rScanlines remaining: " << (image_height - j - 1) << ' ' << std::flush;
         }
+    }
+
+    int height() const { return image_height; }
+
+    // Building blocks for renderers that keep their own per-pixel accumulation (see
+    // preview_renderer). prepare() must be called after changing any public setting.
+    void prepare() { initialize(); }
+
+    // One jittered path sample for pixel (i, j), drawn from the calling thread's generator.
+    template <typename world_t>
+    color trace_sample(int i, int j, const world_t &world) const
+    {
+        color sample;
+        uint64_t rays = 0;
+        with_kernel(world, [&](auto flags) {
+            constexpr unsigned kernel_flags = decltype(flags)::value;
+            sample = integrate<kernel_flags>(get_ray<kernel_flags>(i, j), world, rays);
+        });
+        return sample;
+    }
+
+    // First surface seen through the center of pixel (i, j), ignoring defocus blur. diffuse is
+    // set when that surface scatters from a density, i.e. looks the same from every direction
+    // as far as reuse across views is concerned.
+    template <typename world_t>
+    bool first_hit(int i, int j, const world_t &world, hit_record &rec, bool &diffuse) const
+    {
+        point3 pixel_center = pixel00_loc + i * pixel_delta_u + j * pixel_delta_v;
+        ray r(center, pixel_center - center);
+        if (!world.hit(r, interval(0.001, infinity), rec))
+            return false;
+        diffuse = scatter_pdf(world, r, rec, rec.normal) > 0;
+        return true;
+    }
 
-        std::clog << "\rDone.                 \n";
+    // Continuous pixel coordinates of world point p (pixel centers are at integers). Returns
+    // false for points behind the camera.
+    bool project(const point3 &p, double &x, double &y) const
+    {
+        vec3 d = p - center;
+        double depth = -dot(d, w);
+        if (depth <= 0)
+            return false;
+        vec3 on_plane = center + d * (focus_dist / depth) - pixel00_loc;
+        x = dot(on_plane, pixel_delta_u) / pixel_delta_u.length_squared();
+        y = dot(on_plane, pixel_delta_v) / pixel_delta_v.length_squared();
+        return true;
     }
 
+    // Fills caustics by tracing photons from the sky (the environment map, or the default
+    // gradient) into world. Photons are aimed at the bounding sphere of the specular objects, so
+    // every sky ray that can reach a mirror or glass surface is covered; the ones that arrive at
+    // a diffuse surface after at least one specular bounce are stored. Photons are traced in
+    // fixed-size batches, in parallel, and whole batches are kept until the map's capacity is
+    // reached, which keeps the estimate unbiased and the result independent of thread count.
+    void build_caustics(const hittable &world)
+    {
+        trace::scope scope("photon pass");
+        std::vector<photon> stored;
+        uint64_t emitted = 0;
+        aabb target = world.specular_bounds();
+        if (caustics && !target.is_empty())
+        {
+            aabb scene = world.bounding_box();
+            point3 focus = target.center();
+            double radius = 0.5 * target.extent().length();
+            double distance = (scene.center() - focus).length() + 0.5 * scene.extent().length() + radius;
+
+            const int batch = 1024;
+            size_t capacity = caustics->capacity();
+            uint64_t limit = 32 * uint64_t(std::max<size_t>(capacity, batch));
+            int batches_per_round = 4 * omp_get_max_threads();
+            uint64_t next_batch = 0;
+            bool full = false;
+            while (!full && emitted < limit)
+            {
+                std::vector<std::vector<photon>> found(batches_per_round);
+                #pragma omp parallel for schedule(dynamic)
+                for (int b = 0; b < batches_per_round; b++)
+                {
+                    seed_random(splitmix64(seed ^ ((next_batch + b) * 0x9E3779B97F4A7C15ull)));
+                    for (int k = 0; k < batch; k++)
+                        trace_photon(world, focus, radius, distance, found[b]);
+                }
+                next_batch += batches_per_round;
+
+                for (auto &photons : found)
+                {
+                    if (stored.size() + photons.size() > capacity)
+                    {
+                        full = true;
+                        break;
+                    }
+                    stored.insert(stored.end(), photons.begin(), photons.end());
+                    emitted += batch;
+                }
+            }
+
+            // Each photon carried the flux of one sample; spread it over all emitted.
+            float scale = emitted > 0 ? float(1.0 / double(emitted)) : 0.0f;
+            for (auto &ph : stored)
+                for (float &c : ph.power)
+                    c *= scale;
+        }
+        if (caustics)
+            caustics->assign(std::move(stored), emitted);
+    }
+
+    // The current view, for hittable::update_lod.
+    lod_view lod() const
+    {
+        int height = std::max(1, int(image_width / aspect_ratio));
+        lod_view view;
+        view.eye = lookfrom;
+        view.pixels_per_unit = height / (2 * std::tan(degrees_to_radians(vfov) / 2));
+        view.max_error = lod_error;
+        return view;
+    }
+
+#ifdef RAYTRACER_STATS
+    // Per-pixel cost of the last render_frame call, row-major: wall time in nanoseconds and
+    // number of primitive intersection tests.
+    const std::vector<double> &last_pixel_times() const { return pixel_time_ns; }
+    const std::vector<double> &last_pixel_tests() const { return pixel_tests; }
+#endif
+
 private:
+    // Features the render kernels are compiled for. Every valid combination is instantiated,
+    // and initialize() picks the one the settings need, so the common pinhole, sky-lit case runs
+    // without testing for the others on every sample and bounce. The path and direct integrators
+    // share kernels, as they differ only in path_depth; the preview integrators get their own,
+    // which trace no paths.
+    static constexpr unsigned kernel_defocus = 1;        // lens samples in get_ray
+    static constexpr unsigned kernel_light_sampling = 2; // environment light samples at diffuse hits
+    static constexpr unsigned kernel_shared_state = 4;   // irradiance cache, caustics, guide or dependencies
+    static constexpr unsigned kernel_dielectrics = 8;    // set for flat_scenes holding dielectrics
+    static constexpr unsigned kernel_preview = 16;       // normals, eye-light, depth or ao integrator
+
+    // Light sampling and dielectrics only matter to path kernels.
+    static constexpr bool kernel_valid(unsigned flags)
+    {
+        return (flags & kernel_preview) == 0 || (flags & (kernel_light_sampling | kernel_dielectrics)) == 0;
+    }
+
     int image_height;
+    unsigned kernel = 0;
+    int path_depth;
     double pixel_samples_scale;
+    int pass_samples;
+    uint64_t pass_seed;
+    bool tracking = false;
+    int rerendered_tiles = 0;
     point3 center;
     point3 pixel00_loc;
     vec3 pixel_delta_u;
@@ -72,12 +442,25 @@ private:
     vec3 u, v, w;
     vec3 defocus_disk_u;
     vec3 defocus_disk_v;
+#ifdef RAYTRACER_STATS
+    std::vector<double> pixel_time_ns;
+    std::vector<double> pixel_tests;
+#endif
 
     void initialize()
     {
         image_height = int(image_width / aspect_ratio);
         image_height = (image_height < 1) ? 1 : image_height;
+        pass_samples = samples_per_pixel;
         pixel_samples_scale = 1.0 / samples_per_pixel;
+        pass_seed = seed;
+        tracking = false;
+        bool preview = integrator != integrator_path && integrator != integrator_direct;
+        kernel = (defocus_angle > 0 ? kernel_defocus : 0) |
+                 (!preview && environment && light_sampling ? kernel_light_sampling : 0) |
+                 (irradiance || caustics || guide || dependencies ? kernel_shared_state : 0) |
+                 (preview ? kernel_preview : 0);
+        path_depth = integrator == integrator_direct ? std::min(max_depth, 2) : max_depth;
 
         center = lookfrom;
 
@@ -109,37 +492,711 @@ private:
         defocus_disk_v = v * defocus_radius;
     }
 
-    color ray_color(const ray &r, int depth, const hittable &world) const
+    // Renders pass_samples samples into every pixel of pixels, with the kernel initialize()
+    // picked.
+    template <typename world_t>
+    void render_pass(const world_t &world, std::vector<color> &pixels, const std::atomic<bool> *cancel)
+    {
+        with_kernel(world, [&](auto flags) { render_pass<decltype(flags)::value>(world, pixels, cancel); });
+    }
+
+    template <unsigned flags, typename world_t>
+    void render_pass(const world_t &world, std::vector<color> &pixels, const std::atomic<bool> *cancel)
+    {
+        if constexpr (std::is_base_of_v<hittable, world_t> && (flags & (kernel_defocus | kernel_preview)) == 0)
+        {
+            if (raster)
+            {
+                render_rasterized<flags>(world, pixels, cancel);
+                return;
+            }
+        }
+        if (scheduler)
+        {
+            render_tiles<flags>(world, pixels, cancel);
+            return;
+        }
+
+        // Rows are the unit of dynamic scheduling, which keeps per-row trace events cheap.
+        #pragma omp parallel for schedule(dynamic)
+        for (int j = 0; j < image_height; j++)
+        {
+            trace::scope row_scope("row", j);
+            for (int i = 0; i < image_width; i++)
+            {
+                if (cancel && cancel->load(std::memory_order_relaxed))
+                    continue;
+                pixels[size_t(j) * image_width + i] = render_pixel<flags>(i, j, world);
+            }
+        }
+    }
+
+    // Renders a pass whose camera rays start from raster's visibility buffer, tile by tile.
+    template <unsigned flags, typename world_t>
+    void render_rasterized(const world_t &world, std::vector<color> &pixels, const std::atomic<bool> *cancel)
+    {
+        raster_frame frame(*raster, raster_view{center, w, focus_dist, pixel00_loc, pixel_delta_u, pixel_delta_v,
+                                                image_width, image_height, tile_extent()});
+        uint64_t jitter_seed = splitmix64(pass_seed);
+        auto render = [&](int t) {
+            trace::scope tile_scope("tile", t);
+            static thread_local std::vector<visibility_sample> samples;
+            frame.rasterize(t, pass_samples, jitter_seed, samples);
+            int size = tile_extent();
+            int x0 = (t % tiles_x()) * size, y0 = (t / tiles_x()) * size;
+            int w = std::min(size, image_width - x0), h = std::min(size, image_height - y0);
+            for (int y = 0; y < h; y++)
+                for (int x = 0; x < w; x++)
+                {
+                    if (cancel && cancel->load(std::memory_order_relaxed))
+                        continue;
+                    const visibility_sample *visible = &samples[(size_t(y) * w + x) * pass_samples];
+                    pixels[size_t(y0 + y) * image_width + x0 + x] = render_pixel<flags>(x0 + x, y0 + y, world, visible);
+                }
+        };
+
+        if (scheduler)
+        {
+            scheduler->parallel_for(frame.tile_count(), [&](int t, int) { render(t); });
+            return;
+        }
+        #pragma omp parallel for schedule(dynamic)
+        for (int t = 0; t < frame.tile_count(); t++)
+            render(t);
+    }
+
+    // Passes render_frame makes over every pixel: the guide's training passes (see train_guide),
+    // then the frame's own.
+    int frame_passes() const
+    {
+        if (!guide || integrator != integrator_path)
+            return 1;
+        int budget = int(samples_per_pixel * guide->training_fraction);
+        int spent = 0, passes = 1;
+        for (int n = 1; spent + n <= budget && spent + n < samples_per_pixel; n *= 2)
+        {
+            spent += n;
+            passes++;
+        }
+        return passes;
+    }
+
+    // Renders the guide's training passes, of 1, 2, 4, ... samples per pixel within its share of
+    // the budget, updating the guide after each, and leaves the remaining samples to the frame.
+    // Returns the sum of the training samples of each pixel.
+    template <typename world_t>
+    std::vector<color> train_guide(const world_t &world, std::vector<color> &pixels, const std::atomic<bool> *cancel)
+    {
+        std::vector<color> sum(pixels.size(), color(0, 0, 0));
+        int budget = int(samples_per_pixel * guide->training_fraction);
+        int spent = 0;
+        guide->learning = true;
+        for (int n = 1; spent + n <= budget && spent + n < samples_per_pixel; n *= 2)
+        {
+            trace::scope scope("guide pass", n);
+            pass_samples = n;
+            pixel_samples_scale = 1.0 / n;
+            pass_seed = splitmix64(seed ^ uint64_t(n));
+            render_pass(world, pixels, cancel);
+            guide->update(n);
+            for (size_t k = 0; k < pixels.size(); k++)
+                sum[k] += double(n) * pixels[k];
+            spent += n;
+        }
+        guide->learning = false;
+        pass_samples = samples_per_pixel - spent;
+        pixel_samples_scale = 1.0 / pass_samples;
+        pass_seed = seed;
+        return sum;
+    }
+
+    // Calls f with std::integral_constant<unsigned, flags>, for the flags of the kernel picked
+    // by initialize() and those of world.
+    template <typename world_t, typename function_t>
+    void with_kernel(const world_t &world, function_t &&f) const
+    {
+        const unsigned camera_flags = kernel_defocus | kernel_light_sampling | kernel_shared_state | kernel_preview;
+        if constexpr (std::is_base_of_v<hittable, world_t>)
+            dispatch<camera_flags>(kernel, f);
+        else
+        {
+            bool dielectrics = (kernel & kernel_preview) == 0 && world.has_dielectrics();
+            dispatch<camera_flags | kernel_dielectrics>(kernel | (dielectrics ? kernel_dielectrics : 0), f);
+        }
+    }
+
+    template <unsigned mask, unsigned flags = 0, typename function_t>
+    static void dispatch(unsigned kernel, function_t &f)
+    {
+        if constexpr (flags <= mask)
+        {
+            if constexpr ((flags & ~mask) == 0 && kernel_valid(flags))
+            {
+                if (kernel == flags)
+                {
+                    f(std::integral_constant<unsigned, flags>());
+                    return;
+                }
+            }
+            dispatch<mask, flags + 1>(kernel, f);
+        }
+    }
+
+    // Renders tile t (tile_extent() pixels square, row-major over the image) into pixels.
+    template <unsigned flags, typename world_t>
+    void trace_tile(int t, const world_t &world, std::vector<color> &pixels, const std::atomic<bool> *cancel)
+    {
+        trace::scope tile_scope("tile", t);
+        int size = tile_extent();
+        int x0 = (t % tiles_x()) * size, y0 = (t / tiles_x()) * size;
+        int w = std::min(size, image_width - x0), h = std::min(size, image_height - y0);
+        for (int y = 0; y < h; y++)
+            for (int x = 0; x < w; x++)
+            {
+                if (cancel && cancel->load(std::memory_order_relaxed))
+                    continue;
+                pixels[size_t(y0 + y) * image_width + x0 + x] = render_pixel<flags>(x0 + x, y0 + y, world);
+            }
+    }
+
+    int tile_extent() const { return tile_size < 1 ? 16 : tile_size; }
+    int tiles_x() const { return (image_width + tile_extent() - 1) / tile_extent(); }
+    int tiles_y() const { return (image_height + tile_extent() - 1) / tile_extent(); }
+
+    // Records, while dependencies are tracked, that r was traced up to its hit rec (or to
+    // infinity when hit is false).
+    void track(const ray &r, bool hit, const hit_record &rec) const
+    {
+        if (!tracking)
+            return;
+        dependencies->pass(r, 0.001, hit ? rec.t : infinity);
+        if (hit)
+            dependencies->touch(rec.object);
+    }
+
+    // Renders pass_samples samples of pixel (i, j); with visible, their camera rays are those of
+    // the pixel's visibility samples.
+    template <unsigned flags, typename world_t>
+    color render_pixel(int i, int j, const world_t &world, const visibility_sample *visible = nullptr)
+    {
+#ifdef RAYTRACER_STATS
+        auto pixel_start = std::chrono::steady_clock::now();
+        auto tests_before = local_stats().total_tests();
+#endif
+
+        seed_random(pass_seed * 0x100000001B3ull + uint64_t(j) * uint64_t(image_width) + uint64_t(i));
+        constexpr bool shared_state = flags & kernel_shared_state;
+        if (shared_state && tracking)
+            dependencies->begin_pixel();
+        color pixel_color(0, 0, 0);
+        uint64_t rays = 0;
+        for (int sample = 0; sample < pass_samples; sample++)
+        {
+            if (visible)
+            {
+                pixel_color += integrate_visible<flags>(i, j, visible[sample], world, rays);
+                continue;
+            }
+            ray r = get_ray<flags>(i, j);
+            pixel_color += integrate<flags>(r, world, rays);
+        }
+        if (shared_state && tracking)
+            dependencies->end_pixel((j / tile_extent()) * tiles_x() + i / tile_extent());
+        if (progress)
+            progress->pixel_done(pass_samples, rays);
+
+#ifdef RAYTRACER_STATS
+        auto &stats = local_stats();
+        size_t index = size_t(j) * image_width + i;
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - pixel_start).count();
+        stats.pixels++;
+        stats.pixel_time_ns += uint64_t(ns);
+        pixel_time_ns[index] = ns;
+        pixel_tests[index] = double(stats.total_tests() - tests_before);
+#endif
+
+        return pixel_samples_scale * pixel_color;
+    }
+
+    template <unsigned flags, typename world_t>
+    void render_tiles(const world_t &world, std::vector<color> &pixels, const std::atomic<bool> *cancel)
+    {
+        int size = tile_extent();
+        int tiles_x = this->tiles_x();
+        int tiles_y = this->tiles_y();
+        std::vector<std::unique_ptr<color[]>> tiles(size_t(tiles_x) * tiles_y);
+
+        scheduler->parallel_for(tiles_x * tiles_y, [&](int t, int) {
+            trace::scope tile_scope("tile", t);
+            int x0 = (t % tiles_x) * size, y0 = (t / tiles_x) * size;
+            int w = std::min(size, image_width - x0), h = std::min(size, image_height - y0);
+
+            // Allocated and first touched here, on the worker that renders the tile.
+            std::unique_ptr<color[]> tile(new color[size_t(w) * h]);
+            for (int y = 0; y < h; y++)
+            {
+                for (int x = 0; x < w; x++)
+                {
+                    if (cancel && cancel->load(std::memory_order_relaxed))
+                        continue;
+                    tile[size_t(y) * w + x] = render_pixel<flags>(x0 + x, y0 + y, world);
+                }
+            }
+            tiles[t] = std::move(tile);
+        });
+
+        for (int t = 0; t < tiles_x * tiles_y; t++)
+        {
+            int x0 = (t % tiles_x) * size, y0 = (t / tiles_x) * size;
+            int w = std::min(size, image_width - x0), h = std::min(size, image_height - y0);
+            for (int y = 0; y < h; y++)
+                std::copy(&tiles[t][size_t(y) * w], &tiles[t][size_t(y) * w] + w, &pixels[size_t(y0 + y) * image_width + x0]);
+        }
+    }
+
+    template <unsigned flags = kernel_dielectrics, typename world_t>
+    static bool scatter(const world_t &world, const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered)
+    {
+        if constexpr (std::is_base_of_v<hittable, world_t>)
+            return rec.mat->scatter(r_in, rec, attenuation, scattered);
+        else
+            return world.template scatter<(flags & kernel_dielectrics) != 0>(r_in, rec, attenuation, scattered);
+    }
+
+    template <typename world_t>
+    static double scatter_pdf(const world_t &world, const ray &r_in, const hit_record &rec, const vec3 &wi)
+    {
+        if constexpr (std::is_base_of_v<hittable, world_t>)
+            return rec.mat->scatter_pdf(r_in, rec, wi);
+        else
+            return world.scatter_pdf(r_in, rec, wi);
+    }
+
+    template <typename world_t>
+    static color eval_scatter(const world_t &world, const ray &r_in, const hit_record &rec, const vec3 &wi)
+    {
+        if constexpr (std::is_base_of_v<hittable, world_t>)
+            return rec.mat->eval_scatter(r_in, rec, wi);
+        else
+            return world.eval_scatter(r_in, rec, wi);
+    }
+
+    // Radiance arriving from direction dir when nothing is hit.
+    color sky(const vec3 &dir) const
+    {
+        if (environment)
+            return environment->value(dir);
+        vec3 unit_direction = unit_vector(dir);
+        auto a = 0.5 * (unit_direction.y() + 1.0);
+        return (1.0 - a) * color(1.0, 1.0, 1.0) + a * color(0.5, 0.7, 1.0);
+    }
+
+    // Traces one photon from the sky toward the sphere (focus, radius), starting distance away,
+    // and appends it to out if it lands on a diffuse surface after a specular bounce.
+    void trace_photon(const hittable &world, const point3 &focus, double radius, double distance,
+                      std::vector<photon> &out) const
+    {
+        // Direction the light comes from, and its density.
+        vec3 from;
+        double pdf;
+        if (environment)
+            from = environment->sample(pdf);
+        else
+        {
+            from = random_unit_vector();
+            pdf = 1 / (4 * pi);
+        }
+        if (pdf <= 0)
+            return;
+
+        // Uniform point on the disc facing from that covers the sphere.
+        vec3 t1 = unit_vector(cross(std::fabs(from.x()) > 0.9 ? vec3(0, 1, 0) : vec3(1, 0, 0), from));
+        vec3 t2 = cross(from, t1);
+        vec3 disc = random_in_unit_disk();
+        point3 origin = focus + distance * from + radius * (disc.x() * t1 + disc.y() * t2);
+
+        // Flux through the disc per emitted photon.
+        color power = sky(from) * (pi * radius * radius / pdf);
+        ray r(origin, -from);
+        bool through_specular = false;
+        for (int bounce = 0; bounce < caustics->max_bounces; bounce++)
+        {
+            hit_record rec;
+            if (!world.hit(r, interval(0.001, infinity), rec))
+                return;
+            if (scatter_pdf(world, r, rec, rec.normal) > 0)
+            {
+                if (!through_specular)
+                    return;
+                photon ph;
+                for (int a = 0; a < 3; a++)
+                {
+                    ph.position[a] = float(rec.p[a]);
+                    ph.power[a] = float(power[a]);
+                }
+                ph.set_direction(r.direction());
+                ph.axis = 0;
+                out.push_back(ph);
+                return;
+            }
+
+            ray scattered;
+            color attenuation;
+            if (!scatter(world, r, rec, attenuation, scattered))
+                return;
+            power = power * attenuation;
+            if (power.near_zero())
+                return;
+            through_specular = true;
+            r = scattered;
+        }
+    }
+
+    // Radiance along camera ray r, by the selected integrator. Adds the rays traced to rays.
+    template <unsigned flags, typename world_t>
+    color integrate(const ray &r, const world_t &world, uint64_t &rays) const
     {
+        if constexpr ((flags & kernel_preview) != 0)
+        {
+            return preview_color(r, world, rays);
+        }
+        else
+        {
+            path_state state;
+            state.rays = &rays;
+            return ray_color<flags>(r, path_depth, world, state);
+        }
+    }
+
+    // Radiance along the camera ray of visibility sample s of pixel (i, j), whose first hit comes
+    // from raster, by the path or direct integrator. Adds the rays traced to rays.
+    template <unsigned flags, typename world_t>
+    color integrate_visible(int i, int j, const visibility_sample &s, const world_t &world, uint64_t &rays) const
+    {
+        auto pixel_sample = pixel00_loc + ((i + double(s.x)) * pixel_delta_u) + ((j + double(s.y)) * pixel_delta_v);
+        ray r(center, pixel_sample - center, 0, pixel_delta_u.length() / focus_dist);
+        int depth = path_depth;
+        path_state state;
+        state.rays = &rays;
         if (depth <= 0)
+            return ray_color<flags>(r, depth, world, state);
+
+        RT_STAT(depth == path_depth ? local_stats().primary_rays++ : local_stats().secondary_rays++);
+        rays++;
+        hit_record rec;
+        bool hit;
+        if (!raster->hit(r, s, rec, hit))
+            hit = world.hit(r, interval(0.001, infinity), rec);
+        if constexpr ((flags & kernel_shared_state) != 0)
+            track(r, hit, rec);
+        return shade<flags>(r, hit, rec, depth, world, state);
+    }
+
+    // Radiance along camera ray r for the preview integrators other than direct. Adds the rays
+    // traced to rays.
+    template <typename world_t>
+    color preview_color(const ray &r, const world_t &world, uint64_t &rays) const
+    {
+        RT_STAT(local_stats().primary_rays++);
+        rays++;
+        hit_record rec;
+        if (!world.hit(r, interval(0.001, infinity), rec))
+            return integrator == integrator_depth || integrator == integrator_normals ? color(0, 0, 0) : sky(r.direction());
+
+        switch (integrator)
+        {
+        case integrator_normals:
+            return 0.5 * (rec.normal + color(1, 1, 1));
+        case integrator_eye_light:
+        {
+            double c = std::fabs(dot(rec.normal, unit_vector(r.direction())));
+            return color(c, c, c);
+        }
+        case integrator_depth:
+        {
+            double d = std::fmax(0, 1 - rec.t * r.direction().length() / depth_range);
+            return color(d, d, d);
+        }
+        default:
+        {
+            int open = 0;
+            for (int k = 0; k < ao_samples; k++)
+            {
+                vec3 direction = rec.normal + random_unit_vector();
+                if (direction.near_zero())
+                    direction = rec.normal;
+                RT_STAT(local_stats().secondary_rays++);
+                rays++;
+                hit_record occluder;
+                ray probe(rec.p, direction);
+                if (!world.hit(probe, interval(0.001, ao_distance / direction.length()), occluder))
+                    open++;
+            }
+            double a = ao_samples > 0 ? double(open) / ao_samples : 1;
+            return color(a, a, a);
+        }
+        }
+    }
+
+    // Power heuristic weight for a sample drawn with density pdf_a, competing with pdf_b.
+    static double mis_weight(double pdf_a, double pdf_b)
+    {
+        return pdf_a * pdf_a / (pdf_a * pdf_a + pdf_b * pdf_b);
+    }
+
+    // Density of scattering toward wi at the diffuse hit rec: the material's, or its mix with the
+    // guide's when cell guides this hit.
+    template <typename world_t>
+    double sampling_pdf(const world_t &world, const ray &r_in, const hit_record &rec, const vec3 &wi,
+                        const direction_tree *cell) const
+    {
+        double material_pdf = scatter_pdf(world, r_in, rec, wi);
+        if (!cell)
+            return material_pdf;
+        return guide->bsdf_fraction * material_pdf + (1 - guide->bsdf_fraction) * cell->pdf(unit_vector(wi));
+    }
+
+    // One light sample of the environment at the non-specular hit rec. Adds the shadow ray to
+    // rays.
+    template <typename world_t>
+    color sample_environment(const ray &r_in, const hit_record &rec, const world_t &world, uint64_t &rays,
+                             const direction_tree *cell = nullptr) const
+    {
+        double light_pdf;
+        vec3 wi = environment->sample(light_pdf);
+        if (light_pdf <= 0)
             return color(0, 0, 0);
+        color f = eval_scatter(world, r_in, rec, wi);
+        if (f.near_zero())
+            return color(0, 0, 0);
+
+        RT_STAT(local_stats().secondary_rays++);
+        rays++;
+        hit_record occluder;
+        ray shadow(rec.p, wi);
+        bool blocked = world.hit(shadow, interval(0.001, infinity), occluder);
+        track(shadow, blocked, occluder);
+        if (blocked)
+            return color(0, 0, 0);
+
+        double weight = mis_weight(light_pdf, sampling_pdf(world, r_in, rec, wi, cell));
+        return f * environment->value(wi) * (weight / light_pdf);
+    }
+
+    // What ray_color needs to know about the path so far.
+    struct path_state
+    {
+        // Density with which the ray was scattered by a non-specular material when the
+        // environment is light sampled, and 0 otherwise.
+        double scatter_pdf = 0;
+
+        // Set once the path has left a diffuse surface, after which the irradiance cache no
+        // longer applies.
+        bool after_diffuse = false;
+
+        // With a caustic map: 0 before the first diffuse hit, 1 after it, 2 once a specular
+        // bounce followed it (the sky seen from there was counted by the photons) and 3 after a
+        // second diffuse hit.
+        int caustic = 0;
+
+        // Where the rays of the sample are counted, for progress reports. Counting into the
+        // pixel's own total, added once per pixel, keeps the count off shared and thread-local
+        // memory on every ray.
+        uint64_t *rays = nullptr;
+    };
+
+    // Caustic light at the first diffuse hit rec, and the state of the path continuing from it.
+    template <typename world_t>
+    color caustic_light(const ray &r, const hit_record &rec, const world_t &world, path_state &next) const
+    {
+        if (!caustics || next.caustic != 0)
+        {
+            if (next.caustic == 1 || next.caustic == 2)
+                next.caustic = 3;
+            return color(0, 0, 0);
+        }
+        next.caustic = 1;
+        return eval_scatter(world, r, rec, rec.normal) * caustics->irradiance(rec.p, rec.normal);
+    }
+
+    // Shades the diffuse hit rec from the irradiance cache, gathering a new record there if no
+    // cached one is close enough.
+    template <unsigned flags, typename world_t>
+    color cached_diffuse(const ray &r, const hit_record &rec, int depth, const world_t &world, path_state state) const
+    {
+        if (irradiance->show_records && irradiance->near_record(rec.p, 1.5 * r.footprint(rec.t)))
+            return color(1, 0, 0);
+
+        // f * cos at the normal is albedo / pi for a lambertian surface.
+        color albedo = pi * eval_scatter(world, r, rec, rec.normal);
+        path_state gather_state;
+        gather_state.after_diffuse = true;
+        gather_state.rays = state.rays;
+        gather_state.caustic = state.caustic;
+        color caustic = caustic_light(r, rec, world, gather_state);
+        color e;
+        if (!irradiance->lookup(rec.p, rec.normal, e))
+        {
+            int M = irradiance->theta_samples, N = 4 * M;
+            vec3 t1 = unit_vector(cross(std::fabs(rec.normal.x()) > 0.9 ? vec3(0, 1, 0) : vec3(1, 0, 0), rec.normal));
+            vec3 t2 = cross(rec.normal, t1);
+
+            std::vector<color> radiance(size_t(M) * N);
+            std::vector<double> distance(radiance.size()), theta(radiance.size());
+            for (int j = 0; j < M; j++)
+            {
+                for (int k = 0; k < N; k++)
+                {
+                    size_t at = size_t(j) * N + k;
+                    theta[at] = std::asin(std::sqrt((j + random_double()) / M));
+                    double phi = 2 * pi * (k + random_double()) / N;
+                    vec3 dir = std::sin(theta[at]) * (std::cos(phi) * t1 + std::sin(phi) * t2) + std::cos(theta[at]) * rec.normal;
+
+                    // Each gather ray is traced once, for both its distance and its radiance.
+                    ray gather(rec.p, dir, r.footprint(rec.t), r.cone_spread());
+                    RT_STAT(local_stats().secondary_rays++);
+                    (*state.rays)++;
+                    hit_record seen;
+                    bool hit = world.hit(gather, interval(0.001, infinity), seen);
+                    track(gather, hit, seen);
+                    distance[at] = hit ? seen.t : infinity;
+                    if (depth > 1)
+                        radiance[at] = shade<flags>(gather, hit, seen, depth - 1, world, gather_state);
+                    else
+                    {
+                        RT_STAT(local_stats().record_path(path_depth));
+                        radiance[at] = color(0, 0, 0);
+                    }
+                }
+            }
+            auto record = irradiance->make_record(rec.p, rec.normal, t1, t2, radiance, distance, theta);
+            irradiance->insert(record);
+            e = record.irradiance;
+        }
+        return albedo * e / pi + caustic;
+    }
+
+    // One path sample. Code for features not in flags is compiled out; with none of them a
+    // bounce is just the hit, scatter() and the recursion.
+    template <unsigned flags, typename world_t>
+    color ray_color(const ray &r, int depth, const world_t &world, path_state state) const
+    {
+        constexpr bool shared_state = flags & kernel_shared_state;
+        if (depth <= 0)
+        {
+            RT_STAT(local_stats().record_path(path_depth));
+            return color(0, 0, 0);
+        }
+        RT_STAT(depth == path_depth ? local_stats().primary_rays++ : local_stats().secondary_rays++);
+        (*state.rays)++;
         hit_record rec;
 
         // world
-        if (world.hit(r, interval(0.001, infinity), rec))
+        bool hit = world.hit(r, interval(0.001, infinity), rec);
+        if constexpr (shared_state)
+            track(r, hit, rec);
+        return shade<flags>(r, hit, rec, depth, world, state);
+    }
+
+    // The rest of a path sample once ray r's first hit is known: rec, when hit is set.
+    template <unsigned flags, typename world_t>
+    color shade(const ray &r, bool hit, const hit_record &rec, int depth, const world_t &world, path_state state) const
+    {
+        constexpr bool light_sampled = flags & kernel_light_sampling;
+        constexpr bool shared_state = flags & kernel_shared_state;
+        if (hit)
         {
+            // Only light sampling and the shared-state integrators care whether the hit is
+            // diffuse.
+            bool diffuse = (light_sampled || shared_state) && scatter_pdf(world, r, rec, rec.normal) > 0;
+            if (shared_state && irradiance && !state.after_diffuse && diffuse)
+            {
+                RT_STAT(local_stats().record_path(path_depth - depth));
+                return cached_diffuse<flags>(r, rec, depth, world, state);
+            }
+
             ray scattered;
             color attenuation;
-            if (rec.mat->scatter(r, rec, attenuation, scattered))
-                return attenuation * ray_color(scattered, depth - 1, world);
+            if (scatter<flags>(world, r, rec, attenuation, scattered))
+            {
+                // With a trained guide cell here, diffuse bounces pick the material's direction
+                // or one drawn from the guide, and are weighted by the density of the mix.
+                direction_tree *cell = shared_state && guide && diffuse ? &guide->at(rec.p, rec.normal) : nullptr;
+                const direction_tree *guiding = cell && cell->trained() ? cell : nullptr;
+                double pdf = 0;
+                if (guiding)
+                {
+                    vec3 wi = random_double() < guide->bsdf_fraction ? scattered.direction() : guiding->sample();
+                    pdf = sampling_pdf(world, r, rec, wi, guiding);
+                    attenuation = pdf > 0 ? eval_scatter(world, r, rec, wi) / pdf : color(0, 0, 0);
+                    scattered = ray(rec.p, wi);
+                }
+                else if (diffuse)
+                    pdf = scatter_pdf(world, r, rec, scattered.direction());
+
+                // Carry the ray cone on so textures seen in reflections are filtered too.
+                scattered = ray(scattered.origin(), scattered.direction(), r.footprint(rec.t), r.cone_spread());
+
+                path_state next = state;
+                next.scatter_pdf = 0;
+                color direct(0, 0, 0);
+                if constexpr (shared_state)
+                {
+                    if (diffuse)
+                        direct += caustic_light(r, rec, world, next);
+                    else if (next.caustic == 1)
+                        next.caustic = 2;
+                }
+                if (light_sampled && pdf > 0)
+                {
+                    next.scatter_pdf = pdf;
+                    direct += sample_environment(r, rec, world, *state.rays, guiding);
+                }
+
+                // Guided directions below the surface carry nothing and are not traced.
+                if (attenuation.near_zero())
+                    return direct;
+                color incoming = ray_color<flags>(scattered, depth - 1, world, next);
+                if (shared_state && cell && guide->learning && pdf > 0)
+                {
+                    double value = (incoming.x() + incoming.y() + incoming.z()) / (3 * pdf);
+                    cell->record(unit_vector(scattered.direction()), float(value));
+                }
+                return direct + attenuation * incoming;
+            }
+            RT_STAT(local_stats().record_path(path_depth - depth));
             return color(0, 0, 0);
         }
 
-        // background
-        vec3 unit_direction = unit_vector(r.direction());
-        auto a = 0.5 * (unit_direction.y() + 1.0);
-        return (1.0 - a) * color(1.0, 1.0, 1.0) + a * color(0.5, 0.7, 1.0);
+        RT_STAT(local_stats().record_path(path_depth - depth));
+
+        if (shared_state && state.caustic == 2)
+            return color(0, 0, 0);
+
+        // Hits of the environment by a ray that could also have been light sampled share the
+        // estimate with the light sample.
+        color radiance = sky(r.direction());
+        if (light_sampled && state.scatter_pdf > 0)
+            radiance *= mis_weight(state.scatter_pdf, environment->pdf(unit_vector(r.direction())));
+        return radiance;
     }
 
+    template <unsigned flags>
     ray get_ray(int i, int j) const
     {
         auto offset = sample_square();
         auto pixel_sample = pixel00_loc + ((i + offset.x()) * pixel_delta_u) + ((j + offset.y()) * pixel_delta_v);
 
-        auto ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample();
+        point3 ray_origin;
+        if constexpr ((flags & kernel_defocus) != 0)
+            ray_origin = defocus_disk_sample();
+        else
+            ray_origin = center;
         auto ray_direction = pixel_sample - ray_origin;
 
-        return ray(ray_origin, ray_direction);
+        // The cone starts as wide as the lens sample and spreads by one pixel per unit of
+        // distance along the focus plane.
+        return ray(ray_origin, ray_direction, 0, pixel_delta_u.length() / focus_dist);
     }
 
     vec3 sample_square() const
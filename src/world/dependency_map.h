@@ -0,0 +1,224 @@
+#ifndef DEPENDENCY_MAP_H
+#define DEPENDENCY_MAP_H
+
+#include "../utils/aabb.h"
+#include "../utils/common.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// What each tile of a frame depended on, so that after an edit only the tiles the edit can
+// change are rendered again. Per tile it keeps two bit sets, ORed together over every ray of
+// every sample of the tile's pixels:
+//
+//   objects  the top-level objects the rays hit, one bit per object index below object_bits;
+//            higher indices share the bits as a Bloom filter with two hashes, which can only
+//            add false positives
+//   cells    the cells of a grid over the scene bounds the rays passed through on the way to
+//            their hit, plus one for leaving the grid, so an object moved into the paths of a
+//            tile that never saw it is caught by its new bounds
+//
+// Recording goes to a per-thread scratch set for the pixel being rendered, which is merged into
+// its tile with atomic ORs, so rows of one tile may be rendered by different threads.
+class dependency_map
+{
+public:
+    static constexpr int object_bits = 1024;
+    static constexpr int grid_resolution = 8;
+
+    // Starts a frame of tiles_x * tiles_y tiles of tile_size pixels, over a scene within bounds.
+    void reset(int tiles_x, int tiles_y, int tile_size, const aabb &bounds)
+    {
+        this->tiles_x = tiles_x;
+        this->tiles_y = tiles_y;
+        this->tile_size = tile_size;
+        size_t words = size_t(tiles_x) * tiles_y * tile_words;
+        sets.reset(new std::atomic<uint64_t>[words]);
+        for (size_t k = 0; k < words; k++)
+            sets[k].store(0, std::memory_order_relaxed);
+
+        point3 c = bounds.is_empty() ? point3(0, 0, 0) : bounds.center();
+        vec3 e = bounds.is_empty() ? vec3(1, 1, 1) : bounds.extent();
+        double pad = 1e-3 * std::fmax(e.x(), std::fmax(e.y(), e.z())) + 1e-6;
+        for (int a = 0; a < 3; a++)
+        {
+            lo[a] = c[a] - 0.5 * e[a] - pad;
+            cell_size[a] = (e[a] + 2 * pad) / grid_resolution;
+        }
+    }
+
+    // Whether the map was filled for a frame with this tiling.
+    bool matches(int tiles_x, int tiles_y, int tile_size) const
+    {
+        return sets && this->tiles_x == tiles_x && this->tiles_y == tiles_y && this->tile_size == tile_size;
+    }
+
+    int tiles() const { return tiles_x * tiles_y; }
+    size_t bytes() const { return size_t(tiles()) * tile_words * sizeof(uint64_t); }
+
+    // Forgets what tile t depended on, before it is rendered again.
+    void clear(int t)
+    {
+        for (int k = 0; k < tile_words; k++)
+            sets[size_t(t) * tile_words + k].store(0, std::memory_order_relaxed);
+    }
+
+    // Recording for one pixel, on the rendering thread: begin_pixel(), then touch() and pass()
+    // for its rays, then end_pixel() with the pixel's tile.
+    void begin_pixel() const
+    {
+        std::fill(scratch(), scratch() + tile_words, 0);
+    }
+
+    void touch(int object) const
+    {
+        if (object < 0)
+            return;
+        int b0, b1;
+        object_bit(object, b0, b1);
+        scratch()[b0 / 64] |= uint64_t(1) << (b0 % 64);
+        scratch()[b1 / 64] |= uint64_t(1) << (b1 % 64);
+    }
+
+    // Marks the cells ray r passes through for t in [t_min, t_max].
+    void pass(const ray &r, double t_min, double t_max) const
+    {
+        const point3 &o = r.origin();
+        const vec3 &d = r.direction();
+        double t0 = t_min, t1 = t_max;
+        uint64_t *cells = scratch() + object_words;
+        for (int a = 0; a < 3; a++)
+        {
+            double hi = lo[a] + grid_resolution * cell_size[a];
+            if (d[a] == 0)
+            {
+                if (o[a] < lo[a] || o[a] > hi)
+                    t1 = -infinity;
+                continue;
+            }
+            double ta = (lo[a] - o[a]) / d[a], tb = (hi - o[a]) / d[a];
+            t0 = std::fmax(t0, std::fmin(ta, tb));
+            t1 = std::fmin(t1, std::fmax(ta, tb));
+        }
+        if (t0 > t_min || t1 < t_max || t0 > t1)
+            cells[outside / 64] |= uint64_t(1) << (outside % 64);
+        if (t0 > t1)
+            return;
+
+        // Walk the cells along the clipped segment (Amanatides and Woo).
+        point3 p = r.at(t0);
+        int cell[3], step[3];
+        double next[3], delta[3];
+        for (int a = 0; a < 3; a++)
+        {
+            cell[a] = std::clamp(int((p[a] - lo[a]) / cell_size[a]), 0, grid_resolution - 1);
+            step[a] = d[a] > 0 ? 1 : d[a] < 0 ? -1 : 0;
+            double boundary = lo[a] + (cell[a] + (step[a] > 0 ? 1 : 0)) * cell_size[a];
+            next[a] = step[a] != 0 ? t0 + (boundary - p[a]) / d[a] : infinity;
+            delta[a] = step[a] != 0 ? cell_size[a] / std::fabs(d[a]) : infinity;
+        }
+        while (true)
+        {
+            int index = (cell[2] * grid_resolution + cell[1]) * grid_resolution + cell[0];
+            cells[index / 64] |= uint64_t(1) << (index % 64);
+            int a = next[0] < next[1] ? (next[0] < next[2] ? 0 : 2) : (next[1] < next[2] ? 1 : 2);
+            if (next[a] > t1)
+                break;
+            cell[a] += step[a];
+            if (cell[a] < 0 || cell[a] >= grid_resolution)
+                break;
+            next[a] += delta[a];
+        }
+    }
+
+    void end_pixel(int t) const
+    {
+        const uint64_t *bits = scratch();
+        for (int k = 0; k < tile_words; k++)
+            if (bits[k])
+                sets[size_t(t) * tile_words + k].fetch_or(bits[k], std::memory_order_relaxed);
+    }
+
+    // Tiles whose rays hit one of the objects at the indices in changed, or passed through one
+    // of bounds (the edited objects' new bounds).
+    std::vector<int> affected(const std::vector<size_t> &changed, const std::vector<aabb> &bounds) const
+    {
+        // Cells of the new bounds, laid out like a tile's set.
+        uint64_t query[tile_words] = {};
+        for (const aabb &box : bounds)
+        {
+            if (box.is_empty())
+                continue;
+            int from[3], to[3];
+            for (int a = 0; a < 3; a++)
+            {
+                const interval &range = box.axis_interval(a);
+                if (range.min < lo[a] || range.max > lo[a] + grid_resolution * cell_size[a])
+                    query[object_words + outside / 64] |= uint64_t(1) << (outside % 64);
+                from[a] = std::clamp(int(std::floor((range.min - lo[a]) / cell_size[a])), 0, grid_resolution - 1);
+                to[a] = std::clamp(int(std::floor((range.max - lo[a]) / cell_size[a])), 0, grid_resolution - 1);
+            }
+            for (int z = from[2]; z <= to[2]; z++)
+                for (int y = from[1]; y <= to[1]; y++)
+                    for (int x = from[0]; x <= to[0]; x++)
+                    {
+                        int index = (z * grid_resolution + y) * grid_resolution + x;
+                        query[object_words + index / 64] |= uint64_t(1) << (index % 64);
+                    }
+        }
+
+        std::vector<int> result;
+        for (int t = 0; t < tiles(); t++)
+        {
+            const std::atomic<uint64_t> *set = &sets[size_t(t) * tile_words];
+            bool hit = false;
+            for (size_t object : changed)
+            {
+                int b0, b1;
+                object_bit(int(object), b0, b1);
+                if ((set[b0 / 64].load(std::memory_order_relaxed) >> (b0 % 64) & 1) &&
+                    (set[b1 / 64].load(std::memory_order_relaxed) >> (b1 % 64) & 1))
+                    hit = true;
+            }
+            for (int k = object_words; k < tile_words && !hit; k++)
+                hit = (set[k].load(std::memory_order_relaxed) & query[k]) != 0;
+            if (hit)
+                result.push_back(t);
+        }
+        return result;
+    }
+
+private:
+    static constexpr int object_words = object_bits / 64;
+    static constexpr int outside = grid_resolution * grid_resolution * grid_resolution; // cell bit for leaving the grid
+    static constexpr int cell_words = outside / 64 + 1;
+    static constexpr int tile_words = object_words + cell_words;
+
+    int tiles_x = 0, tiles_y = 0, tile_size = 0;
+    std::unique_ptr<std::atomic<uint64_t>[]> sets; // tile_words per tile
+    double lo[3] = {0, 0, 0};
+    double cell_size[3] = {1, 1, 1};
+
+    static uint64_t *scratch()
+    {
+        static thread_local uint64_t bits[tile_words];
+        return bits;
+    }
+
+    static void object_bit(int object, int &b0, int &b1)
+    {
+        if (object < object_bits)
+        {
+            b0 = b1 = object;
+            return;
+        }
+        uint64_t h = splitmix64(uint64_t(object));
+        b0 = int(h % object_bits);
+        b1 = int((h >> 32) % object_bits);
+    }
+};
+
+#endif
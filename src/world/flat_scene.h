@@ -0,0 +1,204 @@
+#ifndef FLAT_SCENE_H
+#define FLAT_SCENE_H
+
+#include "../utils/common.h"
+#include "hittable_list.h"
+
+#include "../objects/cone.h"
+#include "../objects/cube.h"
+#include "../objects/cylinder.h"
+#include "../objects/plane.h"
+#include "../objects/sphere.h"
+#include "../objects/triangle.h"
+
+#include "../materials/dielectric.h"
+#include "../materials/lambertian.h"
+#include "../materials/metal.h"
+
+#include <map>
+#include <variant>
+#include <vector>
+
+// Closed-world form of a scene for rendering. Scenes are still authored with hittable and
+// material objects; the constructor flattens them into arrays grouped by concrete type
+// (composite primitives become their triangles) and copies materials into a variant. The
+// intersection loops then call the final classes directly and scatter dispatches with
+// std::visit, so the hot path has no virtual calls and no shared_ptr copies.
+//
+// Objects of any other hittable type are kept in a fallback list and go through the usual
+// virtual calls.
+class flat_scene
+{
+public:
+    using material_variant = std::variant<lambertian, metal, dielectric>;
+
+    std::vector<sphere> spheres;
+    std::vector<int> sphere_materials;
+    std::vector<triangle> triangles;
+    std::vector<int> triangle_materials;
+    std::vector<material_variant> materials;
+    hittable_list others;
+
+    flat_scene() {}
+
+    explicit flat_scene(const hittable_list &world)
+    {
+        add(world);
+    }
+
+    void add(const hittable_list &world)
+    {
+        for (const auto &object : world.objects)
+            add(object);
+    }
+
+    bool hit(const ray &r, interval ray_t, hit_record &rec) const
+    {
+        bool hit_anything = false;
+        auto closest_so_far = ray_t.max;
+
+        for (size_t k = 0; k < spheres.size(); k++)
+        {
+            if (spheres[k].hit_surface(r, interval(ray_t.min, closest_so_far), rec))
+            {
+                hit_anything = true;
+                closest_so_far = rec.t;
+                rec.material_id = sphere_materials[k];
+            }
+        }
+
+        for (size_t k = 0; k < triangles.size(); k++)
+        {
+            if (triangles[k].hit_surface(r, interval(ray_t.min, closest_so_far), rec))
+            {
+                hit_anything = true;
+                closest_so_far = rec.t;
+                rec.material_id = triangle_materials[k];
+            }
+        }
+
+        if (!others.objects.empty() && others.hit(r, interval(ray_t.min, closest_so_far), rec))
+        {
+            hit_anything = true;
+            rec.material_id = -1;
+        }
+
+        return hit_anything;
+    }
+
+    // With dielectrics false the scene must hold none (see has_dielectrics), and the variant is
+    // dispatched with a single branch between the other two types.
+    template <bool dielectrics = true>
+    bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered) const
+    {
+        if (rec.material_id < 0)
+            return rec.mat && rec.mat->scatter(r_in, rec, attenuation, scattered);
+
+        const material_variant &m = materials[size_t(rec.material_id)];
+        if constexpr (!dielectrics)
+        {
+            if (auto l = std::get_if<lambertian>(&m))
+                return l->scatter(r_in, rec, attenuation, scattered);
+            return std::get_if<metal>(&m)->scatter(r_in, rec, attenuation, scattered);
+        }
+        else
+            return std::visit([&](const auto &v) { return v.scatter(r_in, rec, attenuation, scattered); }, m);
+    }
+
+    // Tracked as materials are added, so kernel selection costs nothing per call.
+    bool has_dielectrics() const { return dielectrics; }
+
+    double scatter_pdf(const ray &r_in, const hit_record &rec, const vec3 &wi) const
+    {
+        if (rec.material_id < 0)
+            return rec.mat ? rec.mat->scatter_pdf(r_in, rec, wi) : 0;
+
+        return std::visit([&](const auto &m) { return m.scatter_pdf(r_in, rec, wi); },
+                          materials[size_t(rec.material_id)]);
+    }
+
+    color eval_scatter(const ray &r_in, const hit_record &rec, const vec3 &wi) const
+    {
+        if (rec.material_id < 0)
+            return rec.mat ? rec.mat->eval_scatter(r_in, rec, wi) : color(0, 0, 0);
+
+        return std::visit([&](const auto &m) { return m.eval_scatter(r_in, rec, wi); },
+                          materials[size_t(rec.material_id)]);
+    }
+
+private:
+    std::map<const material *, int> material_ids;
+    bool dielectrics = false;
+
+    // Returns the variant index for mat, or -1 if it is not one of the closed material types.
+    int material_id(const shared_ptr<material> &mat)
+    {
+        auto it = material_ids.find(mat.get());
+        if (it != material_ids.end())
+            return it->second;
+
+        int id = -1;
+        if (auto m = dynamic_cast<const lambertian *>(mat.get()))
+            id = push_material(*m);
+        else if (auto m = dynamic_cast<const metal *>(mat.get()))
+            id = push_material(*m);
+        else if (auto m = dynamic_cast<const dielectric *>(mat.get()))
+            id = push_material(*m);
+        material_ids[mat.get()] = id;
+        return id;
+    }
+
+    int push_material(const material_variant &m)
+    {
+        dielectrics = dielectrics || std::holds_alternative<dielectric>(m);
+        materials.push_back(m);
+        return int(materials.size()) - 1;
+    }
+
+    void add_triangle(const triangle &tri, const shared_ptr<hittable> &owner)
+    {
+        int id = material_id(tri.material_ptr());
+        if (id < 0)
+        {
+            others.add(owner);
+            return;
+        }
+        triangles.push_back(tri);
+        triangle_materials.push_back(id);
+    }
+
+    template <typename mesh_t>
+    bool add_mesh(const shared_ptr<hittable> &object)
+    {
+        auto mesh = std::dynamic_pointer_cast<mesh_t>(object);
+        if (!mesh)
+            return false;
+        for (const auto &tri : mesh->triangles())
+            add_triangle(*tri, tri);
+        return true;
+    }
+
+    void add(const shared_ptr<hittable> &object)
+    {
+        if (auto s = std::dynamic_pointer_cast<sphere>(object))
+        {
+            int id = material_id(s->material_ptr());
+            if (id < 0)
+                others.add(object);
+            else
+            {
+                spheres.push_back(*s);
+                sphere_materials.push_back(id);
+            }
+        }
+        else if (auto t = std::dynamic_pointer_cast<triangle>(object))
+            add_triangle(*t, object);
+        else if (auto list = std::dynamic_pointer_cast<hittable_list>(object))
+            add(*list);
+        else if (!add_mesh<plane>(object) && !add_mesh<cube>(object) && !add_mesh<cylinder>(object) &&
+                 !add_mesh<cone>(object))
+            others.add(object);
+    }
+};
+
+#endif
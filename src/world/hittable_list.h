@@ -26,18 +26,43 @@ public:
         bool hit_anything = false;
         auto closest_so_far = ray_t.max;
 
-        for (const auto &object : objects)
+        for (size_t k = 0; k < objects.size(); k++)
         {
-            if (object->hit(r, interval(ray_t.min, closest_so_far), temp_rec))
+            if (objects[k]->hit(r, interval(ray_t.min, closest_so_far), temp_rec))
             {
                 hit_anything = true;
                 closest_so_far = temp_rec.t;
                 rec = temp_rec;
+                rec.object = int(k);
             }
         }
 
         return hit_anything;
     }
+
+    aabb bounding_box() const override
+    {
+        aabb box;
+        for (const auto &object : objects)
+            box = aabb(box, object->bounding_box());
+        return box;
+    }
+
+    aabb specular_bounds() const override
+    {
+        aabb box;
+        for (const auto &object : objects)
+            box = aabb(box, object->specular_bounds());
+        return box;
+    }
+
+    bool update_lod(const lod_view &view) override
+    {
+        bool changed = false;
+        for (const auto &object : objects)
+            changed = object->update_lod(view) || changed;
+        return changed;
+    }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,264 @@
+#ifndef IRRADIANCE_CACHE_H
+#define IRRADIANCE_CACHE_H
+
+#include "../utils/common.h"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+// Irradiance at one point of a diffuse surface, with the gradients used to extrapolate it to
+// nearby points and orientations (Ward & Heckbert 1992).
+struct irradiance_record
+{
+    point3 p;
+    vec3 n;
+    color irradiance;
+    double radius;          // harmonic mean distance to the surfaces seen from p, clamped
+    vec3 translational[3];  // d(irradiance)/d(position), per color channel
+    vec3 rotational[3];     // d(irradiance)/d(rotation of n), per color channel
+};
+
+// Ward-style irradiance cache. The camera gathers irradiance at sparse points of diffuse
+// surfaces and reuses it at nearby hits; records live in an octree sized by their radius of
+// influence, and the root grows to cover records placed outside it. Lookups take a shared lock
+// and inserts an exclusive one, so render threads can read and fill the cache concurrently.
+// Which points become records depends on the order threads reach them, so cached renders are
+// not bit-for-bit reproducible.
+class irradiance_cache
+{
+public:
+    // Maximum interpolation error: records are reused within accuracy * radius.
+    double accuracy = 0.25;
+    double min_spacing = 0.02;
+    double max_spacing = 2.0;
+
+    // Hemisphere strata per record: theta_samples rings of 4 * theta_samples directions.
+    int theta_samples = 8;
+
+    // When set, the camera marks record positions in red.
+    bool show_records = false;
+
+    irradiance_cache() {}
+
+    irradiance_cache(const irradiance_cache &) = delete;
+    irradiance_cache &operator=(const irradiance_cache &) = delete;
+
+    size_t size() const
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return records.size();
+    }
+
+    // Interpolates irradiance at p with normal n from the records that cover it. Returns false
+    // if there are none, in which case the caller should gather a new record.
+    bool lookup(const point3 &p, const vec3 &n, color &irradiance) const
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        if (!root)
+            return false;
+
+        double weights = 0;
+        color sum(0, 0, 0);
+        visit(*root, p, [&](const irradiance_record &r) {
+            double w = weight(r, p, n);
+            if (w <= 0)
+                return;
+            vec3 turn = cross(r.n, n), step = p - r.p;
+            color e(r.irradiance.x() + dot(turn, r.rotational[0]) + dot(step, r.translational[0]),
+                    r.irradiance.y() + dot(turn, r.rotational[1]) + dot(step, r.translational[1]),
+                    r.irradiance.z() + dot(turn, r.rotational[2]) + dot(step, r.translational[2]));
+            sum += w * e;
+            weights += w;
+        });
+        if (weights <= 0)
+            return false;
+        irradiance = sum / weights;
+        irradiance = color(std::fmax(0.0, irradiance.x()), std::fmax(0.0, irradiance.y()), std::fmax(0.0, irradiance.z()));
+        return true;
+    }
+
+    // True if a record lies within distance of p.
+    bool near_record(const point3 &p, double distance) const
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        bool found = false;
+        if (root)
+            visit(*root, p, [&](const irradiance_record &r) {
+                if ((r.p - p).length_squared() < distance * distance)
+                    found = true;
+            });
+        return found;
+    }
+
+    void insert(const irradiance_record &record)
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        double reach = accuracy * record.radius;
+        if (!root)
+            root = std::make_unique<node>(record.p, std::max(reach, max_spacing));
+        while (!root->contains(record.p))
+            grow_toward(record.p);
+
+        // Deepest node whose half size still covers the record's reach.
+        node *at = root.get();
+        while (at->half * 0.5 >= reach)
+        {
+            int octant = at->octant(record.p);
+            if (!at->children[octant])
+                at->children[octant] = std::make_unique<node>(at->child_center(octant), at->half * 0.5);
+            at = at->children[octant].get();
+        }
+        at->records.push_back(uint32_t(records.size()));
+        records.push_back(record);
+    }
+
+    // Builds a record from a stratified, cosine-weighted hemisphere gather around n. t1 and t2
+    // complete n to an orthonormal basis. radiance[j * phi + k] and distance[j * phi + k] are the
+    // radiance and hit distance (infinity for misses) of the sample in ring j, sector k, where
+    // phi = 4 * theta_samples and ring j covers sin^2(theta) in [j/M, (j+1)/M).
+    irradiance_record make_record(const point3 &p, const vec3 &n, const vec3 &t1, const vec3 &t2,
+                                  const std::vector<color> &radiance, const std::vector<double> &distance,
+                                  const std::vector<double> &theta) const
+    {
+        int M = theta_samples, N = 4 * theta_samples;
+        irradiance_record r;
+        r.p = p;
+        r.n = n;
+        r.irradiance = color(0, 0, 0);
+        for (int c = 0; c < 3; c++)
+            r.translational[c] = r.rotational[c] = vec3(0, 0, 0);
+
+        auto at = [N](int j, int k) { return size_t(j) * N + size_t((k + N) % N); };
+        auto planar = [&](double phi) { return std::cos(phi) * t1 + std::sin(phi) * t2; };
+
+        double inverse_distances = 0;
+        for (int j = 0; j < M; j++)
+            for (int k = 0; k < N; k++)
+            {
+                r.irradiance += radiance[at(j, k)];
+                inverse_distances += 1 / distance[at(j, k)];
+            }
+        r.irradiance *= pi / (M * N);
+
+        for (int k = 0; k < N; k++)
+        {
+            double phi = 2 * pi * (k + 0.5) / N;
+            double phi_minus = 2 * pi * k / N;
+            vec3 u_k = planar(phi), v_k = planar(phi + pi / 2), v_minus = planar(phi_minus + pi / 2);
+
+            // Rotational gradient.
+            color ring(0, 0, 0);
+            for (int j = 0; j < M; j++)
+                ring += -std::tan(theta[at(j, k)]) * radiance[at(j, k)];
+            for (int c = 0; c < 3; c++)
+                r.rotational[c] += v_k * (ring[c] * pi / (M * N));
+
+            // Translational gradient: changes across ring boundaries (along u_k) and across
+            // sector boundaries (along v_minus), each divided by the nearer of the two hits.
+            color across_rings(0, 0, 0), across_sectors(0, 0, 0);
+            for (int j = 1; j < M; j++)
+            {
+                double sin_minus = std::sqrt(double(j) / M);
+                double cos2_minus = 1 - double(j) / M;
+                double nearest = std::min(distance[at(j, k)], distance[at(j - 1, k)]);
+                across_rings += (sin_minus * cos2_minus / nearest) * (radiance[at(j, k)] - radiance[at(j - 1, k)]);
+            }
+            for (int j = 0; j < M; j++)
+            {
+                double sin_plus = std::sqrt(double(j + 1) / M), sin_minus = std::sqrt(double(j) / M);
+                double nearest = std::min(distance[at(j, k)], distance[at(j, k - 1)]);
+                across_sectors += ((sin_plus - sin_minus) / nearest) * (radiance[at(j, k)] - radiance[at(j, k - 1)]);
+            }
+            for (int c = 0; c < 3; c++)
+                r.translational[c] += u_k * (2 * pi / N * across_rings[c]) + v_minus * across_sectors[c];
+        }
+
+        // Harmonic mean distance, shrunk where the gradient says irradiance changes quickly.
+        double radius = inverse_distances > 0 ? (M * N) / inverse_distances : max_spacing;
+        for (int c = 0; c < 3; c++)
+        {
+            double g = r.translational[c].length();
+            if (g > 0 && r.irradiance[c] > 0)
+                radius = std::min(radius, r.irradiance[c] / g);
+        }
+        r.radius = std::clamp(radius, min_spacing, max_spacing);
+        return r;
+    }
+
+private:
+    struct node
+    {
+        point3 center;
+        double half;
+        std::vector<uint32_t> records;
+        std::unique_ptr<node> children[8];
+
+        node(const point3 &center, double half) : center(center), half(half) {}
+
+        bool contains(const point3 &p) const
+        {
+            return std::fabs(p.x() - center.x()) <= half && std::fabs(p.y() - center.y()) <= half &&
+                   std::fabs(p.z() - center.z()) <= half;
+        }
+
+        int octant(const point3 &p) const
+        {
+            return (p.x() > center.x() ? 1 : 0) | (p.y() > center.y() ? 2 : 0) | (p.z() > center.z() ? 4 : 0);
+        }
+
+        point3 child_center(int octant) const
+        {
+            double q = half * 0.5;
+            return center + vec3(octant & 1 ? q : -q, octant & 2 ? q : -q, octant & 4 ? q : -q);
+        }
+    };
+
+    mutable std::shared_mutex mutex;
+    std::vector<irradiance_record> records;
+    std::unique_ptr<node> root;
+
+    // Ward's weight, or 0 if the record should not be used at p.
+    double weight(const irradiance_record &r, const point3 &p, const vec3 &n) const
+    {
+        vec3 step = p - r.p;
+        // Skip records whose surface lies in front of p.
+        if (dot(step, 0.5 * (n + r.n)) < -0.05 * r.radius)
+            return 0;
+        double error = step.length() / r.radius + std::sqrt(std::fmax(0.0, 1 - dot(n, r.n)));
+        if (error >= accuracy)
+            return 0;
+        return error > 1e-9 ? 1 / error : 1e9;
+    }
+
+    // Calls fn on every record that can reach p. A record is stored in a node no smaller than
+    // its reach, so only nodes within twice their half size of p need to be searched.
+    template <typename fn_t>
+    void visit(const node &at, const point3 &p, fn_t &&fn) const
+    {
+        double limit = 2 * at.half;
+        if (std::fabs(p.x() - at.center.x()) > limit || std::fabs(p.y() - at.center.y()) > limit ||
+            std::fabs(p.z() - at.center.z()) > limit)
+            return;
+        for (uint32_t index : at.records)
+            fn(records[index]);
+        for (const auto &child : at.children)
+            if (child)
+                visit(*child, p, fn);
+    }
+
+    // Doubles the root so that the old root becomes the octant facing away from p.
+    void grow_toward(const point3 &p)
+    {
+        double h = root->half;
+        vec3 shift(p.x() > root->center.x() ? h : -h, p.y() > root->center.y() ? h : -h, p.z() > root->center.z() ? h : -h);
+        auto bigger = std::make_unique<node>(root->center + shift, 2 * h);
+        int octant = bigger->octant(root->center);
+        bigger->children[octant] = std::move(root);
+        root = std::move(bigger);
+    }
+};
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef LAZY_BVH_H
+#define LAZY_BVH_H
+
+#include "bvh.h"
+
+#include "../utils/trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Bounding volume hierarchy built on demand, for a short time to first pixel. Up front the
+// primitives are only split at the median of their centroids until each bucket holds at most
+// bucket_size of them, which costs little more than computing their bounds. The first ray that
+// reaches a bucket builds its subtree, a bvh<width> over the bucket's primitives; geometry no
+// ray visits is never indexed.
+//
+// hit() may be called from many render threads at once. A bucket's subtree is published with
+// an atomic pointer: traversal reads it without locking once it is built, and threads that
+// reach an unbuilt bucket together wait on the bucket's mutex while one of them builds it.
+template <int width>
+class lazy_bvh : public hittable
+{
+public:
+    explicit lazy_bvh(const hittable_list &world, size_t bucket_size = 4096)
+        : bucket_size(std::max<size_t>(bucket_size, 1)), specular(world.specular_bounds())
+    {
+        primitives.add(world);
+        for (const auto &object : world.objects)
+            lod_objects.push_back(bvh_primitives::captures(object) ? nullptr : object);
+        partition();
+    }
+
+    bool hit(const ray &r, interval ray_t, hit_record &rec) const override
+    {
+        if (nodes.empty())
+            return false;
+
+        bool hit_anything = false;
+        auto closest_so_far = ray_t.max;
+        int32_t stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const node &n = nodes[size_t(stack[--top])];
+            if (!n.bounds.hit(r, interval(ray_t.min, closest_so_far)))
+                continue;
+            if (n.bucket >= 0)
+            {
+                if (subtree(n.bucket).hit(r, interval(ray_t.min, closest_so_far), rec))
+                {
+                    hit_anything = true;
+                    closest_so_far = rec.t;
+                }
+                continue;
+            }
+
+            // Nearer child first, so far buckets are often culled before they are built.
+            const node &a = nodes[size_t(n.child[0])], &b = nodes[size_t(n.child[1])];
+            bool a_first = dot(a.bounds.center() - r.origin(), r.direction()) <=
+                           dot(b.bounds.center() - r.origin(), r.direction());
+            stack[top++] = a_first ? n.child[1] : n.child[0];
+            stack[top++] = a_first ? n.child[0] : n.child[1];
+        }
+        return hit_anything;
+    }
+
+    aabb bounding_box() const override { return nodes.empty() ? aabb() : nodes[0].bounds; }
+
+    aabb specular_bounds() const override { return specular; }
+
+    // Re-tessellates the scene and starts over from the coarse partition. Not to be called
+    // while rendering.
+    bool update_lod(const lod_view &view) override
+    {
+        bool changed = false;
+        for (const auto &object : lod_objects)
+            if (object)
+                changed = object->update_lod(view) || changed;
+        if (!changed)
+            return false;
+        bvh_primitives refreshed;
+        refreshed.add(primitives, lod_objects);
+        primitives = std::move(refreshed);
+        partition();
+        return true;
+    }
+
+    size_t primitive_count() const { return primitives.references().size(); }
+    size_t bucket_count() const { return bucket_total; }
+    size_t built_count() const { return built.load(std::memory_order_relaxed); }
+
+    // Memory of the primitive copies, the partition and the subtrees built so far.
+    size_t bytes() const
+    {
+        size_t total = primitives.bytes() + nodes.size() * sizeof(node);
+        for (size_t b = 0; b < bucket_total; b++)
+        {
+            total += buckets[b].refs.size() * sizeof(uint32_t);
+            if (const bvh<width> *tree = buckets[b].tree.load(std::memory_order_acquire))
+                total += tree->bytes();
+        }
+        return total;
+    }
+
+private:
+    struct node
+    {
+        aabb bounds;
+        int32_t child[2];
+        int32_t bucket; // -1 for inner nodes
+    };
+
+    struct bucket
+    {
+        std::vector<uint32_t> refs;
+        std::atomic<const bvh<width> *> tree{nullptr};
+        std::unique_ptr<bvh<width>> owned;
+        std::mutex building;
+    };
+
+    size_t bucket_size;
+    std::vector<shared_ptr<hittable>> lod_objects; // as in bvh
+    aabb specular;
+    bvh_primitives primitives;
+    std::vector<node> nodes;
+    std::unique_ptr<bucket[]> buckets;
+    size_t bucket_total = 0;
+    mutable std::atomic<size_t> built{0};
+
+    void partition()
+    {
+        trace::scope scope("bvh partition");
+        std::vector<bvh_detail::item> items;
+        items.reserve(primitives.references().size());
+        for (uint32_t ref : primitives.references())
+        {
+            aabb box = primitives.bounds(ref);
+            items.push_back({box, box.center(), ref});
+        }
+
+        nodes.clear();
+        std::vector<std::vector<uint32_t>> leaves;
+        if (!items.empty())
+            split(items, 0, items.size(), leaves);
+        bucket_total = leaves.size();
+        buckets.reset(new bucket[bucket_total]);
+        for (size_t b = 0; b < bucket_total; b++)
+            buckets[b].refs = std::move(leaves[b]);
+        built.store(0, std::memory_order_relaxed);
+    }
+
+    // Median split of items [begin, end) on the widest centroid axis; returns the node index.
+    int32_t split(std::vector<bvh_detail::item> &items, size_t begin, size_t end,
+                  std::vector<std::vector<uint32_t>> &leaves)
+    {
+        aabb bounds, centroids;
+        for (size_t i = begin; i < end; i++)
+        {
+            bounds = aabb(bounds, items[i].box);
+            centroids = aabb(centroids, aabb(items[i].centroid, items[i].centroid));
+        }
+        int32_t index = int32_t(nodes.size());
+        nodes.push_back({bounds, {-1, -1}, -1});
+
+        vec3 extent = centroids.extent();
+        if (end - begin <= bucket_size || extent.length_squared() == 0)
+        {
+            std::vector<uint32_t> refs;
+            refs.reserve(end - begin);
+            for (size_t i = begin; i < end; i++)
+                refs.push_back(items[i].ref);
+            nodes[size_t(index)].bucket = int32_t(leaves.size());
+            leaves.push_back(std::move(refs));
+            return index;
+        }
+
+        int axis = extent.x() >= extent.y() ? (extent.x() >= extent.z() ? 0 : 2) : (extent.y() >= extent.z() ? 1 : 2);
+        size_t mid = begin + (end - begin) / 2;
+        std::nth_element(items.begin() + begin, items.begin() + mid, items.begin() + end,
+                         [&](const bvh_detail::item &a, const bvh_detail::item &b) {
+                             return a.centroid[axis] < b.centroid[axis];
+                         });
+        int32_t left = split(items, begin, mid, leaves);
+        int32_t right = split(items, mid, end, leaves);
+        nodes[size_t(index)].child[0] = left;
+        nodes[size_t(index)].child[1] = right;
+        return index;
+    }
+
+    const bvh<width> &subtree(int32_t b) const
+    {
+        bucket &entry = buckets[size_t(b)];
+        if (const bvh<width> *tree = entry.tree.load(std::memory_order_acquire))
+            return *tree;
+
+        std::lock_guard<std::mutex> lock(entry.building);
+        const bvh<width> *tree = entry.tree.load(std::memory_order_relaxed);
+        if (!tree)
+        {
+            trace::scope scope("bvh refine", int64_t(entry.refs.size()));
+            entry.owned = std::make_unique<bvh<width>>(primitives, entry.refs);
+            tree = entry.owned.get();
+            entry.tree.store(tree, std::memory_order_release);
+            built.fetch_add(1, std::memory_order_relaxed);
+        }
+        return *tree;
+    }
+};
+
+#endif
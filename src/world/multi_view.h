@@ -0,0 +1,165 @@
+#ifndef MULTI_VIEW_H
+#define MULTI_VIEW_H
+
+#include "camera.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// One camera of a multi-view render, and the name its output is written under.
+struct view
+{
+    std::string name;
+    camera cam;
+};
+
+// Left and right eyes of cam, eye_separation apart along its horizontal axis, looking in
+// parallel.
+inline std::vector<view> stereo_views(const camera &cam, double eye_separation)
+{
+    vec3 right = unit_vector(cross(cam.lookat - cam.lookfrom, cam.vup));
+    std::vector<view> views = {{"left", cam}, {"right", cam}};
+    for (int k = 0; k < 2; k++)
+    {
+        vec3 shift = (k == 0 ? -0.5 : 0.5) * eye_separation * right;
+        views[k].cam.lookfrom += shift;
+        views[k].cam.lookat += shift;
+    }
+    return views;
+}
+
+// The six faces of a cube map around cam.lookfrom, square and cam.image_width pixels wide,
+// named px, nx, py, ny, pz and nz after the axis they face. Side faces keep +y up; the top
+// and bottom faces have +z and -z up.
+inline std::vector<view> cubemap_views(const camera &cam)
+{
+    const char *names[6] = {"px", "nx", "py", "ny", "pz", "nz"};
+    const vec3 axes[6] = {vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1)};
+    const vec3 ups[6] = {vec3(0, 1, 0), vec3(0, 1, 0), vec3(0, 0, 1), vec3(0, 0, -1), vec3(0, 1, 0), vec3(0, 1, 0)};
+    std::vector<view> views;
+    for (int f = 0; f < 6; f++)
+    {
+        view face{names[f], cam};
+        face.cam.aspect_ratio = 1;
+        face.cam.vfov = 90;
+        face.cam.defocus_angle = 0;
+        face.cam.lookat = cam.lookfrom + axes[f];
+        face.cam.vup = ups[f];
+        views.push_back(face);
+    }
+    return views;
+}
+
+// count copies of cam in a row along its horizontal axis, spacing apart and centered on it,
+// all looking the same way (a light field camera array).
+inline std::vector<view> camera_array(const camera &cam, int count, double spacing)
+{
+    vec3 right = unit_vector(cross(cam.lookat - cam.lookfrom, cam.vup));
+    std::vector<view> views;
+    for (int k = 0; k < count; k++)
+    {
+        view v{std::to_string(k), cam};
+        vec3 shift = (k - 0.5 * (count - 1)) * spacing * right;
+        v.cam.lookfrom += shift;
+        v.cam.lookat += shift;
+        views.push_back(v);
+    }
+    return views;
+}
+
+// Builds the views named by spec: "stereo[:<eye separation>]" (default 0.065),
+// "cubemap", or "array:<count>[:<spacing>]" (default spacing 0.1), all derived from cam.
+// Returns false for an unknown spec.
+inline bool make_views(const std::string &spec, const camera &cam, std::vector<view> &views)
+{
+    std::string kind = spec.substr(0, spec.find(':'));
+    std::string args = spec.size() > kind.size() ? spec.substr(kind.size() + 1) : "";
+    std::string first = args.substr(0, args.find(':'));
+    std::string second = args.size() > first.size() ? args.substr(first.size() + 1) : "";
+    if (kind == "stereo")
+        views = stereo_views(cam, first.empty() ? 0.065 : std::atof(first.c_str()));
+    else if (kind == "cubemap" && args.empty())
+        views = cubemap_views(cam);
+    else if (kind == "array" && std::atoi(first.c_str()) > 0)
+        views = camera_array(cam, std::atoi(first.c_str()), second.empty() ? 0.1 : std::atof(second.c_str()));
+    else
+        return false;
+    return true;
+}
+
+// Writes frames[k], rendered for views[k], to <prefix>_<name>.ppm. Returns false if a file
+// cannot be written.
+inline bool write_views(const std::vector<view> &views, const std::vector<std::vector<color>> &frames,
+                        const std::string &prefix)
+{
+    for (size_t v = 0; v < views.size(); v++)
+    {
+        std::ofstream out(prefix + "_" + views[v].name + ".ppm");
+        views[v].cam.write_image(out, frames[v]);
+        if (!out)
+            return false;
+    }
+    return true;
+}
+
+// Renders every view of world in one parallel pass and returns their frames, in the order of
+// views. Tiles of all views go into one work list, interleaved so that tile t of each view
+// is rendered before tile t + 1 of any: views of the same part of the scene (stereo eyes,
+// neighbours in an array) then trace it close together in time, while its geometry and
+// textures are still in cache, and no thread idles at the end of one view while another is
+// left. The first view's scheduler is used if it has one, and OpenMP otherwise, and its
+// progress, if any, reports on the whole pass. Views that train a guide are rendered
+// separately beforehand, each with render_frame.
+template <typename world_t>
+std::vector<std::vector<color>> render_views(std::vector<view> &views, const world_t &world,
+                                             const std::atomic<bool> *cancel = nullptr)
+{
+    trace::scope scope("render views");
+    std::vector<std::vector<color>> frames(views.size());
+    std::vector<std::pair<int, int>> tiles; // (tile, view)
+    int most_tiles = 0;
+    for (size_t v = 0; v < views.size(); v++)
+    {
+        if (views[v].cam.guide)
+        {
+            frames[v] = views[v].cam.render_frame(world, cancel);
+            continue;
+        }
+        frames[v] = views[v].cam.start_frame();
+        most_tiles = std::max(most_tiles, views[v].cam.tile_count());
+    }
+    uint64_t pixels = 0, samples = 0;
+    for (int t = 0; t < most_tiles; t++)
+        for (size_t v = 0; v < views.size(); v++)
+            if (!views[v].cam.guide && t < views[v].cam.tile_count())
+            {
+                tiles.push_back({t, int(v)});
+                pixels += uint64_t(views[v].cam.tile_pixels(t));
+                samples += uint64_t(views[v].cam.tile_pixels(t)) * views[v].cam.samples_per_pixel;
+            }
+    shared_ptr<render_progress> progress = views.empty() ? nullptr : views[0].cam.progress;
+    if (progress)
+        progress->start(pixels, samples);
+
+    auto render = [&](int n) {
+        auto [t, v] = tiles[size_t(n)];
+        views[size_t(v)].cam.render_tile(t, world, frames[size_t(v)], cancel);
+    };
+    if (!views.empty() && views[0].cam.scheduler)
+        views[0].cam.scheduler->parallel_for(int(tiles.size()), [&](int n, int) { render(n); });
+    else
+    {
+        #pragma omp parallel for schedule(dynamic)
+        for (int n = 0; n < int(tiles.size()); n++)
+            render(n);
+    }
+    if (progress)
+        progress->finish();
+    return frames;
+}
+
+#endif
@@ -0,0 +1,185 @@
+#ifndef OUT_OF_CORE_H
+#define OUT_OF_CORE_H
+
+#include "hittable_list.h"
+
+#include "../materials/dielectric.h"
+#include "../materials/lambertian.h"
+#include "../materials/metal.h"
+#include "../objects/cone.h"
+#include "../objects/cube.h"
+#include "../objects/cylinder.h"
+#include "../objects/plane.h"
+#include "../objects/streamed_mesh.h"
+#include "../objects/triangle.h"
+#include "../textures/image_texture.h"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Converting a scene's triangles to a geometry file once, and rendering from that file later
+// without building them in memory. A file holds every triangle of the scene (plain triangles and
+// the meshes of planes, cubes, cylinders and cones) with a table of their materials, so a
+// streamed_mesh can be opened from it alone. Other objects, such as spheres, are not stored.
+namespace out_of_core_detail
+{
+    // Calls on_triangle for every triangle of world, nested lists included, in scene order, and
+    // on_other for every object that holds none.
+    template <typename triangle_f, typename other_f>
+    void visit(const hittable_list &world, triangle_f &&on_triangle, other_f &&on_other)
+    {
+        auto add_mesh = [&](const auto &mesh) {
+            for (const auto &t : mesh->triangles())
+                on_triangle(*t);
+        };
+        std::vector<shared_ptr<hittable>> pending(world.objects.rbegin(), world.objects.rend());
+        while (!pending.empty())
+        {
+            auto object = pending.back();
+            pending.pop_back();
+            if (auto t = std::dynamic_pointer_cast<triangle>(object))
+                on_triangle(*t);
+            else if (auto list = std::dynamic_pointer_cast<hittable_list>(object))
+                pending.insert(pending.end(), list->objects.rbegin(), list->objects.rend());
+            else if (auto p = std::dynamic_pointer_cast<plane>(object))
+                add_mesh(p);
+            else if (auto c = std::dynamic_pointer_cast<cube>(object))
+                add_mesh(c);
+            else if (auto c = std::dynamic_pointer_cast<cylinder>(object))
+                add_mesh(c);
+            else if (auto c = std::dynamic_pointer_cast<cone>(object))
+                add_mesh(c);
+            else
+                on_other(object);
+        }
+    }
+
+    inline geometry_material describe(const material *mat)
+    {
+        geometry_material desc;
+        auto set_albedo = [&](const color &c) {
+            for (int a = 0; a < 3; a++)
+                desc.albedo[a] = c[a];
+        };
+        if (auto m = dynamic_cast<const lambertian *>(mat))
+        {
+            const texture *tex = m->albedo_texture().get();
+            if (auto image = dynamic_cast<const image_texture *>(tex))
+            {
+                desc.texture = image->source_path();
+                desc.parameter = image->repeat_count();
+            }
+            else if (auto solid = dynamic_cast<const solid_color *>(tex))
+                set_albedo(solid->albedo_color());
+            else if (tex)
+                return desc;
+            else
+                set_albedo(m->albedo_color());
+            desc.kind = geometry_material::lambertian;
+        }
+        else if (auto m = dynamic_cast<const metal *>(mat))
+        {
+            desc.kind = geometry_material::metal;
+            set_albedo(m->albedo_color());
+            desc.parameter = m->fuzziness();
+        }
+        else if (auto m = dynamic_cast<const dielectric *>(mat))
+        {
+            desc.kind = geometry_material::dielectric;
+            desc.parameter = m->index();
+        }
+        return desc;
+    }
+
+    // Materials of unknown type render magenta, like missing textures, so they stand out.
+    inline shared_ptr<material> make(const geometry_material &desc,
+                                     std::map<std::pair<std::string, double>, shared_ptr<texture>> &textures)
+    {
+        color albedo(desc.albedo[0], desc.albedo[1], desc.albedo[2]);
+        switch (desc.kind)
+        {
+        case geometry_material::lambertian:
+        {
+            if (desc.texture.empty())
+                return make_shared<lambertian>(albedo);
+            auto &tex = textures[{desc.texture, desc.parameter}];
+            if (!tex)
+                tex = make_shared<image_texture>(desc.texture, desc.parameter);
+            return make_shared<lambertian>(tex);
+        }
+        case geometry_material::metal:
+            return make_shared<metal>(albedo, desc.parameter);
+        case geometry_material::dielectric:
+            return make_shared<dielectric>(desc.parameter);
+        default:
+            return make_shared<lambertian>(color(1, 0, 1));
+        }
+    }
+}
+
+// Writes every triangle of world, with its material, to the geometry file at path in chunks of
+// at most chunk_size triangles. Materials other than lambertian (flat or image textured), metal
+// and dielectric are stored as unknown. Returns false if the file cannot be written.
+inline bool write_scene_geometry(const hittable_list &world, const std::string &path, uint32_t chunk_size = 4096)
+{
+    std::vector<packed_triangle> packed;
+    std::vector<geometry_material> materials;
+    std::map<const material *, uint32_t> material_index;
+
+    out_of_core_detail::visit(
+        world,
+        [&](const triangle &t) {
+            packed_triangle p;
+            for (int k = 0; k < 3; k++)
+            {
+                for (int a = 0; a < 3; a++)
+                    p.vertex[3 * k + a] = float(t.vertex(k)[a]);
+                vec3 uv = t.texture_coordinates(k);
+                p.uv[2 * k] = float(uv.x());
+                p.uv[2 * k + 1] = float(uv.y());
+            }
+            const material *mat = t.material_ptr().get();
+            auto found = material_index.find(mat);
+            if (found == material_index.end())
+            {
+                found = material_index.emplace(mat, uint32_t(materials.size())).first;
+                materials.push_back(out_of_core_detail::describe(mat));
+            }
+            p.material = found->second;
+            packed.push_back(p);
+        },
+        [](const shared_ptr<hittable> &) {});
+
+    return write_geometry_file(path, std::move(packed), materials, chunk_size);
+}
+
+// Opens the geometry file at path as a streamed_mesh reading through cache, with materials made
+// from the file's table. Returns nullptr if the file is missing or malformed.
+inline shared_ptr<streamed_mesh> open_scene_geometry(const std::string &path,
+                                                     geometry_cache &cache = geometry_cache::global())
+{
+    std::vector<shared_ptr<material>> materials;
+    {
+        geometry_file file;
+        if (!file.open(path))
+            return nullptr;
+        std::map<std::pair<std::string, double>, shared_ptr<texture>> textures;
+        for (uint32_t m = 0; m < file.material_count(); m++)
+            materials.push_back(out_of_core_detail::make(file.material(m), textures));
+    }
+    auto mesh = make_shared<streamed_mesh>(path, std::move(materials), cache);
+    return mesh->is_open() ? mesh : nullptr;
+}
+
+// The objects of world that hold no triangles (nested lists flattened), for rendering with the
+// triangles taken from a geometry file instead.
+inline hittable_list without_triangles(const hittable_list &world)
+{
+    hittable_list kept;
+    out_of_core_detail::visit(world, [](const triangle &) {}, [&](const shared_ptr<hittable> &object) { kept.add(object); });
+    return kept;
+}
+
+#endif
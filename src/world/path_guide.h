@@ -0,0 +1,354 @@
+#ifndef PATH_GUIDE_H
+#define PATH_GUIDE_H
+
+#include "../utils/aabb.h"
+#include "../utils/common.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Distribution of incident radiance over the sphere of directions, as a quadtree over the unit
+// square with cos(theta) along one side and phi along the other (an equal-area map, so density
+// on the square is density on the sphere times 4 pi). Two trees are kept: the sampling tree is
+// fixed while a pass renders, and the building tree, refined from the last pass, collects the
+// new pass's radiance through atomic adds so threads can record without locks.
+class direction_tree
+{
+public:
+    direction_tree() : building(1), building_sums(new std::atomic<float>[4]), sampling(1)
+    {
+        for (int q = 0; q < 4; q++)
+            building_sums[q].store(0, std::memory_order_relaxed);
+    }
+
+    direction_tree(const direction_tree &other)
+        : building(other.building), building_sums(new std::atomic<float>[4 * other.building.size()]),
+          sampling(other.sampling), total(other.total)
+    {
+        for (size_t k = 0; k < 4 * building.size(); k++)
+            building_sums[k].store(other.building_sums[k].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        recorded.store(other.recorded.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    // False until a pass has recorded radiance here.
+    bool trained() const { return total > 0; }
+
+    uint64_t samples() const { return recorded.load(std::memory_order_relaxed); }
+    void set_samples(uint64_t n) { recorded.store(n, std::memory_order_relaxed); }
+
+    // Draws a unit direction from the sampling tree.
+    vec3 sample() const
+    {
+        double x0 = 0, y0 = 0, size = 1;
+        uint32_t at = 0;
+        while (true)
+        {
+            const node &n = sampling[at];
+            double sum = n.sum[0] + n.sum[1] + n.sum[2] + n.sum[3];
+            if (sum <= 0)
+                break;
+            double pick = random_double() * sum;
+            int q = 0;
+            while (q < 3 && pick >= n.sum[q])
+                pick -= n.sum[q++];
+            size *= 0.5;
+            x0 += (q & 1) ? size : 0;
+            y0 += (q & 2) ? size : 0;
+            if (n.child[q] == 0)
+                break;
+            at = n.child[q];
+        }
+        return from_square(x0 + size * random_double(), y0 + size * random_double());
+    }
+
+    // Solid-angle density with which sample() returns the unit direction dir.
+    double pdf(const vec3 &dir) const
+    {
+        double x, y;
+        to_square(dir, x, y);
+        double density = 1;
+        uint32_t at = 0;
+        while (true)
+        {
+            const node &n = sampling[at];
+            double sum = n.sum[0] + n.sum[1] + n.sum[2] + n.sum[3];
+            if (sum <= 0)
+                break;
+            int q = quadrant(x, y);
+            density *= 4 * n.sum[q] / sum;
+            if (n.child[q] == 0 || density <= 0)
+                break;
+            at = n.child[q];
+        }
+        return density / (4 * pi);
+    }
+
+    // Adds value (incident radiance over the density it was sampled with) arriving from the
+    // unit direction dir to the building tree.
+    void record(const vec3 &dir, float value)
+    {
+        double x, y;
+        to_square(dir, x, y);
+        uint32_t at = 0;
+        while (true)
+        {
+            int q = quadrant(x, y);
+            add(building_sums[4 * size_t(at) + q], value);
+            if (building[at].child[q] == 0)
+                break;
+            at = building[at].child[q];
+        }
+        recorded.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Makes the building tree's radiance the new sampling distribution, then refines the
+    // building tree for the next pass: quadrants holding more than flux_threshold of the total
+    // are subdivided, down to max_depth levels, and the rest are merged. Single-threaded.
+    void update(double flux_threshold, int max_depth)
+    {
+        sampling.assign(building.size(), node());
+        for (size_t k = 0; k < building.size(); k++)
+            for (int q = 0; q < 4; q++)
+            {
+                sampling[k].child[q] = building[k].child[q];
+                sampling[k].sum[q] = building_sums[4 * k + q].load(std::memory_order_relaxed);
+            }
+        total = sampling[0].sum[0] + sampling[0].sum[1] + sampling[0].sum[2] + sampling[0].sum[3];
+
+        std::vector<node> refined(1);
+        if (total > 0)
+            refine(refined, 0, 0, 0, total, flux_threshold, max_depth);
+        building = std::move(refined);
+        building_sums.reset(new std::atomic<float>[4 * building.size()]);
+        for (size_t k = 0; k < 4 * building.size(); k++)
+            building_sums[k].store(0, std::memory_order_relaxed);
+        recorded.store(0, std::memory_order_relaxed);
+    }
+
+    size_t nodes() const { return sampling.size(); }
+
+private:
+    struct node
+    {
+        float sum[4] = {0, 0, 0, 0};
+        uint32_t child[4] = {0, 0, 0, 0}; // 0 for a leaf quadrant (the root is never a child)
+    };
+
+    std::vector<node> building;
+    std::unique_ptr<std::atomic<float>[]> building_sums; // 4 per building node
+    std::vector<node> sampling;
+    double total = 0;
+    std::atomic<uint64_t> recorded{0};
+
+    static int quadrant(double &x, double &y)
+    {
+        int q = 0;
+        x *= 2;
+        y *= 2;
+        if (x >= 1)
+        {
+            q |= 1;
+            x -= 1;
+        }
+        if (y >= 1)
+        {
+            q |= 2;
+            y -= 1;
+        }
+        return q;
+    }
+
+    static void add(std::atomic<float> &sum, float value)
+    {
+        float current = sum.load(std::memory_order_relaxed);
+        while (!sum.compare_exchange_weak(current, current + value, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    static void to_square(const vec3 &dir, double &x, double &y)
+    {
+        x = std::clamp(0.5 * (dir.z() + 1), 0.0, 1 - 1e-9);
+        y = std::clamp((std::atan2(dir.y(), dir.x()) + pi) / (2 * pi), 0.0, 1 - 1e-9);
+    }
+
+    static vec3 from_square(double x, double y)
+    {
+        double z = 2 * x - 1, r = std::sqrt(std::fmax(0.0, 1 - z * z)), phi = 2 * pi * y - pi;
+        return vec3(r * std::cos(phi), r * std::sin(phi), z);
+    }
+
+    // Fills refined[at] from sampling node source, or, when source is -1, from a quadrant that
+    // was a leaf and holds spread energy evenly over its children.
+    void refine(std::vector<node> &refined, uint32_t at, int depth, long source, double spread,
+                double flux_threshold, int max_depth) const
+    {
+        for (int q = 0; q < 4; q++)
+        {
+            double energy = source >= 0 ? sampling[source].sum[q] : spread / 4;
+            if (depth + 1 >= max_depth || energy / total <= flux_threshold)
+                continue;
+            long child_source = source >= 0 && sampling[source].child[q] != 0 ? long(sampling[source].child[q]) : -1;
+            uint32_t child = uint32_t(refined.size());
+            refined.push_back(node());
+            refined[at].child[q] = child;
+            refine(refined, child, depth + 1, child_source, energy, flux_threshold, max_depth);
+        }
+    }
+};
+
+// Online-learned guide for diffuse bounces (Mueller et al., "Practical Path Guiding"): a binary
+// tree over the scene splits space where many paths pass, and each leaf holds direction_trees of
+// the radiance recorded there. Surfaces facing different ways see different halves of the
+// sphere, so a leaf keeps one tree per dominant normal direction (+x, -x, +y, ...) rather than
+// spending guided samples below the surface. The camera renders training passes of doubling
+// sample counts; after each one, update() refines all trees from what the pass recorded.
+class path_guide
+{
+public:
+    // Fraction of diffuse bounces sampled from the material rather than the guide.
+    double bsdf_fraction = 0.5;
+
+    // Fraction of the camera's samples per pixel spent on training passes.
+    double training_fraction = 0.25;
+
+    // A spatial leaf splits once a pass records more than this many samples in it, times the
+    // square root of the pass's samples per pixel.
+    double spatial_threshold = 4000;
+
+    // Direction trees subdivide quadrants with more than this fraction of their energy.
+    double flux_threshold = 0.01;
+    int max_depth = 20;
+
+    // When set, the camera records the radiance its paths find at diffuse bounces.
+    bool learning = false;
+
+    explicit path_guide(const aabb &scene)
+    {
+        // A cube around the scene, so splits at the midpoint keep cells close to cubes.
+        point3 c = scene.is_empty() ? point3(0, 0, 0) : scene.center();
+        vec3 e = scene.is_empty() ? vec3(1, 1, 1) : scene.extent();
+        half = 0.5 * std::fmax(e.x(), std::fmax(e.y(), e.z())) * 1.01 + 1e-3;
+        center = c;
+        nodes.push_back(spatial_node());
+        trees.resize(orientations);
+    }
+
+    path_guide(const path_guide &) = delete;
+    path_guide &operator=(const path_guide &) = delete;
+
+    // Direction tree for surfaces with normal n in the cell containing p. Stable until the next
+    // update().
+    const direction_tree &at(const point3 &p, const vec3 &n) const { return trees[index(p, n)]; }
+    direction_tree &at(const point3 &p, const vec3 &n) { return trees[index(p, n)]; }
+
+    size_t cells() const { return trees.size() / orientations; }
+
+    // Called between passes, with the samples per pixel of the pass that just finished.
+    void update(int pass_samples)
+    {
+        double threshold = spatial_threshold * std::sqrt(double(std::max(pass_samples, 1)));
+        for (size_t k = 0; k < nodes.size(); k++)
+            if (nodes[k].tree >= 0 && samples(nodes[k].tree) > threshold)
+                split(uint32_t(k), threshold);
+        for (auto &tree : trees)
+            tree.update(flux_threshold, max_depth);
+    }
+
+private:
+    struct spatial_node
+    {
+        int axis = 0;
+        uint32_t child[2] = {0, 0};
+        int tree = 0; // leaves: trees[tree * orientations + ...]; -1 for interior nodes
+    };
+
+    static constexpr int orientations = 6;
+
+    point3 center;
+    double half;
+    std::vector<spatial_node> nodes;
+    std::vector<direction_tree> trees;
+
+    size_t index(const point3 &p, const vec3 &n) const
+    {
+        int axis = 0;
+        for (int a = 1; a < 3; a++)
+            if (std::fabs(n[a]) > std::fabs(n[axis]))
+                axis = a;
+        return leaf(p) * orientations + 2 * axis + (n[axis] < 0 ? 1 : 0);
+    }
+
+    uint64_t samples(int tree) const
+    {
+        uint64_t n = 0;
+        for (int o = 0; o < orientations; o++)
+            n += trees[size_t(tree) * orientations + o].samples();
+        return n;
+    }
+
+    size_t leaf(const point3 &p) const
+    {
+        double lo[3], hi[3];
+        for (int a = 0; a < 3; a++)
+        {
+            lo[a] = center[a] - half;
+            hi[a] = center[a] + half;
+        }
+        uint32_t at = 0;
+        while (nodes[at].tree < 0)
+        {
+            const spatial_node &n = nodes[at];
+            double mid = 0.5 * (lo[n.axis] + hi[n.axis]);
+            if (p[n.axis] < mid)
+            {
+                hi[n.axis] = mid;
+                at = n.child[0];
+            }
+            else
+            {
+                lo[n.axis] = mid;
+                at = n.child[1];
+            }
+        }
+        return size_t(nodes[at].tree);
+    }
+
+    // Splits leaf k in half along the next axis. Both halves start from copies of its direction
+    // trees with half their samples, and split further while they stay above threshold.
+    void split(uint32_t k, double threshold)
+    {
+        int tree = nodes[k].tree;
+        for (int o = 0; o < orientations; o++)
+        {
+            direction_tree &t = trees[size_t(tree) * orientations + o];
+            t.set_samples(t.samples() / 2);
+        }
+        for (int o = 0; o < orientations; o++)
+            trees.push_back(direction_tree(trees[size_t(tree) * orientations + o]));
+        uint64_t half_samples = samples(tree);
+
+        int axis = nodes[k].axis;
+        spatial_node left, right;
+        left.axis = right.axis = (axis + 1) % 3;
+        left.tree = tree;
+        right.tree = int(trees.size() / orientations - 1);
+        uint32_t first = uint32_t(nodes.size());
+        nodes.push_back(left);
+        nodes.push_back(right);
+        nodes[k].tree = -1;
+        nodes[k].child[0] = first;
+        nodes[k].child[1] = first + 1;
+
+        if (half_samples > threshold)
+        {
+            split(first, threshold);
+            split(first + 1, threshold);
+        }
+    }
+};
+
+#endif
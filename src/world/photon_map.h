@@ -0,0 +1,180 @@
+#ifndef PHOTON_MAP_H
+#define PHOTON_MAP_H
+
+#include "../utils/common.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// A stored photon: where it landed, the power it carries and the direction it arrived from,
+// packed into 28 bytes so the tree stays small (Jensen's layout, with float power).
+struct photon
+{
+    float position[3];
+    float power[3];
+    unsigned char theta, phi; // incoming direction, quantized spherical angles
+    unsigned char axis;       // kd-tree split axis of the node this photon sits at
+
+    void set_direction(const vec3 &dir)
+    {
+        vec3 d = unit_vector(dir);
+        int t = int(std::acos(std::clamp(d.z(), -1.0, 1.0)) * (256.0 / pi));
+        int p = int((std::atan2(d.y(), d.x()) + pi) * (256.0 / (2 * pi)));
+        theta = (unsigned char)std::min(t, 255);
+        phi = (unsigned char)std::min(p, 255);
+    }
+
+    vec3 direction() const
+    {
+        double t = (theta + 0.5) * (pi / 256), p = (phi + 0.5) * (2 * pi / 256) - pi;
+        return vec3(std::sin(t) * std::cos(p), std::sin(t) * std::sin(p), std::cos(t));
+    }
+};
+
+// Caustic photon map: photons that reached a diffuse surface through at least one specular
+// bounce (camera::build_caustics traces them). They are kept in a balanced kd-tree laid out in
+// one array: every range holds its median photon at its middle and its two halves on either
+// side, so the tree needs no child pointers and a lookup walks contiguous memory.
+class photon_map
+{
+public:
+    // Photons to store, capped by memory_budget bytes of photon storage.
+    size_t photon_count = 200000;
+    size_t memory_budget = size_t(64) << 20;
+    int max_bounces = 16;
+
+    // Density estimation: the nearest photons within max_radius of the hit.
+    int nearest = 50;
+    double max_radius = 0.1;
+
+    size_t capacity() const { return std::min(photon_count, memory_budget / sizeof(photon)); }
+    size_t size() const { return photons.size(); }
+    size_t bytes() const { return photons.size() * sizeof(photon); }
+    uint64_t emitted() const { return emitted_count; }
+
+    // Replaces the contents with the given photons. Their power must already be divided by the
+    // number of photons emitted (emitted is kept only for reporting).
+    void assign(std::vector<photon> stored, uint64_t emitted)
+    {
+        photons = std::move(stored);
+        emitted_count = emitted;
+        balance(0, photons.size());
+    }
+
+    // Irradiance at p on a surface with normal n, from the photons arriving on its front side.
+    color irradiance(const point3 &p, const vec3 &n) const
+    {
+        if (photons.empty())
+            return color(0, 0, 0);
+
+        const int max_nearest = 256;
+        neighbor found[max_nearest];
+        int k = std::clamp(nearest, 1, max_nearest);
+        int count = 0;
+        double radius2 = max_radius * max_radius;
+        float target[3] = {float(p.x()), float(p.y()), float(p.z())};
+        search(0, photons.size(), target, k, found, count, radius2);
+        if (count == 0)
+            return color(0, 0, 0);
+
+        color sum(0, 0, 0);
+        for (int i = 0; i < count; i++)
+        {
+            const photon &ph = photons[found[i].index];
+            if (dot(ph.direction(), n) < 0)
+                sum += color(ph.power[0], ph.power[1], ph.power[2]);
+        }
+        // With fewer than k photons in range the estimate covers the whole search disc.
+        double r2 = count == k ? found[0].distance2 : max_radius * max_radius;
+        return sum / (pi * r2);
+    }
+
+private:
+    std::vector<photon> photons;
+    uint64_t emitted_count = 0;
+
+    struct neighbor
+    {
+        double distance2;
+        size_t index;
+    };
+
+    void balance(size_t begin, size_t end)
+    {
+        if (end - begin < 2)
+        {
+            if (end > begin)
+                photons[begin].axis = 0;
+            return;
+        }
+
+        float lo[3] = {photons[begin].position[0], photons[begin].position[1], photons[begin].position[2]};
+        float hi[3] = {lo[0], lo[1], lo[2]};
+        for (size_t i = begin; i < end; i++)
+            for (int a = 0; a < 3; a++)
+            {
+                lo[a] = std::min(lo[a], photons[i].position[a]);
+                hi[a] = std::max(hi[a], photons[i].position[a]);
+            }
+        int axis = 0;
+        for (int a = 1; a < 3; a++)
+            if (hi[a] - lo[a] > hi[axis] - lo[axis])
+                axis = a;
+
+        size_t mid = begin + (end - begin) / 2;
+        std::nth_element(photons.begin() + begin, photons.begin() + mid, photons.begin() + end,
+                         [axis](const photon &a, const photon &b) { return a.position[axis] < b.position[axis]; });
+        photons[mid].axis = (unsigned char)axis;
+        balance(begin, mid);
+        balance(mid + 1, end);
+    }
+
+    // k-nearest search keeping found[] as a max-heap on distance.
+    void search(size_t begin, size_t end, const float target[3], int k, neighbor *found, int &count, double &radius2) const
+    {
+        if (begin >= end)
+            return;
+        size_t mid = begin + (end - begin) / 2;
+        const photon &ph = photons[mid];
+        double delta = double(target[ph.axis]) - ph.position[ph.axis];
+
+        // Near side first, then the far side if the splitting plane is within range.
+        if (delta < 0)
+        {
+            search(begin, mid, target, k, found, count, radius2);
+            if (delta * delta < radius2)
+                search(mid + 1, end, target, k, found, count, radius2);
+        }
+        else
+        {
+            search(mid + 1, end, target, k, found, count, radius2);
+            if (delta * delta < radius2)
+                search(begin, mid, target, k, found, count, radius2);
+        }
+
+        double dx = double(target[0]) - ph.position[0], dy = double(target[1]) - ph.position[1],
+               dz = double(target[2]) - ph.position[2];
+        double d2 = dx * dx + dy * dy + dz * dz;
+        if (d2 >= radius2)
+            return;
+
+        auto farther = [](const neighbor &a, const neighbor &b) { return a.distance2 < b.distance2; };
+        if (count < k)
+        {
+            found[count++] = {d2, mid};
+            std::push_heap(found, found + count, farther);
+            if (count == k)
+                radius2 = found[0].distance2;
+        }
+        else
+        {
+            std::pop_heap(found, found + count, farther);
+            found[count - 1] = {d2, mid};
+            std::push_heap(found, found + count, farther);
+            radius2 = found[0].distance2;
+        }
+    }
+};
+
+#endif
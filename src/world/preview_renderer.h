@@ -0,0 +1,291 @@
+#ifndef PREVIEW_RENDERER_H
+#define PREVIEW_RENDERER_H
+
+#include "camera.h"
+#include "../utils/shared_framebuffer.h"
+
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Progressive renderer for interactive camera moves. Every pixel keeps its radiance sum and
+// sample count together with the surface seen through its center. When the view changes, each
+// new pixel looks up where its own first hit was in the previous view; if that old pixel saw
+// the same diffuse surface (same point and orientation), its samples carry over. Pixels that
+// were disoccluded, hit something specular or left the frame start again from zero, and the
+// next passes give them more samples per pass than pixels that kept their history.
+template <typename world_t>
+class preview_renderer
+{
+public:
+    // Samples per pass for pixels with fewer than burst_until samples, and for the rest.
+    int burst_samples = 4;
+    int burst_until = 16;
+
+    // The old pixel's hit must lie within this fraction of the hit distance of the new hit's
+    // tangent plane. Offsets along the surface are expected, since pixel centers do not line up
+    // between views.
+    double position_tolerance = 0.01;
+
+    // cam's settings (samples_per_pixel is the target per pixel) are read on construction and
+    // by move_to(). If output is set, every pass is published to it.
+    preview_renderer(camera &cam, world_t &world, shared_framebuffer *output = nullptr)
+        : cam(cam), world(world), output(output)
+    {
+        cam.prepare();
+        width = cam.image_width;
+        height = cam.height();
+        pixels.assign(size_t(width) * height, pixel_history());
+        frame.assign(pixels.size(), color(0, 0, 0));
+        update_first_hits(pixels);
+    }
+
+    // Moves the camera and keeps whatever samples are still valid. Returns the number of pixels
+    // that kept their history.
+    size_t move_to(const point3 &lookfrom, const point3 &lookat)
+    {
+        camera previous = cam;
+        cam.lookfrom = lookfrom;
+        cam.lookat = lookat;
+        cam.prepare();
+
+        // Cylinders and cones follow the camera when it asks for adaptive tessellation. The
+        // new first hits below see the new meshes.
+        if constexpr (std::is_base_of_v<hittable, world_t>)
+            if (cam.lod_error > 0)
+                world.update_lod(cam.lod());
+
+        std::vector<pixel_history> next(pixels.size());
+        update_first_hits(next);
+
+        size_t reused = 0;
+        #pragma omp parallel for schedule(dynamic) reduction(+ : reused)
+        for (int j = 0; j < height; j++)
+        {
+            for (int i = 0; i < width; i++)
+            {
+                auto &p = next[size_t(j) * width + i];
+                double x, y;
+                if (!p.diffuse || !previous.project(p.position, x, y))
+                    continue;
+                int oi = int(std::lround(x)), oj = int(std::lround(y));
+                if (oi < 0 || oi >= width || oj < 0 || oj >= height)
+                    continue;
+
+                const auto &old = pixels[size_t(oj) * width + oi];
+                if (!old.diffuse || old.samples == 0 ||
+                    std::fabs(dot(old.position - p.position, p.normal)) > position_tolerance * p.distance ||
+                    dot(old.normal, p.normal) < 0.9)
+                    continue;
+                p.sum = old.sum;
+                p.samples = old.samples;
+                reused++;
+            }
+        }
+
+        pixels.swap(next);
+        pass_index = 0;
+        resolve();
+        return reused;
+    }
+
+    // Adds one pass of samples. Returns false, without rendering, once every pixel has reached
+    // the camera's samples_per_pixel.
+    bool pass()
+    {
+        int target = cam.samples_per_pixel;
+        bool any = false;
+        uint64_t pass_seed = splitmix64(cam.seed ^ (generation++ * 0x9E3779B97F4A7C15ull));
+
+        #pragma omp parallel for schedule(dynamic) reduction(|| : any)
+        for (int j = 0; j < height; j++)
+        {
+            for (int i = 0; i < width; i++)
+            {
+                auto &p = pixels[size_t(j) * width + i];
+                int n = std::min(target - p.samples, p.samples < burst_until ? burst_samples : 1);
+                if (n <= 0)
+                    continue;
+                any = true;
+                seed_random(pass_seed + uint64_t(j) * uint64_t(width) + uint64_t(i));
+                for (int s = 0; s < n; s++)
+                    p.sum += cam.trace_sample(i, j, world);
+                p.samples += n;
+            }
+        }
+
+        if (any)
+        {
+            pass_index++;
+            resolve();
+        }
+        return any;
+    }
+
+    // Current estimate, row-major.
+    const std::vector<color> &image() const { return frame; }
+
+    // Passes since the last move.
+    int passes() const { return pass_index; }
+
+    int min_samples() const
+    {
+        int m = cam.samples_per_pixel;
+        for (const auto &p : pixels)
+            m = std::min(m, p.samples);
+        return m;
+    }
+
+private:
+    struct pixel_history
+    {
+        point3 position;
+        vec3 normal;
+        double distance = 0;
+        bool diffuse = false;
+        color sum = color(0, 0, 0);
+        int samples = 0;
+    };
+
+    camera &cam;
+    world_t &world;
+    shared_framebuffer *output;
+    int width;
+    int height;
+    std::vector<pixel_history> pixels;
+    std::vector<color> frame;
+    int pass_index = 0;
+    uint64_t generation = 0;
+
+    void update_first_hits(std::vector<pixel_history> &target) const
+    {
+        #pragma omp parallel for schedule(dynamic)
+        for (int j = 0; j < height; j++)
+        {
+            for (int i = 0; i < width; i++)
+            {
+                auto &p = target[size_t(j) * width + i];
+                hit_record rec;
+                bool diffuse = false;
+                if (cam.first_hit(i, j, world, rec, diffuse))
+                {
+                    p.position = rec.p;
+                    p.normal = rec.normal;
+                    p.distance = (rec.p - cam.lookfrom).length();
+                    p.diffuse = diffuse;
+                }
+                else
+                    p.diffuse = false;
+            }
+        }
+    }
+
+    void resolve()
+    {
+        for (size_t k = 0; k < pixels.size(); k++)
+            frame[k] = pixels[k].samples > 0 ? pixels[k].sum / pixels[k].samples : color(0, 0, 0);
+        if (output && output->is_open())
+            output->publish(frame);
+    }
+};
+
+// Interactive preview loop: publishes progressive frames of world to the shared framebuffer
+// shm_name while reading camera moves from commands, one per line:
+//
+//   view <lookfrom x> <y> <z> <lookat x> <y> <z>
+//   quit
+//
+// A move is picked up between passes. Returns once commands ends or says quit.
+template <typename world_t>
+int run_preview(camera &cam, world_t &world, const std::string &shm_name, std::istream &commands)
+{
+    cam.prepare();
+    shared_framebuffer output;
+    if (!output.create(shm_name, cam.image_width, cam.height()))
+    {
+        std::cerr << "raytracer: cannot create shared memory " << shm_name << '\n';
+        return 1;
+    }
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool have_view = false, quit = false;
+    point3 next_from, next_at;
+
+    std::thread reader([&] {
+        std::string line;
+        while (std::getline(commands, line))
+        {
+            std::istringstream in(line);
+            std::string command;
+            in >> command;
+            double v[6];
+            if (command == "view" && in >> v[0] >> v[1] >> v[2] >> v[3] >> v[4] >> v[5])
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                next_from = point3(v[0], v[1], v[2]);
+                next_at = point3(v[3], v[4], v[5]);
+                have_view = true;
+            }
+            else if (command == "quit")
+                break;
+            else if (!command.empty())
+            {
+                std::cerr << "preview: unknown command " << line << '\n';
+                continue;
+            }
+            else
+                continue;
+            changed.notify_one();
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+        changed.notify_one();
+    });
+
+    preview_renderer<world_t> renderer(cam, world, &output);
+    while (true)
+    {
+        point3 from, at;
+        bool move = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (quit && !have_view)
+                break;
+            if (have_view)
+            {
+                from = next_from;
+                at = next_at;
+                have_view = false;
+                move = true;
+            }
+        }
+        if (move)
+        {
+            size_t reused = renderer.move_to(from, at);
+            std::clog << "\nview moved, " << reused << " of " << size_t(cam.image_width) * cam.height()
+                      << " pixels kept their samples\n";
+        }
+
+        if (renderer.pass())
+        {
+            std::clog << "\rpass " << renderer.passes() << ", min samples " << renderer.min_samples() << "   "
+                      << std::flush;
+            continue;
+        }
+
+        // Converged: idle until the next command.
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return have_view || quit; });
+    }
+
+    reader.join();
+    std::clog << '\n';
+    return 0;
+}
+
+#endif
@@ -0,0 +1,291 @@
+#ifndef RASTERIZER_H
+#define RASTERIZER_H
+
+#include "bvh.h"
+
+#include "../utils/common.h"
+#include "../utils/trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+// One camera sample of a visibility buffer: where in its pixel the sample lies and the
+// triangle seen there.
+struct visibility_sample
+{
+    float x, y;       // offset from the pixel center, in [-0.5, 0.5) pixels
+    int32_t triangle; // index into raster_scene::primitives.triangles, -1 when none covers it
+    float b1, b2;     // barycentric coordinates of the triangle's B and C at the sample
+    float depth;      // view-space depth of the triangle at the sample
+};
+
+// The camera of a frame, as the rasterizer sees it: a pinhole at center looking down -w, with
+// pixel (i, j) centered at pixel00_loc + i * pixel_delta_u + j * pixel_delta_v on the plane
+// focus_dist in front of it.
+struct raster_view
+{
+    point3 center;
+    vec3 w;
+    double focus_dist;
+    point3 pixel00_loc;
+    vec3 pixel_delta_u, pixel_delta_v;
+    int width, height;
+    int tile_size;
+};
+
+// A scene split for rasterized primary visibility: its triangles (meshes are split into
+// theirs, as for a bvh) are rasterized, and everything else, spheres included, is kept in a
+// small bvh that camera rays are traced through to find what occludes the triangles.
+class raster_scene
+{
+public:
+    bvh_primitives primitives;
+
+    explicit raster_scene(const hittable_list &world)
+    {
+        trace::scope scope("raster scene");
+        primitives.add(world);
+        std::vector<uint32_t> rest;
+        for (uint32_t ref : primitives.references())
+            if (ref >> bvh_primitives::kind_shift != bvh_primitives::kind_triangle)
+                rest.push_back(ref);
+        if (!rest.empty())
+            others = std::make_unique<bvh<4>>(primitives, rest);
+    }
+
+    size_t triangle_count() const { return primitives.triangles.size(); }
+    size_t other_count() const { return primitives.references().size() - triangle_count(); }
+
+    // Closest hit of camera ray r, whose visible triangle the rasterizer found in s: that
+    // triangle, unless one of the other primitives is nearer. found is set when anything is hit.
+    // Returns false, for the caller to trace r through the whole scene instead, when the
+    // triangle lies edge-on to r or in front of its near end.
+    bool hit(const ray &r, const visibility_sample &s, hit_record &rec, bool &found) const
+    {
+        found = false;
+        double closest = infinity;
+        if (s.triangle >= 0)
+        {
+            if (!primitives.triangles[size_t(s.triangle)].hit_at(r, s.b1, s.b2, rec) || !(rec.t > 0.001))
+                return false;
+            rec.object = primitives.owner(uint32_t(bvh_primitives::kind_triangle) << bvh_primitives::kind_shift |
+                                          uint32_t(s.triangle));
+            found = true;
+            closest = rec.t;
+        }
+        if (others && others->hit(r, interval(0.001, closest), rec))
+            found = true;
+        return true;
+    }
+
+private:
+    std::unique_ptr<bvh<4>> others;
+};
+
+// A raster_scene's triangles projected for one frame and binned into its tiles (tile_size
+// pixels square, row-major over the image), ready to be rasterized tile by tile from many
+// threads at once.
+//
+// Triangles are clipped at the camera's near end (where camera rays start, 0.001 of their
+// length in) and projected to pixel coordinates with their depth. A tile is rasterized by
+// evaluating the three edge functions of every triangle binned to it at every sample, and the
+// nearest triangle containing a sample is kept, with its barycentrics interpolated in
+// perspective. Samples on an edge count as inside both triangles that share it, so meshes
+// show no cracks.
+class raster_frame
+{
+public:
+    raster_frame(const raster_scene &scene, const raster_view &view) : view(view)
+    {
+        trace::scope scope("raster setup", int64_t(scene.triangle_count()));
+        size = view.tile_size < 1 ? 16 : view.tile_size;
+        tiles_x = (view.width + size - 1) / size;
+        tiles_y = (view.height + size - 1) / size;
+        u_axis = view.pixel_delta_u / view.pixel_delta_u.length_squared();
+        v_axis = view.pixel_delta_v / view.pixel_delta_v.length_squared();
+        x_origin = dot(view.pixel00_loc - view.center, u_axis);
+        y_origin = dot(view.pixel00_loc - view.center, v_axis);
+        near = 0.001 * view.focus_dist;
+
+        // Clipping leaves at most a quadrilateral, so each triangle has two slots.
+        const auto &triangles = scene.primitives.triangles;
+        std::vector<screen_triangle> slots(2 * triangles.size());
+        std::vector<uint8_t> used(slots.size(), 0);
+        #pragma omp parallel for schedule(static)
+        for (int64_t k = 0; k < int64_t(triangles.size()); k++)
+            setup(triangles[size_t(k)], int32_t(k), &slots[size_t(2 * k)], &used[size_t(2 * k)]);
+
+        // Bins keep scene order, so equal depths resolve as they would along a ray.
+        bins.resize(size_t(tiles_x) * tiles_y);
+        for (size_t k = 0; k < slots.size(); k++)
+        {
+            if (!used[k])
+                continue;
+            const screen_triangle &s = slots[k];
+            int i0, i1, j0, j1;
+            if (!pixel_range(s.x, view.width, i0, i1) || !pixel_range(s.y, view.height, j0, j1))
+                continue;
+            uint32_t index = uint32_t(screen.size());
+            screen.push_back(s);
+            for (int ty = j0 / size; ty <= j1 / size; ty++)
+                for (int tx = i0 / size; tx <= i1 / size; tx++)
+                    bins[size_t(ty) * tiles_x + tx].push_back(index);
+        }
+    }
+
+    int tile_count() const { return tiles_x * tiles_y; }
+
+    // Fills samples with the visibility buffer of tile t: samples_per_pixel samples for each
+    // of its pixels, in row-major order. Sample offsets are uniform over the pixel, like the
+    // camera's own jitter, and drawn from a generator seeded from (seed, pixel).
+    void rasterize(int t, int samples_per_pixel, uint64_t seed, std::vector<visibility_sample> &samples) const
+    {
+        int x0 = (t % tiles_x) * size, y0 = (t / tiles_x) * size;
+        int w = std::min(size, view.width - x0), h = std::min(size, view.height - y0);
+        samples.resize(size_t(w) * h * samples_per_pixel);
+        for (int y = 0; y < h; y++)
+        {
+            for (int x = 0; x < w; x++)
+            {
+                seed_random(seed * 0x100000001B3ull + uint64_t(y0 + y) * uint64_t(view.width) + uint64_t(x0 + x));
+                visibility_sample *pixel = &samples[(size_t(y) * w + x) * samples_per_pixel];
+                for (int k = 0; k < samples_per_pixel; k++)
+                {
+                    pixel[k].x = float(random_double() - 0.5);
+                    pixel[k].y = float(random_double() - 0.5);
+                    pixel[k].triangle = -1;
+                    pixel[k].depth = std::numeric_limits<float>::infinity();
+                }
+            }
+        }
+
+        for (uint32_t index : bins[size_t(t)])
+        {
+            const screen_triangle &s = screen[index];
+            double area = (s.x[1] - s.x[0]) * (s.y[2] - s.y[0]) - (s.x[2] - s.x[0]) * (s.y[1] - s.y[0]);
+            if (area == 0)
+                continue;
+            double inv_area = 1 / area;
+            int i0, i1, j0, j1;
+            pixel_range(s.x, view.width, i0, i1);
+            pixel_range(s.y, view.height, j0, j1);
+            i0 = std::max(i0, x0), i1 = std::min(i1, x0 + w - 1);
+            j0 = std::max(j0, y0), j1 = std::min(j1, y0 + h - 1);
+
+            for (int j = j0; j <= j1; j++)
+            {
+                for (int i = i0; i <= i1; i++)
+                {
+                    visibility_sample *pixel = &samples[(size_t(j - y0) * w + (i - x0)) * samples_per_pixel];
+                    for (int k = 0; k < samples_per_pixel; k++)
+                    {
+                        visibility_sample &sample = pixel[k];
+                        double px = i + double(sample.x), py = j + double(sample.y);
+                        double l0 = ((s.x[1] - px) * (s.y[2] - py) - (s.x[2] - px) * (s.y[1] - py)) * inv_area;
+                        double l1 = ((s.x[2] - px) * (s.y[0] - py) - (s.x[0] - px) * (s.y[2] - py)) * inv_area;
+                        double l2 = ((s.x[0] - px) * (s.y[1] - py) - (s.x[1] - px) * (s.y[0] - py)) * inv_area;
+                        if (l0 < 0 || l1 < 0 || l2 < 0)
+                            continue;
+                        double inv_depth = l0 * s.inv_z[0] + l1 * s.inv_z[1] + l2 * s.inv_z[2];
+                        if (!(inv_depth > 0) || 1 / inv_depth >= sample.depth)
+                            continue;
+                        double depth = 1 / inv_depth;
+                        sample.triangle = s.triangle;
+                        sample.depth = float(depth);
+                        sample.b1 = float((l0 * s.b1[0] + l1 * s.b1[1] + l2 * s.b1[2]) * depth);
+                        sample.b2 = float((l0 * s.b2[0] + l1 * s.b2[1] + l2 * s.b2[2]) * depth);
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    // A (piece of a) triangle in pixel coordinates. Reciprocal depth, and the barycentrics over
+    // depth, interpolate linearly across the screen.
+    struct screen_triangle
+    {
+        double x[3], y[3];
+        double inv_z[3];
+        double b1[3], b2[3];
+        int32_t triangle;
+    };
+
+    struct clip_vertex
+    {
+        vec3 d; // from the camera center
+        double z;
+        double b1, b2;
+    };
+
+    raster_view view;
+    int size, tiles_x, tiles_y;
+    vec3 u_axis, v_axis;
+    double x_origin, y_origin;
+    double near;
+    std::vector<screen_triangle> screen;
+    std::vector<std::vector<uint32_t>> bins;
+
+    // Clips triangle k to the near plane and projects the remaining polygon into up to two
+    // screen triangles, marking the slots used.
+    void setup(const triangle &tri, int32_t k, screen_triangle *out, uint8_t *used) const
+    {
+        static const double corner_b1[3] = {0, 1, 0}, corner_b2[3] = {0, 0, 1};
+        clip_vertex corners[3];
+        for (int c = 0; c < 3; c++)
+        {
+            vec3 d = tri.vertex(c) - view.center;
+            corners[c] = {d, -dot(d, view.w), corner_b1[c], corner_b2[c]};
+        }
+
+        clip_vertex polygon[4];
+        int n = 0;
+        for (int c = 0; c < 3; c++)
+        {
+            const clip_vertex &a = corners[c], &b = corners[(c + 1) % 3];
+            if (a.z >= near)
+                polygon[n++] = a;
+            if ((a.z >= near) != (b.z >= near))
+            {
+                double f = (near - a.z) / (b.z - a.z);
+                polygon[n++] = {a.d + f * (b.d - a.d), near, a.b1 + f * (b.b1 - a.b1), a.b2 + f * (b.b2 - a.b2)};
+            }
+        }
+
+        for (int fan = 0; fan + 2 < n; fan++)
+        {
+            screen_triangle &s = out[fan];
+            const clip_vertex *v[3] = {&polygon[0], &polygon[fan + 1], &polygon[fan + 2]};
+            for (int c = 0; c < 3; c++)
+            {
+                double inv_z = 1 / v[c]->z;
+                double scale = view.focus_dist * inv_z;
+                s.x[c] = dot(v[c]->d, u_axis) * scale - x_origin;
+                s.y[c] = dot(v[c]->d, v_axis) * scale - y_origin;
+                s.inv_z[c] = inv_z;
+                s.b1[c] = v[c]->b1 * inv_z;
+                s.b2[c] = v[c]->b2 * inv_z;
+            }
+            s.triangle = k;
+            used[fan] = 1;
+        }
+    }
+
+    // Pixels [first, last] along one axis (of extent pixels) whose samples, at most half a
+    // pixel from their centers, can fall within the coordinates c. False when there are none.
+    static bool pixel_range(const double c[3], int extent, int &first, int &last)
+    {
+        double lo = std::min({c[0], c[1], c[2]}) - 0.5, hi = std::max({c[0], c[1], c[2]}) + 0.5;
+        if (!(hi >= 0) || !(lo < extent))
+            return false;
+        first = int(std::floor(std::max(lo, 0.0)));
+        last = std::min(extent - 1, int(std::ceil(std::min(hi, double(extent)))));
+        return true;
+    }
+};
+
+#endif
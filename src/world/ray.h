@@ -10,8 +10,21 @@ public:
 
   ray(const point3 &origin, const vec3 &direction) : orig(origin), dir(direction) {}
 
+  // A ray cone approximates the ray differentials of a camera ray: the footprint of the ray is
+  // cone_width at the origin and grows by cone_spread per unit of distance travelled.
+  ray(const point3 &origin, const vec3 &direction, double cone_width, double cone_spread)
+      : orig(origin), dir(direction), width(cone_width), spread(cone_spread) {}
+
   const point3 &origin() const { return orig; }
   const vec3 &direction() const { return dir; }
+  double cone_width() const { return width; }
+  double cone_spread() const { return spread; }
+
+  // Width of the ray footprint at parameter t.
+  double footprint(double t) const
+  {
+    return width + spread * t * dir.length();
+  }
 
   point3 at(double t) const
   {
@@ -21,6 +34,8 @@ public:
 private:
   point3 orig;
   vec3 dir;
+  double width = 0;
+  double spread = 0;
 };
 
 #endif
\ No newline at end of file
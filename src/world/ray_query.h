@@ -0,0 +1,171 @@
+#ifndef RAY_QUERY_H
+#define RAY_QUERY_H
+
+#include "bvh.h"
+
+#include "../objects/sphere_set.h"
+#include "../utils/trace.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// A ray of a query batch. Hits count at distances t in (tmin, tmax), in units of direction.
+struct query_ray
+{
+    point3 origin;
+    vec3 direction;
+    double tmin, tmax;
+};
+
+// Closest-hit results of a batch, one array per field, indexed like the rays. Rays that hit
+// nothing get t = infinity, primitive, object and material -1 and a zero normal.
+struct query_hits
+{
+    std::vector<double> t;
+    std::vector<int32_t> primitive; // index of the primitive hit, below ray_query_scene::primitive_count()
+    std::vector<int32_t> object;    // index into the objects of the queried hittable_list
+    std::vector<double> normal[3];  // x, y and z of the surface normal, facing the ray
+    std::vector<int32_t> material;  // index into ray_query_scene::materials(), -1 if not listed
+
+    // Sizes every array for count rays. Reusing a query_hits for batches of the same size
+    // allocates nothing.
+    void resize(size_t count)
+    {
+        t.resize(count);
+        primitive.resize(count);
+        object.resize(count);
+        for (auto &axis : normal)
+            axis.resize(count);
+        material.resize(count);
+    }
+};
+
+// Geometry queries other than rendering, such as visibility, line of sight and distance probes,
+// answered in batches. The scene is flattened and indexed by a 4-wide bvh once; each call
+// then runs a contiguous array of rays through it in parallel and writes results straight
+// into caller-owned arrays, with nothing allocated per ray.
+//
+// Primitives are numbered in scene order: each triangle (of meshes too) and each sphere,
+// including those grouped into sphere_sets, has its own index, and objects of other types
+// count as one. Materials of triangles and spheres are numbered in the order they are first
+// met, so results can refer to them by index. Hits on objects of other types report material
+// -1.
+class ray_query_scene
+{
+public:
+    explicit ray_query_scene(const hittable_list &world)
+    {
+        trace::scope scope("query scene");
+        primitives.add(split_sphere_sets(world));
+        tree = std::make_unique<bvh<4>>(primitives, primitives.references());
+        const auto &refs = primitives.references();
+        primitive_index[bvh_primitives::kind_triangle].resize(primitives.triangles.size());
+        primitive_index[bvh_primitives::kind_sphere].resize(primitives.spheres.size());
+        primitive_index[bvh_primitives::kind_other].resize(primitives.others.size());
+        for (size_t k = 0; k < refs.size(); k++)
+            primitive_index[refs[k] >> bvh_primitives::kind_shift][refs[k] & bvh_primitives::index_mask] = int32_t(k);
+        std::map<const material *, int32_t> ids;
+        auto add_material = [&](const shared_ptr<material> &mat) {
+            if (mat && ids.emplace(mat.get(), int32_t(material_table.size())).second)
+                material_table.push_back(mat);
+        };
+        for (const auto &tri : primitives.triangles)
+            add_material(tri.material_ptr());
+        for (const auto &s : primitives.spheres)
+            add_material(s.material_ptr());
+        material_index.assign(ids.begin(), ids.end());
+    }
+
+    ray_query_scene(const ray_query_scene &) = delete;
+    ray_query_scene &operator=(const ray_query_scene &) = delete;
+
+    const std::vector<shared_ptr<material>> &materials() const { return material_table; }
+    size_t primitive_count() const { return tree->primitive_count(); }
+    aabb bounding_box() const { return tree->bounding_box(); }
+
+    // Finds the closest hit of each of rays[0, count) and writes it to hits, which is resized
+    // to count.
+    void closest_hit(const query_ray *rays, size_t count, query_hits &hits) const
+    {
+        trace::scope scope("closest hit batch", int64_t(count));
+        hits.resize(count);
+        #pragma omp parallel for schedule(dynamic, 256)
+        for (int64_t k = 0; k < int64_t(count); k++)
+        {
+            const query_ray &q = rays[k];
+            hit_record rec;
+            if (!tree->hit(ray(q.origin, q.direction), interval(q.tmin, q.tmax), rec))
+            {
+                hits.t[size_t(k)] = infinity;
+                hits.primitive[size_t(k)] = -1;
+                hits.object[size_t(k)] = -1;
+                for (auto &axis : hits.normal)
+                    axis[size_t(k)] = 0;
+                hits.material[size_t(k)] = -1;
+                continue;
+            }
+            hits.t[size_t(k)] = rec.t;
+            uint32_t ref = uint32_t(rec.primitive);
+            hits.primitive[size_t(k)] = primitive_index[ref >> bvh_primitives::kind_shift][ref & bvh_primitives::index_mask];
+            hits.object[size_t(k)] = rec.object;
+            for (int a = 0; a < 3; a++)
+                hits.normal[a][size_t(k)] = rec.normal[a];
+            hits.material[size_t(k)] = material_id(rec.mat.get());
+        }
+    }
+
+    // Sets occluded[k] to 1 if rays[k] hits anything, 0 otherwise. Each ray stops at the first
+    // hit it finds, which makes this cheaper than closest_hit for shadow and line-of-sight
+    // tests.
+    void any_hit(const query_ray *rays, size_t count, uint8_t *occluded) const
+    {
+        trace::scope scope("any hit batch", int64_t(count));
+        #pragma omp parallel for schedule(dynamic, 256)
+        for (int64_t k = 0; k < int64_t(count); k++)
+        {
+            const query_ray &q = rays[k];
+            occluded[k] = tree->occluded(ray(q.origin, q.direction), interval(q.tmin, q.tmax)) ? 1 : 0;
+        }
+    }
+
+private:
+    bvh_primitives primitives;
+    std::unique_ptr<bvh<4>> tree;
+    std::vector<shared_ptr<material>> material_table;
+    std::vector<std::pair<const material *, int32_t>> material_index; // sorted by pointer
+    std::vector<int32_t> primitive_index[3]; // position in primitives.references(), by kind and index
+
+    // world with every sphere_set, nested ones included, replaced by a list of its spheres, so
+    // that each sphere is a primitive. Top-level object indices are unchanged.
+    static hittable_list split_sphere_sets(const hittable_list &world)
+    {
+        hittable_list split;
+        for (const auto &object : world.objects)
+        {
+            if (auto set = std::dynamic_pointer_cast<sphere_set>(object))
+            {
+                auto spheres = make_shared<hittable_list>();
+                for (size_t k = 0; k < set->size(); k++)
+                    spheres->add(make_shared<sphere>(set->at(k)));
+                split.add(spheres);
+            }
+            else if (auto list = std::dynamic_pointer_cast<hittable_list>(object))
+                split.add(make_shared<hittable_list>(split_sphere_sets(*list)));
+            else
+                split.add(object);
+        }
+        return split;
+    }
+
+    int32_t material_id(const material *mat) const
+    {
+        auto found = std::lower_bound(material_index.begin(), material_index.end(), std::make_pair(mat, int32_t(-1)));
+        return found != material_index.end() && found->first == mat ? found->second : -1;
+    }
+};
+
+#endif
@@ -0,0 +1,603 @@
+#ifndef RENDER_SERVER_H
+#define RENDER_SERVER_H
+
+#include "../utils/common.h"
+#include "camera.h"
+#include "hittable_list.h"
+#include "scenes.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <omp.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <list>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Long-running render daemon. Listens on a local Unix socket for line-based commands, keeps
+// built scenes cached by id and runs render jobs on a fixed pool of worker threads, highest
+// priority first. Each job is still parallelized over pixels by camera::render_frame, on an
+// OpenMP team of its worker's share of the threads, so concurrent jobs never add up to more
+// threads than one render would use.
+//
+// Commands (one per line, one reply line each):
+//   RENDER scene=<id> out=<path> [width= aspect= spp= depth= vfov= lookfrom=x,y,z lookat=x,y,z
+//          vup=x,y,z defocus= focus= priority=]      -> OK <job id>
+//   CANCEL <job id>                                  -> OK | ERR ...
+//   STATUS <job id>                                  -> <job id> <state> and timings in ms
+//   WAIT <job id>                                    -> same as STATUS once the job has ended
+//
+// Jobs are known to CANCEL, STATUS and WAIT until job_history later jobs have ended.
+//   PRELOAD <scene id>                               -> OK <build ms>
+//   SHUTDOWN                                         -> OK
+class render_server
+{
+public:
+    render_server(const std::string &socket_path, int workers = 1)
+        : socket_path(socket_path), worker_count(workers < 1 ? 1 : workers),
+          job_threads(std::max(1, omp_get_max_threads() / worker_count)) {}
+
+    ~render_server()
+    {
+        stop();
+    }
+
+    // Serves connections until a SHUTDOWN command arrives. Returns non-zero if the socket
+    // could not be set up or stopped accepting connections.
+    int run()
+    {
+        listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0)
+        {
+            std::cerr << "render_server: socket: " << std::strerror(errno) << '\n';
+            return 1;
+        }
+
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof(addr.sun_path))
+        {
+            std::cerr << "render_server: socket path too long\n";
+            return 1;
+        }
+        std::strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+        unlink(socket_path.c_str());
+
+        if (bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || listen(listen_fd, 16) < 0)
+        {
+            std::cerr << "render_server: bind " << socket_path << ": " << std::strerror(errno) << '\n';
+            return 1;
+        }
+
+        for (int i = 0; i < worker_count; i++)
+            workers.emplace_back([this] { worker_loop(); });
+
+        std::clog << "render_server: listening on " << socket_path << " with " << worker_count << " worker(s) of "
+                  << job_threads << " thread(s)\n";
+
+        int status = 0;
+        while (!stopping)
+        {
+            int fd = accept(listen_fd, nullptr, nullptr);
+            if (fd < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (!stopping)
+                {
+                    std::cerr << "render_server: accept: " << std::strerror(errno) << '\n';
+                    status = 1;
+                }
+                break;
+            }
+            reap_clients();
+            std::lock_guard<std::mutex> lock(clients_mutex);
+            client_fds.push_back(fd);
+            clients.emplace_back();
+            client_thread &client = clients.back();
+            client.thread = std::thread([this, fd, &client] { serve_client(fd, client); });
+        }
+
+        stop();
+        return status;
+    }
+
+private:
+    enum class job_state
+    {
+        queued,
+        running,
+        done,
+        cancelled,
+        failed
+    };
+
+    struct render_job
+    {
+        int id = 0;
+        int priority = 0;
+        std::string scene_id;
+        std::string output_path;
+        camera cam;
+
+        std::atomic<bool> cancel{false};
+        job_state state = job_state::queued;
+        std::string error;
+
+        std::chrono::steady_clock::time_point submitted;
+        double queue_ms = 0;
+        double scene_ms = 0;
+        double render_ms = 0;
+        double write_ms = 0;
+    };
+
+    using job_ptr = std::shared_ptr<render_job>;
+
+    struct job_order
+    {
+        // Higher priority first, then submission order.
+        bool operator()(const job_ptr &a, const job_ptr &b) const
+        {
+            if (a->priority != b->priority)
+                return a->priority < b->priority;
+            return a->id > b->id;
+        }
+    };
+
+    // A connection's thread, joined by the accept loop once finished is set.
+    struct client_thread
+    {
+        std::thread thread;
+        std::atomic<bool> finished{false};
+    };
+
+    std::string socket_path;
+    int worker_count;
+    int job_threads; // OpenMP threads per job
+    std::atomic<bool> stopping{false};
+
+    // SHUTDOWN reads the listening socket from a connection's thread while stop() may be
+    // closing it, so both hold listen_mutex. run() sets it before any connection is served.
+    std::mutex listen_mutex;
+    int listen_fd = -1;
+
+    std::vector<std::thread> workers;
+    std::mutex clients_mutex;
+    std::list<client_thread> clients;
+    std::vector<int> client_fds;
+
+    // Guards the queue, the job table and all job state/timing fields.
+    std::mutex jobs_mutex;
+    std::condition_variable jobs_changed;
+    std::priority_queue<job_ptr, std::vector<job_ptr>, job_order> queue;
+    std::map<int, job_ptr> jobs;
+    int next_job_id = 1;
+
+    // Ended jobs, oldest first. Beyond job_history of them the oldest are dropped from jobs,
+    // so a long-running server does not grow with every job it has served.
+    static constexpr size_t job_history = 1024;
+    std::deque<int> ended_jobs;
+
+    // Scenes by id, as futures so a scene is built once, outside scenes_mutex, while requests
+    // for other scenes go on.
+    using scene_future = std::shared_future<std::shared_ptr<const hittable_list>>;
+    std::mutex scenes_mutex;
+    std::map<std::string, scene_future> scenes;
+
+    static double ms_since(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void stop()
+    {
+        if (stopping.exchange(true) && workers.empty() && clients.empty())
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(listen_mutex);
+            if (listen_fd >= 0)
+            {
+                shutdown(listen_fd, SHUT_RDWR);
+                close(listen_fd);
+                listen_fd = -1;
+                unlink(socket_path.c_str());
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(jobs_mutex);
+            for (auto &entry : jobs)
+                entry.second->cancel = true;
+        }
+        jobs_changed.notify_all();
+        for (auto &t : workers)
+            t.join();
+        workers.clear();
+
+        std::list<client_thread> finished;
+        {
+            std::lock_guard<std::mutex> lock(clients_mutex);
+            for (int fd : client_fds)
+                shutdown(fd, SHUT_RDWR);
+            finished.swap(clients);
+        }
+        for (auto &client : finished)
+            client.thread.join();
+    }
+
+    // Joins the threads of connections that have closed.
+    void reap_clients()
+    {
+        std::list<client_thread> finished;
+        {
+            std::lock_guard<std::mutex> lock(clients_mutex);
+            for (auto it = clients.begin(); it != clients.end();)
+            {
+                auto next = std::next(it);
+                if (it->finished)
+                    finished.splice(finished.end(), clients, it);
+                it = next;
+            }
+        }
+        for (auto &client : finished)
+            client.thread.join();
+    }
+
+    // Returns the cached scene for id, building it on first use, or nullptr for unknown ids.
+    // build_ms is the time spent building the scene or waiting for its build, 0 once cached.
+    std::shared_ptr<const hittable_list> get_scene(const std::string &id, double &build_ms)
+    {
+        auto start = std::chrono::steady_clock::now();
+        build_ms = 0;
+        std::promise<std::shared_ptr<const hittable_list>> built;
+        scene_future scene;
+        {
+            std::lock_guard<std::mutex> lock(scenes_mutex);
+            auto it = scenes.find(id);
+            if (it != scenes.end())
+                scene = it->second;
+            else
+                scenes[id] = built.get_future().share();
+        }
+
+        if (scene.valid())
+        {
+            if (scene.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                scene.wait();
+                build_ms = ms_since(start);
+            }
+            return scene.get();
+        }
+
+        auto world = make_shared<hittable_list>();
+        if (!make_scene(id, *world))
+        {
+            // Unknown ids are not cached.
+            {
+                std::lock_guard<std::mutex> lock(scenes_mutex);
+                scenes.erase(id);
+            }
+            built.set_value(nullptr);
+            return nullptr;
+        }
+        built.set_value(world);
+        build_ms = ms_since(start);
+        return world;
+    }
+
+    void worker_loop()
+    {
+        // Parallel regions started from this thread get its share of the threads.
+        omp_set_num_threads(job_threads);
+        while (true)
+        {
+            job_ptr job;
+            {
+                std::unique_lock<std::mutex> lock(jobs_mutex);
+                jobs_changed.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (stopping)
+                    return;
+                job = queue.top();
+                queue.pop();
+                if (job->state != job_state::queued)
+                    continue;
+                job->state = job_state::running;
+                job->queue_ms = ms_since(job->submitted);
+            }
+            run_job(*job);
+            jobs_changed.notify_all();
+        }
+    }
+
+    void run_job(render_job &job)
+    {
+        double scene_ms;
+        auto world = get_scene(job.scene_id, scene_ms);
+        if (!world)
+        {
+            finish_job(job, job_state::failed, "unknown scene " + job.scene_id);
+            return;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<color> pixels = job.cam.render_frame(*world, &job.cancel);
+        double render_ms = ms_since(start);
+
+        if (job.cancel)
+        {
+            finish_job(job, job_state::cancelled, "", scene_ms, render_ms);
+            return;
+        }
+
+        start = std::chrono::steady_clock::now();
+        std::ofstream out(job.output_path);
+        if (out)
+            job.cam.write_image(out, pixels);
+        if (!out)
+        {
+            finish_job(job, job_state::failed, "cannot write " + job.output_path, scene_ms, render_ms);
+            return;
+        }
+        finish_job(job, job_state::done, "", scene_ms, render_ms, ms_since(start));
+    }
+
+    void finish_job(render_job &job, job_state state, const std::string &error,
+                    double scene_ms = 0, double render_ms = 0, double write_ms = 0)
+    {
+        std::string line;
+        {
+            std::lock_guard<std::mutex> lock(jobs_mutex);
+            job.state = state;
+            job.error = error;
+            job.scene_ms = scene_ms;
+            job.render_ms = render_ms;
+            job.write_ms = write_ms;
+            line = describe(job);
+            retire(job);
+        }
+        std::clog << "render_server: " << line << '\n';
+    }
+
+    // Records that job has ended, forgetting the oldest ended jobs beyond job_history. Caller
+    // must hold jobs_mutex.
+    void retire(const render_job &job)
+    {
+        ended_jobs.push_back(job.id);
+        while (ended_jobs.size() > job_history)
+        {
+            jobs.erase(ended_jobs.front());
+            ended_jobs.pop_front();
+        }
+    }
+
+    static const char *state_name(job_state state)
+    {
+        switch (state)
+        {
+        case job_state::queued:
+            return "queued";
+        case job_state::running:
+            return "running";
+        case job_state::done:
+            return "done";
+        case job_state::cancelled:
+            return "cancelled";
+        default:
+            return "failed";
+        }
+    }
+
+    // Caller must hold jobs_mutex.
+    static std::string describe(const render_job &job)
+    {
+        std::ostringstream s;
+        s << job.id << ' ' << state_name(job.state)
+          << " queue_ms=" << job.queue_ms
+          << " scene_ms=" << job.scene_ms
+          << " render_ms=" << job.render_ms
+          << " write_ms=" << job.write_ms;
+        if (!job.error.empty())
+            s << " error=\"" << job.error << '"';
+        return s.str();
+    }
+
+    static bool parse_vec3(const std::string &text, vec3 &v)
+    {
+        std::istringstream s(text);
+        char c1, c2;
+        double x, y, z;
+        if (!(s >> x >> c1 >> y >> c2 >> z) || c1 != ',' || c2 != ',')
+            return false;
+        v = vec3(x, y, z);
+        return true;
+    }
+
+    // Parses the key=value arguments of a RENDER command into job. Returns an error message,
+    // or an empty string on success.
+    static std::string parse_job(std::istringstream &args, render_job &job)
+    {
+        job.cam.aspect_ratio = 16.0 / 9.0;
+        job.cam.image_width = 400;
+        job.cam.samples_per_pixel = 100;
+        job.cam.max_depth = 50;
+
+        std::string token;
+        while (args >> token)
+        {
+            auto eq = token.find('=');
+            if (eq == std::string::npos)
+                return "expected key=value, got " + token;
+            std::string key = token.substr(0, eq);
+            std::string value = token.substr(eq + 1);
+
+            try
+            {
+                if (key == "scene")
+                    job.scene_id = value;
+                else if (key == "out")
+                    job.output_path = value;
+                else if (key == "priority")
+                    job.priority = std::stoi(value);
+                else if (key == "width")
+                    job.cam.image_width = std::stoi(value);
+                else if (key == "aspect")
+                    job.cam.aspect_ratio = std::stod(value);
+                else if (key == "spp")
+                    job.cam.samples_per_pixel = std::stoi(value);
+                else if (key == "depth")
+                    job.cam.max_depth = std::stoi(value);
+                else if (key == "vfov")
+                    job.cam.vfov = std::stod(value);
+                else if (key == "defocus")
+                    job.cam.defocus_angle = std::stod(value);
+                else if (key == "focus")
+                    job.cam.focus_dist = std::stod(value);
+                else if (key == "lookfrom" || key == "lookat" || key == "vup")
+                {
+                    vec3 &target = key == "lookfrom" ? job.cam.lookfrom : key == "lookat" ? job.cam.lookat : job.cam.vup;
+                    if (!parse_vec3(value, target))
+                        return "bad vector for " + key;
+                }
+                else
+                    return "unknown key " + key;
+            }
+            catch (const std::exception &)
+            {
+                return "bad value for " + key;
+            }
+        }
+
+        if (job.scene_id.empty() || job.output_path.empty())
+            return "scene and out are required";
+        if (job.cam.image_width < 1 || job.cam.samples_per_pixel < 1 || job.cam.aspect_ratio <= 0)
+            return "width, spp and aspect must be positive";
+        return "";
+    }
+
+    std::string handle_command(const std::string &line)
+    {
+        std::istringstream args(line);
+        std::string command;
+        args >> command;
+
+        if (command == "RENDER")
+        {
+            auto job = std::make_shared<render_job>();
+            std::string error = parse_job(args, *job);
+            if (!error.empty())
+                return "ERR " + error;
+
+            std::lock_guard<std::mutex> lock(jobs_mutex);
+            job->id = next_job_id++;
+            job->submitted = std::chrono::steady_clock::now();
+            jobs[job->id] = job;
+            queue.push(job);
+            jobs_changed.notify_all();
+            return "OK " + std::to_string(job->id);
+        }
+
+        if (command == "CANCEL" || command == "STATUS" || command == "WAIT")
+        {
+            int id;
+            if (!(args >> id))
+                return "ERR missing job id";
+
+            std::unique_lock<std::mutex> lock(jobs_mutex);
+            auto it = jobs.find(id);
+            if (it == jobs.end())
+                return "ERR unknown job " + std::to_string(id);
+            job_ptr job = it->second;
+
+            if (command == "CANCEL")
+            {
+                if (job->state != job_state::queued && job->state != job_state::running)
+                    return "ERR job already " + std::string(state_name(job->state));
+                job->cancel = true;
+                if (job->state == job_state::queued)
+                {
+                    job->state = job_state::cancelled;
+                    retire(*job);
+                }
+                return "OK";
+            }
+            if (command == "WAIT")
+            {
+                jobs_changed.wait(lock, [&] {
+                    return stopping || (job->state != job_state::queued && job->state != job_state::running);
+                });
+            }
+            return describe(*job);
+        }
+
+        if (command == "PRELOAD")
+        {
+            std::string id;
+            args >> id;
+            double build_ms;
+            if (!get_scene(id, build_ms))
+                return "ERR unknown scene " + id;
+            return "OK " + std::to_string(build_ms);
+        }
+
+        if (command == "SHUTDOWN")
+        {
+            stopping = true;
+            jobs_changed.notify_all();
+            std::lock_guard<std::mutex> lock(listen_mutex);
+            if (listen_fd >= 0)
+                shutdown(listen_fd, SHUT_RDWR);
+            return "OK";
+        }
+
+        return "ERR unknown command " + command;
+    }
+
+    void serve_client(int fd, client_thread &client)
+    {
+        std::string buffer;
+        char chunk[1024];
+        ssize_t n;
+        while ((n = read(fd, chunk, sizeof(chunk))) > 0)
+        {
+            buffer.append(chunk, size_t(n));
+            size_t newline;
+            while ((newline = buffer.find('\n')) != std::string::npos)
+            {
+                std::string line = buffer.substr(0, newline);
+                buffer.erase(0, newline + 1);
+                if (!line.empty() && line.back() == '\r')
+                    line.pop_back();
+                if (line.empty())
+                    continue;
+
+                std::string reply = handle_command(line) + "\n";
+                if (write(fd, reply.data(), reply.size()) < 0)
+                    break;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        client_fds.erase(std::remove(client_fds.begin(), client_fds.end(), fd), client_fds.end());
+        close(fd);
+        client.finished = true;
+    }
+};
+
+#endif
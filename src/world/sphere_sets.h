@@ -0,0 +1,63 @@
+#ifndef SPHERE_SETS_H
+#define SPHERE_SETS_H
+
+#include "hittable_list.h"
+
+#include "../objects/sphere_set.h"
+
+#include <algorithm>
+#include <vector>
+
+// Replaces the spheres of world, including those in nested lists, with sphere_sets of at most
+// set_size spheres each, grouped by splitting at the median of their centers along the widest
+// axis so each set is compact. Other objects stay as they are, and nested lists are flattened.
+// Returns the number of sets made.
+inline size_t make_sphere_sets(hittable_list &world, size_t set_size = sphere_set::lanes)
+{
+    std::vector<shared_ptr<sphere>> spheres;
+    hittable_list kept;
+    std::vector<shared_ptr<hittable>> pending(world.objects.rbegin(), world.objects.rend());
+    while (!pending.empty())
+    {
+        auto object = pending.back();
+        pending.pop_back();
+        if (auto s = std::dynamic_pointer_cast<sphere>(object))
+            spheres.push_back(s);
+        else if (auto list = std::dynamic_pointer_cast<hittable_list>(object))
+            pending.insert(pending.end(), list->objects.rbegin(), list->objects.rend());
+        else
+            kept.add(object);
+    }
+
+    size_t sets = 0;
+    auto group = [&](auto &&self, size_t begin, size_t end) -> void {
+        if (end - begin <= std::max<size_t>(set_size, 1))
+        {
+            auto set = make_shared<sphere_set>();
+            for (size_t k = begin; k < end; k++)
+                set->add(*spheres[k]);
+            kept.add(set);
+            sets++;
+            return;
+        }
+        aabb centers;
+        for (size_t k = begin; k < end; k++)
+            centers = aabb(centers, aabb(spheres[k]->center_point(), spheres[k]->center_point()));
+        vec3 extent = centers.extent();
+        int axis = extent.x() >= extent.y() ? (extent.x() >= extent.z() ? 0 : 2) : (extent.y() >= extent.z() ? 1 : 2);
+        size_t mid = begin + (end - begin) / 2;
+        std::nth_element(spheres.begin() + begin, spheres.begin() + mid, spheres.begin() + end,
+                         [&](const shared_ptr<sphere> &a, const shared_ptr<sphere> &b) {
+                             return a->center_point()[axis] < b->center_point()[axis];
+                         });
+        self(self, begin, mid);
+        self(self, mid, end);
+    };
+    if (!spheres.empty())
+        group(group, 0, spheres.size());
+
+    world = std::move(kept);
+    return sets;
+}
+
+#endif